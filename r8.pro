@@ -0,0 +1,12 @@
+#-------------------------------------------------
+#
+# R8: GUI simulator (r8asm) and headless runner (r8run)
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS += r8asm r8run
+
+r8asm.file = r8asm.pro
+r8run.file = r8run.pro
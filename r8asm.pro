@@ -11,25 +11,27 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 TARGET = r8asm
 TEMPLATE = app
 
+OBJECTS_DIR = .obj/r8asm
+MOC_DIR     = .moc/r8asm
+
+include(r8core.pri)
 
 SOURCES += main.cpp\
         r8asmwindow.cpp \
-    r8engine.cpp \
-    r8compiler.cpp \
-    r8charstream.cpp \
     r8sourceeditor.cpp \
     r8syntaxhighlighter.cpp \
-    r8lexer.cpp \
-    r8inputdialog.cpp
+    r8inputdialog.cpp \
+    r8enginethread.cpp \
+    r8memorymodel.cpp \
+    r8blockcompiler.cpp
 
 HEADERS  += r8asmwindow.h \
-    r8engine.h \
-    r8compiler.h \
-    r8charstream.h \
     r8sourceeditor.h \
     r8syntaxhighlighter.h \
-    r8lexer.h \
-    r8inputdialog.h
+    r8inputdialog.h \
+    r8enginethread.h \
+    r8memorymodel.h \
+    r8blockcompiler.h
 
 FORMS    += r8asmwindow.ui \
     r8inputdialog.ui
@@ -1,20 +1,26 @@
 #include "r8asmwindow.h"
 
 #include <QComboBox>
+#include <QDockWidget>
+#include <QHBoxLayout>
+#include <QLabel>
 #include <QFileDialog>
+#include <QHeaderView>
 #include <QMessageBox>
 #include <QTextDocumentWriter>
 #include <QFile>
 #include <QTextStream>
 #include <QSettings>
+#include <QTimer>
 
 #include "ui_r8asmwindow.h"
 
 #include "r8charstream.h"
+#include "r8enginethread.h"
 #include "r8inputdialog.h"
 #include "r8sourceeditor.h"
 
-R8AsmWindow::R8AsmWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::R8AsmWindow) {
+R8AsmWindow::R8AsmWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::R8AsmWindow), mCurrentState(EDIT_STATE), mBlockCompiler(&mCompiler) {
     ui->setupUi(this);
 
     InitRegisterViewModes();
@@ -27,11 +33,14 @@ R8AsmWindow::R8AsmWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::R8As
     ViewAllRegisters();
     ViewAllMemory();
 
-    AttachInputDialog();
+    AttachPorts();
+    mEngine.SetLoopDetectionEnabled(true); //Run stops on "jz 0,l1" loops by itself
+    InitEngineThread();
     ConnectEngineSignals();
     ConnectEditorSignals();
 
     InitActions();
+    InitInputTape();
 
     InitMenu();
     InitToolBar();
@@ -40,13 +49,12 @@ R8AsmWindow::R8AsmWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::R8As
     InitStatusbar();
 
     SetEngineCommandSetVariant(0);
-    InitCharStream();
 }
 
 R8AsmWindow::~R8AsmWindow() {
+    StopEngineThread();
     delete ui;
     delete mInputPort;
-    delete mCharStream ;
 }
 
 void R8AsmWindow::on_r0Title_clicked() { ShiftRegisterViewFor(0); }
@@ -61,47 +69,16 @@ void R8AsmWindow::on_r7Title_clicked() { ShiftRegisterViewFor(7); }
 void R8AsmWindow::SetEngineCommandSetVariant(int variant) {
     ClearCommandSet();
 
-    if (variant <= 0) {
-        SetZeroCommandSet();
-        return;
-    }
-
-    --variant;
-
-    SetCommonCommands();
-
-    SetShiftsVariant(variant % SHIFTS_COUNT);
-    variant = variant / SHIFTS_COUNT;
-
-    SetLogicsVariant(variant % LOGICS_COUNT);
-    variant = variant / LOGICS_COUNT;
-
-    SetArithmeticsVariant(variant % ARITHMETICS_COUNT);
-    variant = variant / ARITHMETICS_COUNT;
-
-    SetJumpsVariant(variant % JUMPS_COUNT);
-
-    ShiftCurrentStateTo(EDIT_STATE);
-
-    RehighlightSource();
-}
-
-void R8AsmWindow::SetZeroCommandSet() {
-    SetCommonCommands();
-
-    SetLogicAnd();
-    SetLogicNot();
-    SetLogicOr();
-    SetLogicXor();
-
-    SetShiftROL();
-    SetShiftROR();
-
-    SetArithmeticsAdd();
-    SetArithmeticsSub();
+    mCommandSet.SetVariant(variant);
+    mCommandSet.ApplyTo(mCompiler);
+    mBlockCompiler.Invalidate();
 
-    SetJumpJo();
-    SetJumpJz();
+    QListIterator<R8CommandInfo> it(mCommandSet.Commands());
+    while (it.hasNext()) {
+        const R8CommandInfo& info = it.next();
+        ui->commandsListWidget->addItem(tr(info.Help()));
+        mSyntaxHighlighter->SetAvailableCommand(info.Name(), info.Descriptor());
+    }
 
     ShiftCurrentStateTo(EDIT_STATE);
 
@@ -116,211 +93,6 @@ void R8AsmWindow::ClearCommandSet() {
 
 void R8AsmWindow::RehighlightSource() { mSyntaxHighlighter->rehighlight(); }
 
-void R8AsmWindow::SetCommonCommands() {
-    SetInCommand();
-    SetOutCommand();
-}
-
-void R8AsmWindow::SetShiftsVariant(int variant) {
-    Q_ASSERT(variant < SHIFTS_COUNT);
-
-    static const TVariantPtr sShifts[SHIFTS_COUNT] = {
-        &R8AsmWindow::SetShiftROR,
-        &R8AsmWindow::SetShiftROL};
-    (this->*(sShifts[variant]))();
-}
-
-void R8AsmWindow::SetLogicsVariant(int variant) {
-    Q_ASSERT(variant < LOGICS_COUNT);
-
-    static const TVariantPtr sLogics[LOGICS_COUNT] = {
-        &R8AsmWindow::SetLogicAndNot,
-        &R8AsmWindow::SetLogicOrNot,
-        &R8AsmWindow::SetLogicXorOr,
-        &R8AsmWindow::SetLogicXorAnd,
-        &R8AsmWindow::SetLogicNand,
-        &R8AsmWindow::SetLogicNor
-    };
-    (this->*(sLogics[variant]))();
-}
-
-void R8AsmWindow::SetArithmeticsVariant(int variant) {
-    Q_ASSERT(variant < ARITHMETICS_COUNT);
-
-    static const TVariantPtr sArithmetics[ARITHMETICS_COUNT] = {
-        &R8AsmWindow::SetArithmeticsAdd,
-        &R8AsmWindow::SetArithmeticsSub
-    };
-    (this->*(sArithmetics[variant]))();
-}
-
-void R8AsmWindow::SetJumpsVariant(int variant) {
-    Q_ASSERT(variant < JUMPS_COUNT);
-
-    static const TVariantPtr sJumps[JUMPS_COUNT] = {
-        &R8AsmWindow::SetJumpJz,
-        &R8AsmWindow::SetJumpJo
-    };
-    (this->*(sJumps[variant]))();
-}
-
-void R8AsmWindow::SetLogicAndNot() {
-    SetLogicAnd();
-    SetLogicNot();
-}
-
-void R8AsmWindow::SetLogicOrNot() {
-    SetLogicOr();
-    SetLogicNot();
-}
-
-void R8AsmWindow::SetLogicXorOr() {
-    SetLogicXor();
-    SetLogicOr();
-}
-
-void R8AsmWindow::SetLogicXorAnd() {
-    SetLogicXor();
-    SetLogicAnd();
-}
-
-void R8AsmWindow::SetInCommand() {
-    mCompiler.SetAvailableCommand(
-                QString("IN"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_DST, R8Instruction::IN_OPCODE));
-    ui->commandsListWidget->addItem(tr("in <dst>   ;dst := input"));
-    mSyntaxHighlighter->SetAvailableCommand(
-                QString("IN"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_DST, R8Instruction::IN_OPCODE));
-}
-
-void R8AsmWindow::SetOutCommand() {
-    mCompiler.SetAvailableCommand(
-                QString("OUT"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC, R8Instruction::OUT_OPCODE));
-    ui->commandsListWidget->addItem(tr("out <src>   ;output := src"));
-    mSyntaxHighlighter->SetAvailableCommand(
-                QString("OUT"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC, R8Instruction::OUT_OPCODE));
-}
-
-void R8AsmWindow::SetShiftROR() {
-    mCompiler.SetAvailableCommand(
-                QString("ROR"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::ROR_OPCODE));
-    ui->commandsListWidget->addItem(tr("ror <src1>, <src2>, <dst>   ;dst := src1 >>> src2"));
-    mSyntaxHighlighter->SetAvailableCommand(
-                QString("ROR"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::ROR_OPCODE));
-}
-
-void R8AsmWindow::SetShiftROL() {
-    mCompiler.SetAvailableCommand(
-                QString("ROL"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::ROL_OPCODE));
-    ui->commandsListWidget->addItem(tr("rol <src1>, <src2>, <dst>   ;dst := src1 <<< src2"));
-    mSyntaxHighlighter->SetAvailableCommand(
-                QString("ROL"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::ROL_OPCODE));
-}
-
-void R8AsmWindow::SetLogicNot() {
-    mCompiler.SetAvailableCommand(
-                QString("NOT"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC_DST, R8Instruction::NOT_OPCODE));
-    ui->commandsListWidget->addItem(tr("not <src>, <dst>   ;dst := NOT(src)"));
-    mSyntaxHighlighter->SetAvailableCommand(
-                QString("NOT"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC_DST, R8Instruction::NOT_OPCODE));
-}
-
-void R8AsmWindow::SetLogicXor() {
-    mCompiler.SetAvailableCommand(
-                QString("XOR"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::XOR_OPCODE));
-    ui->commandsListWidget->addItem(tr("xor <src1>, <src2>, <dst>   ;dst := XOR(src1,src2)"));
-    mSyntaxHighlighter->SetAvailableCommand(
-                QString("XOR"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::XOR_OPCODE));
-}
-
-void R8AsmWindow::SetLogicAnd() {
-    mCompiler.SetAvailableCommand(
-                QString("AND"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::AND_OPCODE));
-    ui->commandsListWidget->addItem(tr("and <src1>, <src2>, <dst>   ;dst := AND(src1,src2)"));
-    mSyntaxHighlighter->SetAvailableCommand(
-                QString("AND"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::AND_OPCODE));
-}
-
-void R8AsmWindow::SetLogicOr() {
-    mCompiler.SetAvailableCommand(
-                QString("OR"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::OR_OPCODE));
-    ui->commandsListWidget->addItem(tr("or <src1>, <src2>, <dst>   ;dst := OR(src1,src2)"));
-    mSyntaxHighlighter->SetAvailableCommand(
-                QString("OR"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::OR_OPCODE));
-}
-
-void R8AsmWindow::SetLogicNand() {
-    mCompiler.SetAvailableCommand(
-                QString("NAND"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::NAND_OPCODE));
-    ui->commandsListWidget->addItem(tr("nand <src1>, <src2>, <dst>   ;dst := NOT(AND(src1,src2))"));
-}
-
-void R8AsmWindow::SetLogicNor() {
-    mCompiler.SetAvailableCommand(
-                QString("NOR"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::NOR_OPCODE));
-    ui->commandsListWidget->addItem(tr("nor <src1>, <src1>, <dst>   ;dst := NOT(OR(src1,src2))"));
-    mSyntaxHighlighter->SetAvailableCommand(
-                QString("NOR"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::NOR_OPCODE));
-}
-
-void R8AsmWindow::SetArithmeticsAdd() {
-    mCompiler.SetAvailableCommand(
-                QString("ADD"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::ADD_OPCODE));
-    ui->commandsListWidget->addItem(tr("add <src1>, <src2>, <dst>   ;dst := src1 + src2"));
-    mSyntaxHighlighter->SetAvailableCommand(
-                QString("ADD"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::ADD_OPCODE));
-}
-
-void R8AsmWindow::SetArithmeticsSub() {
-    mCompiler.SetAvailableCommand(
-                QString("SUB"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::SUB_OPCODE));
-    ui->commandsListWidget->addItem(tr("sub <src1>, <src2>, <dst>  ;dst := src1 - src2"));
-    mSyntaxHighlighter->SetAvailableCommand(
-                QString("SUB"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::SUB_OPCODE));
-}
-
-void R8AsmWindow::SetJumpJz() {
-    mCompiler.SetAvailableCommand(
-                QString("JZ"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC_LABEL, R8Instruction::JZ_OPCODE));
-    ui->commandsListWidget->addItem(tr("jz <src>, <lbl>   ;if (src=0x00) goto lbl"));
-    mSyntaxHighlighter->SetAvailableCommand(
-                QString("JZ"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC_LABEL, R8Instruction::JZ_OPCODE));
-}
-
-void R8AsmWindow::SetJumpJo() {
-    mCompiler.SetAvailableCommand(
-                QString("JO"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC_LABEL, R8Instruction::JO_OPCODE));
-    ui->commandsListWidget->addItem(tr("jo <src>, <lbl>   ;if (src=0xFF) goto lbl"));
-    mSyntaxHighlighter->SetAvailableCommand(
-                QString("JO"),
-                R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC_LABEL, R8Instruction::JO_OPCODE));
-}
-
 void R8AsmWindow::InitRegisterViewModes() {
     for (unsigned int i = 0; i<R8Engine::REGISTERS_COUNT; ++i)
         mRegisterViewMode[i] = HEX_MODE;
@@ -335,30 +107,21 @@ void R8AsmWindow::InitRegisterViews() {
     mRegisterView[5] = ui->r5LineEdit;
     mRegisterView[6] = ui->r6LineEdit;
     mRegisterView[7] = ui->r7LineEdit;
+
+    for (unsigned int i = 0; i<R8Engine::REGISTERS_COUNT; ++i)
+        mShownRegisters[i] = -1;
 }
 
 void R8AsmWindow::InitMemoryTable() {
-    int rowCount = (R8Engine::MEMORY_SIZE + MEMORY_TABLE_COLUMN_COUNT - 1) / MEMORY_TABLE_COLUMN_COUNT ;
-
-    ui->memoryTable->setColumnCount(MEMORY_TABLE_COLUMN_COUNT);
-    ui->memoryTable->setRowCount(rowCount);
-
-    QStringList columnLabels;
-    for (int i=0; i<MEMORY_TABLE_COLUMN_COUNT ; ++i)
-        columnLabels.append(QString("%1").arg(i, 0, MEMORY_TABLE_COLUMN_COUNT ).toUpper());
-    ui->memoryTable->setHorizontalHeaderLabels(columnLabels);
-
-    QStringList rowLabels;
-    for (int i=0; i<rowCount; ++i)
-        rowLabels.append(QString("0x%1").arg(QString("%1").arg(i, 0, MEMORY_TABLE_COLUMN_COUNT).toUpper()));
-    ui->memoryTable->setVerticalHeaderLabels(rowLabels);
-
-    for (int ri=0; ri<rowCount; ++ri)
-        for (int ci=0; ci<MEMORY_TABLE_COLUMN_COUNT ; ++ci) {
-            QTableWidgetItem *item = new QTableWidgetItem();
-            item->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled);
-            ui->memoryTable->setItem(ri, ci, item);
-        }
+    mMemoryModel = new R8MemoryModel(&mEngine, this);
+    ui->memoryTable->setModel(mMemoryModel);
+
+    const int cellWidth = ui->memoryTable->fontMetrics().width(QString("00")) + 2*MEMORY_CELL_MARGIN;
+    QHeaderView *header = ui->memoryTable->horizontalHeader();
+    header->setMinimumSectionSize(cellWidth);
+    header->setDefaultSectionSize(cellWidth);
+    header->setSectionResizeMode(QHeaderView::Fixed);
+    ui->memoryTable->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
 }
 
 void R8AsmWindow::InitSourceEditor() {
@@ -369,6 +132,25 @@ void R8AsmWindow::InitSyntaxHighlighter() {
     mSyntaxHighlighter = new R8SyntaxHighlighter(ui->sourcePlainText->document());
 }
 
+void R8AsmWindow::InitInputTape() {
+    QWidget *tape = new QWidget();
+    mInputTapeEdit = new QLineEdit(tape);
+    mInputTapeEdit->setPlaceholderText(tr("Values for \"in\": 1, 2, 0x10"));
+    mInputTapeLabel = new QLabel(tape);
+
+    QHBoxLayout *layout = new QHBoxLayout(tape);
+    layout->addWidget(mInputTapeEdit, 1);
+    layout->addWidget(mInputTapeLabel);
+
+    mInputTapeDock = new QDockWidget(tr("Input tape"), this);
+    mInputTapeDock->setObjectName("inputTapeDock");
+    mInputTapeDock->setWidget(tape);
+    addDockWidget(Qt::BottomDockWidgetArea, mInputTapeDock);
+
+    connect(mInputTapeEdit, SIGNAL(textChanged(QString)), this, SLOT(SlotInputTapeChanged()));
+    ViewInputTape();
+}
+
 void R8AsmWindow::InitMenu() {
     QMenu *fileMenu = new QMenu(tr("&File"));
     fileMenu->addAction(mOpenSourceAction);
@@ -387,6 +169,8 @@ void R8AsmWindow::InitMenu() {
     programMenu->addAction(mStopAction);
     programMenu->addAction(mSetBreakpointAction);
     programMenu->addAction(mResetAction);
+    programMenu->addSeparator();
+    programMenu->addAction(mInputTapeDock->toggleViewAction());
 
     QMenu *helpMenu = new QMenu(tr("&Help"));
     QAction *aboutAction = helpMenu->addAction(tr("About R8"));
@@ -499,17 +283,13 @@ void R8AsmWindow::InitActions() {
 
 void R8AsmWindow::InitStatusbar() {
     QComboBox *combo = new QComboBox();
-    for (int i=0; i<VARIANTS_COUNT; ++i) {
+    for (int i=0; i<R8CommandSet::VARIANTS_COUNT; ++i) {
         combo->addItem(QString(tr("Command set #%1").arg(i)));
     }
     connect(combo, SIGNAL(currentIndexChanged(int)), this, SLOT(SlotArchitectureVariant(int)));
     statusBar()->addWidget(combo, 100);
 }
 
-void R8AsmWindow::InitCharStream() {
-    mCharStream = new R8SourceEditorCharStream();
-}
-
 void R8AsmWindow::ShiftRegisterViewFor(int index) {
     Q_ASSERT((unsigned int)index < R8Engine::REGISTERS_COUNT);
 
@@ -525,13 +305,18 @@ void R8AsmWindow::ShiftRegisterViewFor(int index) {
         mRegisterViewMode[index] = BIN_MODE;
     }
 
+    mShownRegisters[index] = -1;
     ViewRegister(index);
 }
 
 void R8AsmWindow::ViewRegister(int index) {
     Q_ASSERT((unsigned int)index < R8Engine::REGISTERS_COUNT);
 
-    mRegisterView[index]->setText(FormatCell(mEngine.Register(index), mRegisterViewMode[index]));
+    const int value = mEngine.Register(index);
+    if (value == mShownRegisters[index])
+        return;
+    mShownRegisters[index] = value;
+    mRegisterView[index]->setText(FormatCell(value, mRegisterViewMode[index]));
 }
 
 void R8AsmWindow::ViewAllRegisters() {
@@ -540,17 +325,11 @@ void R8AsmWindow::ViewAllRegisters() {
 }
 
 void R8AsmWindow::ViewMemory(int index) {
-    int row = index / MEMORY_TABLE_COLUMN_COUNT;
-    int col = index % MEMORY_TABLE_COLUMN_COUNT;
-
-    QTableWidgetItem *item = ui->memoryTable->item(row, col);
-    item->setText(QString("%1").arg(mEngine.MemoryCell(index), 2, 16, QLatin1Char('0')));
+    mMemoryModel->RefreshCell(index);
 }
 
 void R8AsmWindow::ViewAllMemory() {
-    for (unsigned int i=0; i<R8Engine::MEMORY_SIZE; ++i)
-        ViewMemory(i);
-    ui->memoryTable->resizeColumnsToContents();
+    mMemoryModel->Refresh();
 }
 
 void R8AsmWindow::ViewIP() {
@@ -558,7 +337,7 @@ void R8AsmWindow::ViewIP() {
         HideIpMarkInEditor();
         return;
     }
-    mSourceEditor->SetIpAtLine(mCompiler.SourceLineForIp(mEngine.IP()));
+    mSourceEditor->SetIpAtLine(mBlockCompiler.SourceLineForIp(mEngine.IP()));
 }
 
 void R8AsmWindow::ViewExecutionTime() {
@@ -582,11 +361,53 @@ void R8AsmWindow::ViewExecutionTime() {
     }
 }
 
+void R8AsmWindow::ViewInputTape() {
+    mInputTapeLabel->setText(QString(tr("%1 of %2 read")).arg(mInputPort->TapeReadCount()).arg(mInputPort->TapeCount()));
+}
+
+void R8AsmWindow::ViewOutput(unsigned char value) {
+    ui->outputListWidget->insertItem(
+                0,
+                QString("0x%1 (0b%2, %3)")
+                    .arg((unsigned int)value, 2, 16, QLatin1Char('0'))
+                         .arg((unsigned int)value, 8, 2,  QLatin1Char('0'))
+                         .arg((unsigned int)value));
+}
+
+void R8AsmWindow::ViewOutputs() {
+    const QVector<unsigned char> values = mOutputPort.Take();
+    for (int i=0; i<values.size(); ++i)
+        ViewOutput(values[i]);
+}
+
+// Registers and cells written since the last view; the engine may be running
+void R8AsmWindow::ViewDirtyState() {
+    R8DirtyBits& bits = mEngine.DirtyBits();
+
+    const unsigned int registers = bits.TakeRegisters();
+    for (unsigned int i=0; i<R8Engine::REGISTERS_COUNT; ++i) {
+        if (registers & (1u << i))
+            ViewRegister(i);
+    }
+    for (int word=0; word<R8DirtyBits::MEMORY_WORDS_COUNT; ++word) {
+        const unsigned int cells = bits.TakeMemoryCells(word);
+        for (int bit=0; (cells >> bit) != 0; ++bit) {
+            if (cells & (1u << bit))
+                ViewMemory(32*word + bit);
+        }
+    }
+
+    ViewExecutionTime();
+    ViewOutputs();
+}
+
 void R8AsmWindow::ShowR8State() {
+    ViewDirtyState();
     ViewAllRegisters();
     ViewAllMemory();
     ViewIP();
     ViewExecutionTime();
+    ViewInputTape();
 }
 
 QString R8AsmWindow::FormatCell(unsigned char value, R8AsmWindow::EByteViewMode mode) const {
@@ -603,21 +424,41 @@ QString R8AsmWindow::FormatCell(unsigned char value, R8AsmWindow::EByteViewMode
     }
 }
 
-void R8AsmWindow::AttachInputDialog() {
+void R8AsmWindow::AttachPorts() {
     mInputPort = new R8UiInputPort();
     mEngine.SetInputPort(mInputPort);
+    mEngine.SetOutputPort(&mOutputPort);
+}
+
+void R8AsmWindow::InitEngineThread() {
+    mEngineThread = new R8EngineThread(&mEngine, &mOutputPort, this);
+    connect(mEngineThread, SIGNAL(finished()), this, SLOT(SlotEngineThreadFinished()));
+
+    mViewTimer = new QTimer(this);
+    mViewTimer->setInterval(VIEW_INTERVAL_MSECS);
+    connect(mViewTimer, SIGNAL(timeout()), this, SLOT(SlotViewTimer()));
+}
+
+void R8AsmWindow::StartEngineThread() {
+    SetEngineBreakpoints();
+    mEngineThread->Start();
+    mViewTimer->start();
+}
+
+void R8AsmWindow::StopEngineThread() {
+    mEngineThread->Stop();
+    mViewTimer->stop();
 }
 
 void R8AsmWindow::ConnectEngineSignals() {
     connect(&mEngine, SIGNAL(SignalReset()),                     this, SLOT(SlotEngineReset()));
     connect(&mEngine, SIGNAL(SignalHalt()),                      this, SLOT(SlotEngineHalt()));
-    connect(&mEngine, SIGNAL(SignalOutput(unsigned char)),       this, SLOT(SlotEngineOutput(unsigned char)));
-    connect(&mEngine, SIGNAL(SignalWriteRegister(unsigned int)), this, SLOT(SlotEngineWriteRegister(unsigned int)));
-    connect(&mEngine, SIGNAL(SignalWriteMemory(unsigned int)),   this, SLOT(SlotEngineWriteMemory(unsigned int)));
 }
 
 void R8AsmWindow::ConnectEditorSignals() {
+    mBlockCompiler.SetDocument(mSourceEditor->document());
     connect(mSourceEditor, SIGNAL(textChanged()), this, SLOT(SlotSourceChanged()));
+    connect(mSourceEditor->document(), SIGNAL(contentsChange(int,int,int)), this, SLOT(SlotSourceContentsChange(int,int,int)));
 }
 
 void R8AsmWindow::DescribeCompilerException(const R8CompilerException &ex) {
@@ -652,6 +493,12 @@ void R8AsmWindow::DescribeCompilerException(const R8CompilerException &ex) {
     case R8CompilerException::REGISTER_EXPECTED:
         ErrorMessage(tr("Register name expected instead \"%1\"").arg(ex.Info()), ex.LineNumber());
         break;
+    case R8CompilerException::MODULE_EXPECTED:
+        ErrorMessage(tr("Module name expected"), ex.LineNumber());
+        break;
+    case R8CompilerException::INCLUDE_NOT_ALLOWED:
+        ErrorMessage(tr("\"include %1\" is allowed in modules only").arg(ex.Info()), ex.LineNumber());
+        break;
     default:
         ErrorMessage(tr("Error of unknown type"), ex.LineNumber());
     }
@@ -673,25 +520,14 @@ void R8AsmWindow::ErrorMessage(const QString &message, int line) {
     mSourceEditor->SetIpAtLine(line);
 }
 
-bool R8AsmWindow::IsBreakedIp(int ip) const {
-    int currLine = mCompiler.SourceLineForIp(ip);
-    int nextLine = mCompiler.SourceLineForIp(ip + 1);
-
-    if (currLine >= 0) {
-        if (nextLine >= 0) {
-            if (nextLine > currLine)
-                return mSourceEditor->IsBreakointBetweenLines(currLine, nextLine - 1);
-        }
-        return mSourceEditor->IsBreakointBetweenLines(currLine, currLine);
-    } else
-        return false;
-}
-
 void R8AsmWindow::HideIpMarkInEditor() {
     mSourceEditor->SetIpAtLine(-1);
 }
 
 void R8AsmWindow::ShiftCurrentStateTo(R8AsmWindow::EState state) {
+    if (IsCurrentStateIs(RUN_STATE) && (state != RUN_STATE))
+        StopEngineThread(); //the engine is the window's again
+
     mCurrentState = state;
 
     SetActionsForState(state);
@@ -710,6 +546,7 @@ void R8AsmWindow::SetActionsForState(EState state) {
         mOpenSourceAction->setEnabled(true);
         mSaveSourceAction->setEnabled(true);
         mSaveSourceAsAction->setEnabled(true);
+        mInputTapeEdit->setReadOnly(false);
         break;
     case STEP_STATE:
         mStepAction->setEnabled(true);
@@ -721,6 +558,7 @@ void R8AsmWindow::SetActionsForState(EState state) {
         mOpenSourceAction->setEnabled(true);
         mSaveSourceAction->setEnabled(true);
         mSaveSourceAsAction->setEnabled(true);
+        mInputTapeEdit->setReadOnly(false);
         break;
     case RUN_STATE:
         mStepAction->setEnabled(false);
@@ -732,6 +570,7 @@ void R8AsmWindow::SetActionsForState(EState state) {
         mOpenSourceAction->setEnabled(false);
         mSaveSourceAction->setEnabled(false);
         mSaveSourceAsAction->setEnabled(false);
+        mInputTapeEdit->setReadOnly(true); //the engine thread reads the tape
         break;
     case HALT_STATE:
         mStepAction->setEnabled(false);
@@ -743,6 +582,7 @@ void R8AsmWindow::SetActionsForState(EState state) {
         mOpenSourceAction->setEnabled(false);
         mSaveSourceAction->setEnabled(false);
         mSaveSourceAsAction->setEnabled(false);
+        mInputTapeEdit->setReadOnly(false);
         break;
     default:
         Q_ASSERT(false);
@@ -760,43 +600,78 @@ void R8AsmWindow::SetEditorForState(R8AsmWindow::EState state) {
 }
 
 void R8AsmWindow::Step() {
-    unsigned int line = mCompiler.SourceLineForIp(mEngine.IP());
+    unsigned int line = mBlockCompiler.SourceLineForIp(mEngine.IP());
 
     try {
         mEngine.Step();
     } catch (R8Exception& ex) {
+        mOutputPort.Flush();
+        ViewOutputs();
         ui->outputListWidget->insertItem(0, QString(tr("Execution error: \"%1\" at %2")).arg(ex.Message()).arg(line));
         mEngine.Halt();
     }
+    mOutputPort.Flush();
+    ViewDirtyState();
 }
 
 void R8AsmWindow::SlotEngineReset() {
     ui->outputListWidget->clear();
+    mOutputPort.Clear();
+    mInputPort->Rewind();
     ShowR8State();
 }
 
 void R8AsmWindow::SlotEngineHalt() {
+    if (!mEngine.IsHalted()) //queued from the engine thread before a reset
+        return;
     ShiftCurrentStateTo(HALT_STATE);
 
     ShowR8State();
 }
 
-void R8AsmWindow::SlotEngineOutput(unsigned char value) {
-    value = value;
-    ui->outputListWidget->insertItem(
-                0,
-                QString("0x%1 (0b%2, %3)")
-                    .arg((unsigned int)value, 2, 16, QLatin1Char('0'))
-                         .arg((unsigned int)value, 8, 2,  QLatin1Char('0'))
-                         .arg((unsigned int)value));
+void R8AsmWindow::SlotEngineThreadFinished() {
+    if (mEngineThread->isRunning()) //of a run stopped and started again
+        return;
+    mViewTimer->stop();
+
+    if (!mEngineThread->ErrorMessage().isEmpty()) {
+        ViewOutputs();
+        ui->outputListWidget->insertItem(0, QString(tr("Execution error: \"%1\" at %2")).arg(mEngineThread->ErrorMessage()).arg(mBlockCompiler.SourceLineForIp(mEngine.IP())));
+        mEngine.Halt();
+    } else if (IsCurrentStateIs(RUN_STATE)) {
+        switch (mEngineThread->Status()) {
+        case R8Engine::BREAKPOINT_STATUS:
+            ShiftCurrentStateTo(STEP_STATE);
+            break;
+        case R8Engine::INPUT_NEEDED_STATUS: //the tape is over, the dialog asks
+            Step();
+            if (IsCurrentStateIs(RUN_STATE)) {
+                StartEngineThread();
+                return;
+            }
+            break;
+        default: //halted, SlotEngineHalt() follows
+            break;
+        }
+    }
+
+    if (!IsCurrentStateIs(RUN_STATE))
+        ShowR8State();
 }
 
-void R8AsmWindow::SlotEngineWriteRegister(unsigned int index) {
-    ViewRegister(index);
+void R8AsmWindow::SlotViewTimer() {
+    ViewDirtyState();
 }
 
-void R8AsmWindow::SlotEngineWriteMemory(unsigned int index) {
-    ViewMemory(index);
+// Editing the tape rewinds it
+void R8AsmWindow::SlotInputTapeChanged() {
+    QVector<unsigned char> values;
+    if (!R8BufferInputPort::ParseValues(mInputTapeEdit->text(), values)) {
+        mInputTapeLabel->setText(tr("Bad value"));
+        return;
+    }
+    mInputPort->SetTape(values);
+    ViewInputTape();
 }
 
 void R8AsmWindow::SlotSourceChanged() {
@@ -806,6 +681,10 @@ void R8AsmWindow::SlotSourceChanged() {
     ViewIP();
 }
 
+void R8AsmWindow::SlotSourceContentsChange(int position, int, int charsAdded) {
+    mBlockCompiler.MarkChanged(position, charsAdded);
+}
+
 void R8AsmWindow::SlotSaveSource() {
     if (mSourcePath.isEmpty()) {
         QString fileName = QFileDialog::getSaveFileName(
@@ -900,13 +779,12 @@ void R8AsmWindow::SlotRussian() {
 
 void R8AsmWindow::SlotCompile() {
     try {
-        mCharStream->SetSourceTextBlock(mSourceEditor->document()->begin());
-        mCompiler.SetSource(mCharStream);
-        mCompiler.Compile();
+        mBlockCompiler.Compile();
 
         ShiftCurrentStateTo(STEP_STATE);
 
-        mEngine.SetProgram(mCompiler.CompiledCode());
+        mEngine.SetProgram(mBlockCompiler.CompiledCode());
+        SetEngineBreakpoints();
     } catch (const R8CompilerException& compilerEx) {
         DescribeCompilerException(compilerEx);
 
@@ -919,27 +797,33 @@ void R8AsmWindow::SlotCompile() {
 }
 
 void R8AsmWindow::SlotStep() {
-    mSourceEditor->SetIpAtLine(mCompiler.SourceLineForIp(mEngine.IP()));
+    mSourceEditor->SetIpAtLine(mBlockCompiler.SourceLineForIp(mEngine.IP()));
     Step();
-    mSourceEditor->SetIpAtLine(mCompiler.SourceLineForIp(mEngine.IP()));
-    ViewExecutionTime();
+    mSourceEditor->SetIpAtLine(mBlockCompiler.SourceLineForIp(mEngine.IP()));
+    ViewInputTape();
 }
 
 void R8AsmWindow::SlotRun() {
     ShiftCurrentStateTo(RUN_STATE);
 
     HideIpMarkInEditor();
+    StartEngineThread();
+}
 
-    while (IsCurrentStateIs(RUN_STATE)) {
-        Step();
-        if (IsBreakedIp(mEngine.IP())) {
-            ShiftCurrentStateTo(STEP_STATE);
-            break;
-        }
-        qApp->processEvents();
-    }
+// A breakpoint stops at the command its line belongs to, see R8Compiler
+void R8AsmWindow::SetEngineBreakpoints() {
+    QVector<bool> breakpoints(mBlockCompiler.CompiledCode().Length(), false);
 
-    ShowR8State();
+    const QList<int>& lines = mSourceEditor->Breakpoints();
+    for (int i=0; i<lines.size(); ++i) {
+        int ip = mBlockCompiler.IpForSourceLine(lines[i]);
+        if (ip < 0)
+            continue;
+        breakpoints[ip] = true;
+        while (mBlockCompiler.SourceLineForIp(ip + 1) == lines[i]) //more commands on the line
+            breakpoints[++ip] = true;
+    }
+    mEngine.SetBreakpoints(breakpoints);
 }
 
 void R8AsmWindow::SlotReset() {
@@ -954,6 +838,13 @@ void R8AsmWindow::SlotStop() {
 
 void R8AsmWindow::SlotSetBreakpoint() {
     mSourceEditor->AddOrRemoveBreakpointAt(mSourceEditor->textCursor().blockNumber());
+
+    if (IsCurrentStateIs(RUN_STATE)) { //the engine takes breakpoints when it starts
+        StopEngineThread();
+        StartEngineThread();
+    } else if (!IsCurrentStateIs(EDIT_STATE)) {
+        SetEngineBreakpoints();
+    }
 }
 
 void R8AsmWindow::SlotArchitectureVariant(int variant) {
@@ -5,16 +5,24 @@
 
 #include <QLineEdit>
 
+#include "r8memorymodel.h"
+
+#include "r8blockcompiler.h"
 #include "r8compiler.h"
+#include "r8commandset.h"
+#include "r8ports.h"
 #include "r8syntaxhighlighter.h"
 
 namespace Ui {
 class R8AsmWindow;
 }
 
-class R8InputPort;
+class QDockWidget;
+class QLabel;
+class QTimer;
+class R8EngineThread;
+class R8UiInputPort;
 class R8SourceEditor;
-class R8SourceEditorCharStream;
 
 class R8AsmWindow : public QMainWindow
 {
@@ -27,7 +35,6 @@ public:
 private:
     Ui::R8AsmWindow *ui;
 
-    typedef void (R8AsmWindow::*TVariantPtr)();
     enum EState {
         EDIT_STATE,
         STEP_STATE,
@@ -42,23 +49,21 @@ private:
         DEC_MODE
     };
 
-    static const int SHIFTS_COUNT      = 2; // rol, ror
-    static const int LOGICS_COUNT      = 6; // {and,not},{or,not},{xor,or}, nand, nor, {xor,and}
-    static const int ARITHMETICS_COUNT = 2; // add,sub
-    static const int JUMPS_COUNT       = 2; // jz,jo
-
-    static const int VARIANTS_COUNT    = SHIFTS_COUNT * LOGICS_COUNT * ARITHMETICS_COUNT * JUMPS_COUNT + 1;
-
-    static const int MEMORY_TABLE_COLUMN_COUNT = 16;
+    static const int MEMORY_CELL_MARGIN = 4; //pixels on each side of a cell text
+    static const int VIEW_INTERVAL_MSECS = 16; //of the view while the engine runs, ~60 fps
 
     EState                    mCurrentState;
 
-    R8Compiler                mCompiler;
+    R8CommandSet              mCommandSet;
+    R8Compiler                mCompiler;      //of a line, for mBlockCompiler
+    R8BlockCompiler           mBlockCompiler;
     R8Engine                  mEngine;
     R8SyntaxHighlighter      *mSyntaxHighlighter;
-    R8InputPort              *mInputPort;
+    R8UiInputPort            *mInputPort;
+    R8QueuedOutputPort        mOutputPort;
+    R8EngineThread           *mEngineThread;
+    QTimer                   *mViewTimer;
     R8SourceEditor           *mSourceEditor;
-    R8SourceEditorCharStream *mCharStream;
 
     QAction                  *mSaveSourceAction,
                              *mSaveSourceAsAction,
@@ -70,53 +75,28 @@ private:
                              *mStopAction,
                              *mSetBreakpointAction;
 
+    QDockWidget              *mInputTapeDock;
+    QLineEdit                *mInputTapeEdit;
+    QLabel                   *mInputTapeLabel;
+
     QString                   mSourcePath;
 
     EByteViewMode mRegisterViewMode[R8Engine::REGISTERS_COUNT];
     QLineEdit *mRegisterView[R8Engine::REGISTERS_COUNT];
+    int mShownRegisters[R8Engine::REGISTERS_COUNT]; //values in mRegisterView, -1 to view anew
+    R8MemoryModel *mMemoryModel;
 
     void SetEngineCommandSetVariant(int variant);
-    void SetZeroCommandSet();
 
     void ClearCommandSet();
     void RehighlightSource();
 
-    void SetCommonCommands();
-
-    void SetShiftsVariant(int variant);
-    void SetLogicsVariant(int variant);
-    void SetArithmeticsVariant(int variant);
-    void SetJumpsVariant(int variant);
-
-    void SetLogicAndNot();
-    void SetLogicOrNot();
-    void SetLogicXorOr();
-    void SetLogicXorAnd();
-
-    void SetInCommand();
-    void SetOutCommand();
-
-    void SetShiftROR();
-    void SetShiftROL();
-
-    void SetLogicNot();
-    void SetLogicXor();
-    void SetLogicAnd();
-    void SetLogicOr();
-    void SetLogicNand();
-    void SetLogicNor();
-
-    void SetArithmeticsAdd();
-    void SetArithmeticsSub();
-
-    void SetJumpJz();
-    void SetJumpJo();
-
     void InitRegisterViewModes();
     void InitRegisterViews();
     void InitMemoryTable();
     void InitSourceEditor();
     void InitSyntaxHighlighter();
+    void InitInputTape();
 
     void InitMenu();
     void InitToolBar();
@@ -125,8 +105,6 @@ private:
     void InitActions();
     void InitStatusbar();
 
-    void InitCharStream();
-
     void ShiftRegisterViewFor(int index);
     void ViewRegister(int index);
     void ViewAllRegisters();
@@ -134,12 +112,19 @@ private:
     void ViewAllMemory();
     void ViewIP();
     void ViewExecutionTime();
+    void ViewInputTape();
+    void ViewOutput(unsigned char value);
+    void ViewOutputs(); //flushed to mOutputPort
+    void ViewDirtyState();
 
     void ShowR8State();
 
     QString FormatCell(unsigned char value, EByteViewMode mode) const;
 
-    void AttachInputDialog();
+    void AttachPorts();
+    void InitEngineThread();
+    void StartEngineThread();
+    void StopEngineThread();
     void ConnectEngineSignals();
     void ConnectEditorSignals();
 
@@ -147,7 +132,7 @@ private:
     void DescribeLexerException(const R8LexerException& ex);
     void ErrorMessage(const QString& message, int line);
 
-    bool IsBreakedIp(int ip) const;
+    void SetEngineBreakpoints();
     void HideIpMarkInEditor();
 
     EState CurrentState() const {return mCurrentState;}
@@ -161,11 +146,12 @@ private:
 private slots:
     void SlotEngineReset();
     void SlotEngineHalt();
-    void SlotEngineOutput(unsigned char value);
-    void SlotEngineWriteRegister(unsigned int index);
-    void SlotEngineWriteMemory(unsigned int index);
+    void SlotEngineThreadFinished();
+    void SlotViewTimer();
 
     void SlotSourceChanged();
+    void SlotSourceContentsChange(int position, int charsRemoved, int charsAdded);
+    void SlotInputTapeChanged();
 
     void SlotSaveSource();
     void SlotSaveAsSource();
@@ -0,0 +1,258 @@
+#include "r8vectorengine.h"
+
+R8BitPlane R8BitPlane::Fill(bool bit) {
+    R8BitPlane plane;
+    for (int w=0; w<WORDS_COUNT; ++w)
+        plane.Words[w] = bit ? ~Q_UINT64_C(0) : Q_UINT64_C(0);
+    return plane;
+}
+
+bool R8BitPlane::IsEmpty() const {
+    quint64 any = 0;
+    for (int w=0; w<WORDS_COUNT; ++w)
+        any |= Words[w];
+    return (any == 0);
+}
+
+R8BitPlane R8BitPlane::operator~() const {
+    R8BitPlane plane;
+    for (int w=0; w<WORDS_COUNT; ++w)
+        plane.Words[w] = ~Words[w];
+    return plane;
+}
+
+R8BitPlane R8BitPlane::operator&(const R8BitPlane &plane) const {
+    R8BitPlane result;
+    for (int w=0; w<WORDS_COUNT; ++w)
+        result.Words[w] = Words[w] & plane.Words[w];
+    return result;
+}
+
+R8BitPlane R8BitPlane::operator|(const R8BitPlane &plane) const {
+    R8BitPlane result;
+    for (int w=0; w<WORDS_COUNT; ++w)
+        result.Words[w] = Words[w] | plane.Words[w];
+    return result;
+}
+
+R8BitPlane R8BitPlane::operator^(const R8BitPlane &plane) const {
+    R8BitPlane result;
+    for (int w=0; w<WORDS_COUNT; ++w)
+        result.Words[w] = Words[w] ^ plane.Words[w];
+    return result;
+}
+
+// ALU operations of R8BitLanes::Alu<>() on the 8 planes of x, y and r,
+// bit 0 first; the same results as TOperation::Apply() for every lane.
+template<class TOperation> struct R8BitOperation;
+
+template<> struct R8BitOperation<R8OrOperation> {
+    static void Apply(const R8BitPlane *x, const R8BitPlane *y, R8BitPlane *r) {
+        for (int i=0; i<8; ++i) r[i] = x[i] | y[i];
+    }
+};
+
+template<> struct R8BitOperation<R8AndOperation> {
+    static void Apply(const R8BitPlane *x, const R8BitPlane *y, R8BitPlane *r) {
+        for (int i=0; i<8; ++i) r[i] = x[i] & y[i];
+    }
+};
+
+template<> struct R8BitOperation<R8NorOperation> {
+    static void Apply(const R8BitPlane *x, const R8BitPlane *y, R8BitPlane *r) {
+        for (int i=0; i<8; ++i) r[i] = ~(x[i] | y[i]);
+    }
+};
+
+template<> struct R8BitOperation<R8NandOperation> {
+    static void Apply(const R8BitPlane *x, const R8BitPlane *y, R8BitPlane *r) {
+        for (int i=0; i<8; ++i) r[i] = ~(x[i] & y[i]);
+    }
+};
+
+template<> struct R8BitOperation<R8XorOperation> {
+    static void Apply(const R8BitPlane *x, const R8BitPlane *y, R8BitPlane *r) {
+        for (int i=0; i<8; ++i) r[i] = x[i] ^ y[i];
+    }
+};
+
+template<> struct R8BitOperation<R8NotOperation> {
+    static void Apply(const R8BitPlane *x, const R8BitPlane *, R8BitPlane *r) {
+        for (int i=0; i<8; ++i) r[i] = ~x[i];
+    }
+};
+
+// Ripple carry adder; sub is x + ~y + 1
+static void R8AddPlanes(const R8BitPlane *x, const R8BitPlane *y, bool isSub, R8BitPlane *r) {
+    R8BitPlane carry = R8BitPlane::Fill(isSub);
+    for (int i=0; i<8; ++i) {
+        R8BitPlane b = isSub ? ~y[i] : y[i];
+        R8BitPlane half = x[i] ^ b;
+        r[i]  = half ^ carry;
+        carry = (x[i] & b) | (carry & half);
+    }
+}
+
+template<> struct R8BitOperation<R8AddOperation> {
+    static void Apply(const R8BitPlane *x, const R8BitPlane *y, R8BitPlane *r) {R8AddPlanes(x, y, false, r);}
+};
+
+template<> struct R8BitOperation<R8SubOperation> {
+    static void Apply(const R8BitPlane *x, const R8BitPlane *y, R8BitPlane *r) {R8AddPlanes(x, y, true, r);}
+};
+
+// Barrel rotation by y % 8: stage k rotates by 2^k the lanes with bit k of y
+static void R8RotatePlanes(const R8BitPlane *x, const R8BitPlane *y, bool isLeft, R8BitPlane *r) {
+    for (int i=0; i<8; ++i)
+        r[i] = x[i];
+
+    for (int k=0; k<3; ++k) {
+        const int shift = (1 << k);
+        R8BitPlane rotated[8];
+        for (int i=0; i<8; ++i)
+            rotated[i] = r[isLeft ? ((i + 8 - shift) % 8) : ((i + shift) % 8)];
+        for (int i=0; i<8; ++i)
+            r[i] = (rotated[i] & y[k]) | (r[i] & ~y[k]);
+    }
+}
+
+template<> struct R8BitOperation<R8RolOperation> {
+    static void Apply(const R8BitPlane *x, const R8BitPlane *y, R8BitPlane *r) {R8RotatePlanes(x, y, true, r);}
+};
+
+template<> struct R8BitOperation<R8RorOperation> {
+    static void Apply(const R8BitPlane *x, const R8BitPlane *y, R8BitPlane *r) {R8RotatePlanes(x, y, false, r);}
+};
+
+
+void R8BitLanes::Clear() {
+    const R8BitPlane zero = R8BitPlane::Fill(false);
+    for (unsigned int index=0; index<R8BatchEngine::REGISTERS_COUNT; ++index) {
+        for (int i=0; i<8; ++i)
+            mRegisters[index].Bits[i] = zero;
+    }
+    for (unsigned int index=0; index<R8BatchEngine::MEMORY_SIZE; ++index) {
+        for (int i=0; i<8; ++i)
+            mMemoryCells[index].Bits[i] = zero;
+    }
+}
+
+unsigned char R8BitLanes::Unslice(const TByte &x, int lane) {
+    unsigned char result = 0;
+    for (int i=0; i<8; ++i)
+        result |= ((x.Bits[i].Words[lane / 64] >> (lane % 64)) & 1) << i;
+    return result;
+}
+
+R8BitPlane R8BitLanes::MaskPlane(const unsigned char *mask) {
+    R8BitPlane plane = R8BitPlane::Fill(false);
+    for (int lane=0; lane<LANES_COUNT; ++lane)
+        plane.Words[lane / 64] |= (quint64)(mask[lane] & 1) << (lane % 64);
+    return plane;
+}
+
+// Lanes where x == expected
+R8BitPlane R8BitLanes::EqualsPlane(const TByte &x, unsigned char expected) {
+    R8BitPlane plane = R8BitPlane::Fill(true);
+    for (int i=0; i<8; ++i)
+        plane = plane & (((expected >> i) & 1) ? x.Bits[i] : ~x.Bits[i]);
+    return plane;
+}
+
+void R8BitLanes::ReadByte(unsigned char mode, unsigned char value, TByte &x) const {
+    switch (mode) {
+    case R8Reference::REGISTER:
+        x = mRegisters[value];
+        break;
+    case R8Reference::MEMORY_BY_CONSTANT:
+        x = mMemoryCells[value];
+        break;
+    case R8Reference::MEMORY_BY_REGISTER: {
+        const TByte& address = mRegisters[value];
+        for (int i=0; i<8; ++i)
+            x.Bits[i] = R8BitPlane::Fill(false);
+        for (unsigned int index=0; index<R8BatchEngine::MEMORY_SIZE; ++index) {
+            R8BitPlane match = EqualsPlane(address, index);
+            if (match.IsEmpty())
+                continue;
+            for (int i=0; i<8; ++i)
+                x.Bits[i] = x.Bits[i] | (mMemoryCells[index].Bits[i] & match);
+        }
+        break;
+    }
+    default: //CONSTANT
+        for (int i=0; i<8; ++i)
+            x.Bits[i] = R8BitPlane::Fill((value >> i) & 1);
+        break;
+    }
+}
+
+void R8BitLanes::WriteByte(unsigned char mode, unsigned char value, const TByte &r, const R8BitPlane &mask) {
+    if (mode == R8Reference::MEMORY_BY_REGISTER) {
+        const TByte address = mRegisters[value];
+        for (unsigned int index=0; index<R8BatchEngine::MEMORY_SIZE; ++index) {
+            R8BitPlane match = EqualsPlane(address, index) & mask;
+            if (match.IsEmpty())
+                continue;
+            TByte& cell = mMemoryCells[index];
+            for (int i=0; i<8; ++i)
+                cell.Bits[i] = (r.Bits[i] & match) | (cell.Bits[i] & ~match);
+        }
+        return;
+    }
+
+    TByte& x = (mode == R8Reference::REGISTER) ? mRegisters[value] : mMemoryCells[value];
+    for (int i=0; i<8; ++i)
+        x.Bits[i] = (r.Bits[i] & mask) | (x.Bits[i] & ~mask);
+}
+
+void R8BitLanes::Read(unsigned char mode, unsigned char value, unsigned char *x) const {
+    TByte planes;
+    ReadByte(mode, value, planes);
+    for (int lane=0; lane<LANES_COUNT; ++lane)
+        x[lane] = Unslice(planes, lane);
+}
+
+void R8BitLanes::Write(unsigned char mode, unsigned char value, const unsigned char *r, const unsigned char *mask) {
+    TByte planes;
+    for (int i=0; i<8; ++i)
+        planes.Bits[i] = R8BitPlane::Fill(false);
+    for (int lane=0; lane<LANES_COUNT; ++lane) {
+        for (int i=0; i<8; ++i)
+            planes.Bits[i].Words[lane / 64] |= (quint64)((r[lane] >> i) & 1) << (lane % 64);
+    }
+    WriteByte(mode, value, planes, MaskPlane(mask));
+}
+
+void R8BitLanes::Equals(unsigned char mode, unsigned char value, unsigned char expected, unsigned char *isEqual) const {
+    TByte planes;
+    ReadByte(mode, value, planes);
+
+    R8BitPlane plane = EqualsPlane(planes, expected);
+    for (int lane=0; lane<LANES_COUNT; ++lane)
+        isEqual[lane] = ((plane.Words[lane / 64] >> (lane % 64)) & 1) ? 0xFF : 0x00;
+}
+
+template<class TOperation>
+void R8BitLanes::Alu(const R8DecodedInstruction &d, const unsigned char *mask) {
+    TByte x, y, r;
+    ReadByte(d.Mode1, d.Value1, x);
+    ReadByte(d.Mode2, d.Value2, y);
+    R8BitOperation<TOperation>::Apply(x.Bits, y.Bits, r.Bits);
+    WriteByte(d.ModeR, d.ValueR, r, MaskPlane(mask));
+}
+
+R8BitLanes::TAluHandler R8BitLanes::SelectAlu(unsigned char opcode) {
+    switch (opcode) {
+    case R8Instruction::ROR_OPCODE:  return &R8BitLanes::Alu<R8RorOperation>;
+    case R8Instruction::ROL_OPCODE:  return &R8BitLanes::Alu<R8RolOperation>;
+    case R8Instruction::NOT_OPCODE:  return &R8BitLanes::Alu<R8NotOperation>;
+    case R8Instruction::OR_OPCODE:   return &R8BitLanes::Alu<R8OrOperation>;
+    case R8Instruction::AND_OPCODE:  return &R8BitLanes::Alu<R8AndOperation>;
+    case R8Instruction::NOR_OPCODE:  return &R8BitLanes::Alu<R8NorOperation>;
+    case R8Instruction::NAND_OPCODE: return &R8BitLanes::Alu<R8NandOperation>;
+    case R8Instruction::XOR_OPCODE:  return &R8BitLanes::Alu<R8XorOperation>;
+    case R8Instruction::ADD_OPCODE:  return &R8BitLanes::Alu<R8AddOperation>;
+    default:                         return &R8BitLanes::Alu<R8SubOperation>;
+    }
+}
@@ -0,0 +1,230 @@
+#include "r8blockcompiler.h"
+
+#include <QTextDocument>
+
+#include "r8charstream.h"
+
+R8BlockCompiler::R8BlockCompiler(R8Compiler *lineCompiler) :
+    mLineCompiler(lineCompiler),mDocument(0),mGeneration(0),mIsLinked(false),mLinkedBlocksCount(0) {}
+
+void R8BlockCompiler::SetDocument(QTextDocument *document) {
+    mDocument = document;
+    Invalidate();
+}
+
+void R8BlockCompiler::Invalidate() {
+    ++mGeneration;
+    mIsLinked = false;
+    mChangedBlocks.clear();
+}
+
+void R8BlockCompiler::MarkChanged(int position, int charsAdded) {
+    if (!mIsLinked)
+        return; //all the blocks are looked at anyway
+
+    for (QTextBlock block = mDocument->findBlock(position); block.isValid() && (block.position() <= position + charsAdded); block = block.next()) {
+        if (mChangedBlocks.size() == MAX_CHANGED_BLOCKS) {
+            mIsLinked = false;
+            mChangedBlocks.clear();
+            return;
+        }
+        mChangedBlocks.append(block);
+    }
+}
+
+void R8BlockCompiler::Compile() {
+    Q_ASSERT(mDocument != 0);
+
+    if (!Patch())
+        Link();
+    mChangedBlocks.clear();
+}
+
+bool R8BlockCompiler::IsCompiled(const QTextBlock &block, const R8BlockCode *code) const {
+    return (code != 0) && (code->Revision == block.revision()) && (code->Generation == mGeneration);
+}
+
+R8BlockCode *R8BlockCompiler::CodeOf(QTextBlock block) {
+    R8BlockCode *code = static_cast<R8BlockCode*>(block.userData());
+    if (code == 0) {
+        code = new R8BlockCode();
+        block.setUserData(code); //the document owns it
+    }
+    if (!IsCompiled(block, code))
+        CompileBlock(block, code);
+    return code;
+}
+
+void R8BlockCompiler::CompileBlock(const QTextBlock &block, R8BlockCode *code) {
+    code->Revision   = block.revision();
+    code->Generation = mGeneration;
+    code->Instructions.clear();
+    code->Labels.clear();
+    code->Jumps.clear();
+    code->IsError = false;
+
+    R8StringCharStream charStream(block.text());
+    mLineCompiler->SetSource(&charStream);
+    try {
+        mLineCompiler->CompileFragment(&code->Labels, &code->Jumps);
+        const R8Program& program = mLineCompiler->CompiledCode();
+        for (int i=0; i<program.Length(); ++i)
+            code->Instructions.append(program.Instruction(i));
+    } catch (const R8CompilerException& ex) {
+        code->IsError      = true;
+        code->IsLexerError = false;
+        code->ErrorType    = ex.Type();
+        code->ErrorInfo    = ex.Info();
+    } catch (const R8LexerException& ex) {
+        code->IsError      = true;
+        code->IsLexerError = true;
+        code->ErrorType    = ex.Type();
+        code->ErrorInfo    = ex.Info();
+    }
+    mLineCompiler->SetSource(0);
+}
+
+void R8BlockCompiler::Link() {
+    mIsLinked = false;
+    mProgram.Clear();
+    mLabels.clear();
+    mJumps.clear();
+    mSourceLines.clear();
+    mIps.clear();
+
+    int line = 0;
+    int lastCommandLine = -1;
+    for (QTextBlock block = mDocument->begin(); block.isValid(); block = block.next(), ++line) {
+        R8BlockCode *code = CodeOf(block);
+        if (code->IsError)
+            ThrowError(code, line);
+
+        code->FirstIp = mProgram.Length();
+        for (int i=0; i<code->Instructions.size(); ++i) {
+            mProgram.AddInstruction(code->Instructions[i]);
+            mSourceLines.append(line);
+        }
+        if (!code->Instructions.isEmpty())
+            lastCommandLine = line;
+        mIps.append(code->Instructions.isEmpty() ? ((int)code->FirstIp - 1) : (int)code->FirstIp); //-1 before the first command
+
+        for (int i=0; i<code->Labels.size(); ++i) {
+            if (mLabels.contains(code->Labels[i].Name))
+                throw R8CompilerException(R8CompilerException::LABEL_REDEFINITION, line, code->Labels[i].Name);
+            mLabels.insert(code->Labels[i].Name, code->FirstIp + code->Labels[i].Ip);
+        }
+        for (int i=0; i<code->Jumps.size(); ++i)
+            mJumps[code->Jumps[i].Name].append(code->FirstIp + code->Jumps[i].Ip);
+    }
+    mIps.resize(lastCommandLine + 1); //the lines after the last command belong to none
+    mLinkedBlocksCount = line;
+
+    unsigned int unresolvedIp = (unsigned int)mProgram.Length();
+    QString      unresolvedName;
+    for (TJumps::const_iterator it = mJumps.constBegin(); it != mJumps.constEnd(); ++it)
+        ResolveJumps(it.key(), &unresolvedIp, &unresolvedName);
+    if (!unresolvedName.isNull())
+        ThrowUnresolved(unresolvedIp, unresolvedName);
+
+    mIsLinked = true;
+}
+
+// The old labels and jumps of the changed blocks are taken out before the new
+// ones are put in, so a label may move from one edited line to another.
+bool R8BlockCompiler::Patch() {
+    if (!mIsLinked || (mDocument->blockCount() != mLinkedBlocksCount))
+        return false;
+
+    QVector<TChange> changes;
+    for (int i=0; i<mChangedBlocks.size(); ++i) {
+        TChange change;
+        change.Block = mChangedBlocks[i];
+        change.Code  = static_cast<R8BlockCode*>(change.Block.userData());
+        if (!change.Block.isValid() || (change.Code == 0))
+            return false;
+        if (IsCompiled(change.Block, change.Code))
+            continue; //not edited, or already in changes
+
+        const int oldCount = change.Code->Instructions.size();
+        change.OldLabels = change.Code->Labels;
+        change.OldJumps  = change.Code->Jumps;
+        CompileBlock(change.Block, change.Code);
+        if (change.Code->IsError || (change.Code->Instructions.size() != oldCount))
+            return false;
+        changes.append(change);
+    }
+
+    mIsLinked = false; //until the patch is done
+    QList<QString> touchedLabels;
+    for (int c=0; c<changes.size(); ++c) {
+        const TChange& change = changes[c];
+        for (int i=0; i<change.OldLabels.size(); ++i) {
+            mLabels.remove(change.OldLabels[i].Name);
+            touchedLabels.append(change.OldLabels[i].Name);
+        }
+        for (int i=0; i<change.OldJumps.size(); ++i)
+            mJumps[change.OldJumps[i].Name].removeOne(change.Code->FirstIp + change.OldJumps[i].Ip);
+    }
+
+    for (int c=0; c<changes.size(); ++c) {
+        const TChange& change = changes[c];
+        const R8BlockCode *code = change.Code;
+        for (int i=0; i<code->Instructions.size(); ++i)
+            mProgram.SetInstruction(code->FirstIp + i, code->Instructions[i]);
+
+        for (int i=0; i<code->Labels.size(); ++i) {
+            if (mLabels.contains(code->Labels[i].Name))
+                throw R8CompilerException(R8CompilerException::LABEL_REDEFINITION, change.Block.blockNumber(), code->Labels[i].Name);
+            mLabels.insert(code->Labels[i].Name, code->FirstIp + code->Labels[i].Ip);
+            touchedLabels.append(code->Labels[i].Name);
+        }
+        for (int i=0; i<code->Jumps.size(); ++i) {
+            mJumps[code->Jumps[i].Name].append(code->FirstIp + code->Jumps[i].Ip);
+            touchedLabels.append(code->Jumps[i].Name);
+        }
+    }
+
+    unsigned int unresolvedIp = (unsigned int)mProgram.Length();
+    QString      unresolvedName;
+    for (int i=0; i<touchedLabels.size(); ++i)
+        ResolveJumps(touchedLabels[i], &unresolvedIp, &unresolvedName);
+    if (!unresolvedName.isNull())
+        ThrowUnresolved(unresolvedIp, unresolvedName);
+
+    mIsLinked = true;
+    return true;
+}
+
+// Points the jumps to the label at it; if it is not defined, the first of them
+// is kept for the error
+void R8BlockCompiler::ResolveJumps(const QString &name, unsigned int *unresolvedIp, QString *unresolvedName) {
+    const QVector<unsigned int> jumps = mJumps.value(name);
+    if (jumps.isEmpty())
+        return;
+
+    TLabels::const_iterator label = mLabels.constFind(name);
+    if (label == mLabels.constEnd()) {
+        for (int i=0; i<jumps.size(); ++i) {
+            if (jumps[i] < *unresolvedIp) {
+                *unresolvedIp   = jumps[i];
+                *unresolvedName = name;
+            }
+        }
+        return;
+    }
+
+    const R8Reference labelReference(R8Reference::INSTRUCTION_INDEX, label.value());
+    for (int i=0; i<jumps.size(); ++i)
+        mProgram.SetInstructionResult(jumps[i], labelReference);
+}
+
+void R8BlockCompiler::ThrowUnresolved(unsigned int ip, const QString &name) {
+    mIsLinked = false;
+    throw R8CompilerException(R8CompilerException::UNRESOLVED_LABEL, SourceLineForIp(ip), name);
+}
+
+void R8BlockCompiler::ThrowError(const R8BlockCode *code, int line) {
+    if (code->IsLexerError)
+        throw R8LexerException((R8LexerException::EType)code->ErrorType, line, code->ErrorInfo);
+    throw R8CompilerException((R8CompilerException::EType)code->ErrorType, line, code->ErrorInfo);
+}
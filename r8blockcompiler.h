@@ -0,0 +1,87 @@
+#ifndef R8BLOCKCOMPILER_H
+#define R8BLOCKCOMPILER_H
+
+#include <QHash>
+#include <QList>
+#include <QTextBlock>
+#include <QVector>
+
+#include "r8compiler.h"
+
+class QTextDocument;
+
+// The code of a source line, kept in its block until the line is edited
+class R8BlockCode : public QTextBlockUserData {
+public:
+    R8BlockCode() : Revision(-1),Generation(-1),FirstIp(0),IsError(false),IsLexerError(false),ErrorType(0) {}
+
+    int                    Revision;     //of the block when compiled
+    int                    Generation;   //of R8BlockCompiler when compiled
+    unsigned int           FirstIp;      //in the linked program
+    QVector<R8Instruction> Instructions;
+    QVector<R8LabelUse>    Labels;       //ips are of Instructions
+    QVector<R8LabelUse>    Jumps;
+    bool                   IsError;
+    bool                   IsLexerError;
+    int                    ErrorType;    //of R8CompilerException or R8LexerException
+    QString                ErrorInfo;
+};
+
+// Compiles a document a line at a time (so a command must fit in its line) and
+// links the program from the code its blocks keep: a compile lexes only the
+// lines edited since the last one. If the edits keep the number of lines and
+// the number of commands of every edited line, the program is patched in place
+// and only the jumps to the labels the edits touched are resolved again.
+class R8BlockCompiler {
+public:
+    explicit R8BlockCompiler(R8Compiler *lineCompiler);
+
+    void SetDocument(QTextDocument *document);
+    void Invalidate();                             //the commands changed, every line is compiled anew
+    void MarkChanged(int position, int charsAdded); //see QTextDocument::contentsChange()
+
+    void Compile(); //throws R8CompilerException and R8LexerException
+    const R8Program& CompiledCode() const {return mProgram;}
+
+    int  SourceLineForIp(int ip) const {return ((unsigned int)ip < (unsigned int)mSourceLines.size()) ? mSourceLines[ip] : -1;}
+    int  IpForSourceLine(int line) const {return ((unsigned int)line < (unsigned int)mIps.size()) ? mIps[line] : -1;}
+
+private:
+    typedef QHash<QString, unsigned int>           TLabels; // f: label_name -> command_index_label_points_to
+    typedef QHash<QString, QVector<unsigned int> > TJumps;  // f: label_name -> { goto_command_index }
+    typedef QVector<int>                           TIpMapping;
+
+    static const int MAX_CHANGED_BLOCKS = 1024; //more are linked anew
+
+    struct TChange {
+        QTextBlock          Block;
+        R8BlockCode        *Code;
+        QVector<R8LabelUse> OldLabels;
+        QVector<R8LabelUse> OldJumps;
+    };
+
+    R8Compiler        *mLineCompiler;
+    QTextDocument     *mDocument;
+    int                mGeneration;
+    bool               mIsLinked;          //mProgram is the code of all the blocks
+    int                mLinkedBlocksCount;
+    QList<QTextBlock>  mChangedBlocks;     //since the last compile
+
+    R8Program          mProgram;
+    TLabels            mLabels;
+    TJumps             mJumps;
+    TIpMapping         mSourceLines;       // f: opcode_index -> source_line
+    TIpMapping         mIps;               // f: source_line -> opcode_index of the command the line belongs to
+
+    R8BlockCode *CodeOf(QTextBlock block); //compiled anew if the block changed
+    bool IsCompiled(const QTextBlock& block, const R8BlockCode *code) const;
+    void CompileBlock(const QTextBlock& block, R8BlockCode *code);
+
+    void Link();
+    bool Patch(); //false if the changes need Link()
+    void ResolveJumps(const QString& name, unsigned int *unresolvedIp, QString *unresolvedName);
+    void ThrowUnresolved(unsigned int ip, const QString& name);
+    static void ThrowError(const R8BlockCode *code, int line);
+};
+
+#endif // R8BLOCKCOMPILER_H
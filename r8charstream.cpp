@@ -1,28 +1,25 @@
 #include "r8charstream.h"
 
-R8CharStream::R8CharStream() {}
+R8CharStream::R8CharStream() : mBegin(0),mEnd(0),mCurrent(0),mCurrentLine(0) {}
 
-void R8StringCharStream::SetSourceString(const QString &source) {
-    mSource = source;
-    mCurrentLine = 0;
-    mCurrentCharIndex = 0;
-}
-
-QChar R8StringCharStream::CurrentChar() const {
-    if (IsValidCurrentChar())
-        return mSource[mCurrentCharIndex];
-    return QChar(' '); //dont want throw...
-}
-
-void R8StringCharStream::GoToNextChar() {
+void R8CharStream::GoToNextChar() {
     if (IsValidCurrentChar()) {
-        QChar ch = mSource[mCurrentCharIndex];
-        if (ch == QChar('\n'))
+        if (*mCurrent == QChar('\n'))
             mCurrentLine++;
-        mCurrentCharIndex++;
+        mCurrent++;
     }
 }
 
-bool R8StringCharStream::IsValidCurrentChar() const {
-    return (mCurrentCharIndex < mSource.length());
+void R8CharStream::SetCurrent(const QChar *current, int line) {
+    Q_ASSERT((mBegin <= current) && (current <= mEnd));
+    mCurrent = current;
+    mCurrentLine = line;
+}
+
+void R8CharStream::SetSource(const QString &source) {
+    mSource = source;
+    mBegin = mSource.constData();
+    mEnd = mBegin + mSource.length();
+    mCurrent = mBegin;
+    mCurrentLine = 0;
 }
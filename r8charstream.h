@@ -4,15 +4,33 @@
 #include <QChar>
 #include <QString>
 
+// Source text in one contiguous buffer, lines separated by '\n'. The lexer
+// scans the buffer directly and its tokens are spans of it, so the stream
+// must outlive the tokens read from it.
 class R8CharStream {
 public:
     R8CharStream();
     virtual ~R8CharStream() {}
 
-    virtual QChar CurrentChar() const           = 0;
-    virtual void  GoToNextChar()                = 0;
-    virtual bool  IsValidCurrentChar() const    = 0;
-    virtual int   CurrentLine() const           = 0;
+    QChar CurrentChar() const {return IsValidCurrentChar() ? *mCurrent : QChar(' ');}
+    void  GoToNextChar();
+    bool  IsValidCurrentChar() const {return (mCurrent < mEnd);}
+    int   CurrentLine() const {return mCurrentLine;}
+
+    const QChar *Begin() const {return mBegin;}
+    const QChar *End() const {return mEnd;}
+    const QChar *Current() const {return mCurrent;}
+    void  SetCurrent(const QChar *current, int line); //after the chars scanned by the lexer
+
+protected:
+    void SetSource(const QString& source);
+
+private:
+    QString      mSource;
+    const QChar *mBegin;
+    const QChar *mEnd;
+    const QChar *mCurrent;
+    int          mCurrentLine;
 };
 
 class R8StringCharStream : public R8CharStream {
@@ -20,16 +38,7 @@ public:
     R8StringCharStream() {}
     R8StringCharStream(const QString& source) {SetSourceString(source);}
 
-    void SetSourceString(const QString& source);
-
-    virtual QChar CurrentChar() const;
-    virtual void  GoToNextChar();
-    virtual bool  IsValidCurrentChar() const;
-    virtual int   CurrentLine() const {return mCurrentLine;}
-private:
-    int     mCurrentCharIndex;
-    int     mCurrentLine;
-    QString mSource;
+    void SetSourceString(const QString& source) {SetSource(source);}
 };
 
 #endif // R8CHARSTREAM_H
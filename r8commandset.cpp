@@ -0,0 +1,196 @@
+#include "r8commandset.h"
+
+void R8CommandSet::SetVariant(int variant) {
+    mCommands.clear();
+    mVariant = (variant < 0) ? 0 : variant;
+
+    if (variant <= 0) {
+        SetZeroCommandSet();
+        return;
+    }
+
+    --variant;
+
+    SetCommonCommands();
+
+    SetShiftsVariant(variant % SHIFTS_COUNT);
+    variant = variant / SHIFTS_COUNT;
+
+    SetLogicsVariant(variant % LOGICS_COUNT);
+    variant = variant / LOGICS_COUNT;
+
+    SetArithmeticsVariant(variant % ARITHMETICS_COUNT);
+    variant = variant / ARITHMETICS_COUNT;
+
+    SetJumpsVariant(variant % JUMPS_COUNT);
+}
+
+void R8CommandSet::ApplyTo(R8Compiler &compiler) const {
+    compiler.ClearAvailableCommands();
+
+    QListIterator<R8CommandInfo> it(mCommands);
+    while (it.hasNext()) {
+        const R8CommandInfo& info = it.next();
+        compiler.SetAvailableCommand(info.Name(), info.Descriptor());
+    }
+}
+
+void R8CommandSet::AddCommand(const char *name, R8CommandDescriptor::EType type, R8Instruction::EOpcode opcode, const char *help) {
+    mCommands.append(R8CommandInfo(QString(name), R8CommandDescriptor(type, opcode), help));
+}
+
+void R8CommandSet::SetZeroCommandSet() {
+    SetCommonCommands();
+
+    SetLogicAnd();
+    SetLogicNot();
+    SetLogicOr();
+    SetLogicXor();
+
+    SetShiftROL();
+    SetShiftROR();
+
+    SetArithmeticsAdd();
+    SetArithmeticsSub();
+
+    SetJumpJo();
+    SetJumpJz();
+}
+
+void R8CommandSet::SetCommonCommands() {
+    SetInCommand();
+    SetOutCommand();
+}
+
+void R8CommandSet::SetShiftsVariant(int variant) {
+    Q_ASSERT(variant < SHIFTS_COUNT);
+
+    static const TVariantPtr sShifts[SHIFTS_COUNT] = {
+        &R8CommandSet::SetShiftROR,
+        &R8CommandSet::SetShiftROL};
+    (this->*(sShifts[variant]))();
+}
+
+void R8CommandSet::SetLogicsVariant(int variant) {
+    Q_ASSERT(variant < LOGICS_COUNT);
+
+    static const TVariantPtr sLogics[LOGICS_COUNT] = {
+        &R8CommandSet::SetLogicAndNot,
+        &R8CommandSet::SetLogicOrNot,
+        &R8CommandSet::SetLogicXorOr,
+        &R8CommandSet::SetLogicXorAnd,
+        &R8CommandSet::SetLogicNand,
+        &R8CommandSet::SetLogicNor
+    };
+    (this->*(sLogics[variant]))();
+}
+
+void R8CommandSet::SetArithmeticsVariant(int variant) {
+    Q_ASSERT(variant < ARITHMETICS_COUNT);
+
+    static const TVariantPtr sArithmetics[ARITHMETICS_COUNT] = {
+        &R8CommandSet::SetArithmeticsAdd,
+        &R8CommandSet::SetArithmeticsSub
+    };
+    (this->*(sArithmetics[variant]))();
+}
+
+void R8CommandSet::SetJumpsVariant(int variant) {
+    Q_ASSERT(variant < JUMPS_COUNT);
+
+    static const TVariantPtr sJumps[JUMPS_COUNT] = {
+        &R8CommandSet::SetJumpJz,
+        &R8CommandSet::SetJumpJo
+    };
+    (this->*(sJumps[variant]))();
+}
+
+void R8CommandSet::SetLogicAndNot() {
+    SetLogicAnd();
+    SetLogicNot();
+}
+
+void R8CommandSet::SetLogicOrNot() {
+    SetLogicOr();
+    SetLogicNot();
+}
+
+void R8CommandSet::SetLogicXorOr() {
+    SetLogicXor();
+    SetLogicOr();
+}
+
+void R8CommandSet::SetLogicXorAnd() {
+    SetLogicXor();
+    SetLogicAnd();
+}
+
+void R8CommandSet::SetInCommand() {
+    AddCommand("IN", R8CommandDescriptor::ARGS_DST, R8Instruction::IN_OPCODE,
+               QT_TRANSLATE_NOOP("R8AsmWindow", "in <dst>   ;dst := input"));
+}
+
+void R8CommandSet::SetOutCommand() {
+    AddCommand("OUT", R8CommandDescriptor::ARGS_SRC, R8Instruction::OUT_OPCODE,
+               QT_TRANSLATE_NOOP("R8AsmWindow", "out <src>   ;output := src"));
+}
+
+void R8CommandSet::SetShiftROR() {
+    AddCommand("ROR", R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::ROR_OPCODE,
+               QT_TRANSLATE_NOOP("R8AsmWindow", "ror <src1>, <src2>, <dst>   ;dst := src1 >>> src2"));
+}
+
+void R8CommandSet::SetShiftROL() {
+    AddCommand("ROL", R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::ROL_OPCODE,
+               QT_TRANSLATE_NOOP("R8AsmWindow", "rol <src1>, <src2>, <dst>   ;dst := src1 <<< src2"));
+}
+
+void R8CommandSet::SetLogicNot() {
+    AddCommand("NOT", R8CommandDescriptor::ARGS_SRC_DST, R8Instruction::NOT_OPCODE,
+               QT_TRANSLATE_NOOP("R8AsmWindow", "not <src>, <dst>   ;dst := NOT(src)"));
+}
+
+void R8CommandSet::SetLogicXor() {
+    AddCommand("XOR", R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::XOR_OPCODE,
+               QT_TRANSLATE_NOOP("R8AsmWindow", "xor <src1>, <src2>, <dst>   ;dst := XOR(src1,src2)"));
+}
+
+void R8CommandSet::SetLogicAnd() {
+    AddCommand("AND", R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::AND_OPCODE,
+               QT_TRANSLATE_NOOP("R8AsmWindow", "and <src1>, <src2>, <dst>   ;dst := AND(src1,src2)"));
+}
+
+void R8CommandSet::SetLogicOr() {
+    AddCommand("OR", R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::OR_OPCODE,
+               QT_TRANSLATE_NOOP("R8AsmWindow", "or <src1>, <src2>, <dst>   ;dst := OR(src1,src2)"));
+}
+
+void R8CommandSet::SetLogicNand() {
+    AddCommand("NAND", R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::NAND_OPCODE,
+               QT_TRANSLATE_NOOP("R8AsmWindow", "nand <src1>, <src2>, <dst>   ;dst := NOT(AND(src1,src2))"));
+}
+
+void R8CommandSet::SetLogicNor() {
+    AddCommand("NOR", R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::NOR_OPCODE,
+               QT_TRANSLATE_NOOP("R8AsmWindow", "nor <src1>, <src1>, <dst>   ;dst := NOT(OR(src1,src2))"));
+}
+
+void R8CommandSet::SetArithmeticsAdd() {
+    AddCommand("ADD", R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::ADD_OPCODE,
+               QT_TRANSLATE_NOOP("R8AsmWindow", "add <src1>, <src2>, <dst>   ;dst := src1 + src2"));
+}
+
+void R8CommandSet::SetArithmeticsSub() {
+    AddCommand("SUB", R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::SUB_OPCODE,
+               QT_TRANSLATE_NOOP("R8AsmWindow", "sub <src1>, <src2>, <dst>  ;dst := src1 - src2"));
+}
+
+void R8CommandSet::SetJumpJz() {
+    AddCommand("JZ", R8CommandDescriptor::ARGS_SRC_LABEL, R8Instruction::JZ_OPCODE,
+               QT_TRANSLATE_NOOP("R8AsmWindow", "jz <src>, <lbl>   ;if (src=0x00) goto lbl"));
+}
+
+void R8CommandSet::SetJumpJo() {
+    AddCommand("JO", R8CommandDescriptor::ARGS_SRC_LABEL, R8Instruction::JO_OPCODE,
+               QT_TRANSLATE_NOOP("R8AsmWindow", "jo <src>, <lbl>   ;if (src=0xFF) goto lbl"));
+}
@@ -0,0 +1,86 @@
+#ifndef R8COMMANDSET_H
+#define R8COMMANDSET_H
+
+#include <QString>
+#include <QList>
+
+#include "r8compiler.h"
+
+class R8CommandInfo {
+public:
+    R8CommandInfo() : mHelp(0) {}
+    R8CommandInfo(const QString& name, const R8CommandDescriptor& descriptor, const char *help) :
+        mName(name),mDescriptor(descriptor),mHelp(help) {}
+
+    const QString&             Name()       const {return mName;}
+    const R8CommandDescriptor& Descriptor() const {return mDescriptor;}
+    const char*                Help()       const {return mHelp;} //untranslated, context "R8AsmWindow"
+
+private:
+    QString              mName;
+    R8CommandDescriptor  mDescriptor;
+    const char          *mHelp;
+};
+
+// Command set variants: #0 is the full set, #1..#(VARIANTS_COUNT-1) are the
+// cartesian product of the shift, logic, arithmetic and jump bases.
+class R8CommandSet {
+public:
+    static const int SHIFTS_COUNT      = 2; // rol, ror
+    static const int LOGICS_COUNT      = 6; // {and,not},{or,not},{xor,or}, nand, nor, {xor,and}
+    static const int ARITHMETICS_COUNT = 2; // add,sub
+    static const int JUMPS_COUNT       = 2; // jz,jo
+
+    static const int VARIANTS_COUNT    = SHIFTS_COUNT * LOGICS_COUNT * ARITHMETICS_COUNT * JUMPS_COUNT + 1;
+
+    R8CommandSet() {SetVariant(0);}
+
+    void SetVariant(int variant);
+    int  Variant() const {return mVariant;}
+
+    const QList<R8CommandInfo>& Commands() const {return mCommands;}
+
+    void ApplyTo(R8Compiler& compiler) const;
+
+private:
+    typedef void (R8CommandSet::*TVariantPtr)();
+
+    int                   mVariant;
+    QList<R8CommandInfo>  mCommands;
+
+    void AddCommand(const char *name, R8CommandDescriptor::EType type, R8Instruction::EOpcode opcode, const char *help);
+
+    void SetZeroCommandSet();
+    void SetCommonCommands();
+
+    void SetShiftsVariant(int variant);
+    void SetLogicsVariant(int variant);
+    void SetArithmeticsVariant(int variant);
+    void SetJumpsVariant(int variant);
+
+    void SetLogicAndNot();
+    void SetLogicOrNot();
+    void SetLogicXorOr();
+    void SetLogicXorAnd();
+
+    void SetInCommand();
+    void SetOutCommand();
+
+    void SetShiftROR();
+    void SetShiftROL();
+
+    void SetLogicNot();
+    void SetLogicXor();
+    void SetLogicAnd();
+    void SetLogicOr();
+    void SetLogicNand();
+    void SetLogicNor();
+
+    void SetArithmeticsAdd();
+    void SetArithmeticsSub();
+
+    void SetJumpJz();
+    void SetJumpJo();
+};
+
+#endif // R8COMMANDSET_H
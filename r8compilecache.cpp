@@ -0,0 +1,159 @@
+#include "r8compilecache.h"
+
+#include <QDataStream>
+#include <QFile>
+
+#include "r8charstream.h"
+#include "r8lexer.h"
+
+static const quint32 R8_CACHE_MAGIC   = 0x52384343; //"R8CC"
+static const quint16 R8_CACHE_VERSION = 2;          //of the format and of the compiler: a new one drops the old results
+
+static const quint64 R8_FNV_OFFSET = Q_UINT64_C(14695981039346656037);
+static const quint64 R8_FNV_PRIME  = Q_UINT64_C(1099511628211);
+
+static void R8AppendValue(QByteArray &tokens, quint32 value) {
+    tokens.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+bool R8CompileCache::Key(const QString &source, int variant, R8CompileKey *key) {
+    R8StringCharStream charStream(source);
+    R8Lexer lexer;
+    lexer.SetSource(&charStream);
+
+    QByteArray tokens;
+    R8AppendValue(tokens, (quint32)variant);
+    try {
+        for (lexer.NextToken(); lexer.CurrentToken().Type() != R8Token::END_OF_SOURCE; lexer.NextToken()) {
+            const R8Token& token = lexer.CurrentToken();
+            R8AppendValue(tokens, (quint32)token.Type());
+            R8AppendValue(tokens, (quint32)lexer.CurrentLine());
+            R8AppendValue(tokens, (quint32)token.Length());
+            tokens.append(reinterpret_cast<const char*>(token.Text()), token.Length()*(int)sizeof(QChar));
+        }
+    } catch (const R8LexerException&) {
+        return false;
+    }
+
+    quint64 hash = R8_FNV_OFFSET;
+    for (int i=0; i<tokens.size(); ++i)
+        hash = (hash ^ (uchar)tokens[i]) * R8_FNV_PRIME;
+    key->Hash   = hash;
+    key->Tokens = tokens;
+    return true;
+}
+
+bool R8CompileCache::Find(const R8CompileKey &key, R8CompileResult *result) const {
+    QMutexLocker locker(&mMutex);
+    TResults::const_iterator it = mResults.constFind(key.Hash);
+    if ((it == mResults.constEnd()) || (it.value().Tokens != key.Tokens))
+        return false;
+    *result = it.value().Result;
+    return true;
+}
+
+void R8CompileCache::Insert(const R8CompileKey &key, const R8CompileResult &result) {
+    TEntry entry;
+    entry.Tokens = key.Tokens;
+    entry.Result = result;
+
+    QMutexLocker locker(&mMutex);
+    mResults.insert(key.Hash, entry);
+    mIsChanged = true;
+}
+
+int R8CompileCache::Count() const {
+    QMutexLocker locker(&mMutex);
+    return mResults.size();
+}
+
+bool R8CompileCache::IsChanged() const {
+    QMutexLocker locker(&mMutex);
+    return mIsChanged;
+}
+
+static void R8WriteReference(QDataStream &stream, const R8Reference &reference) {
+    stream << (quint8)reference.AccessType() << (quint32)reference.Value();
+}
+
+static R8Reference R8ReadReference(QDataStream &stream) {
+    quint8  accessType = 0;
+    quint32 value = 0;
+    stream >> accessType >> value;
+    if (accessType > R8Reference::INSTRUCTION_INDEX)
+        stream.setStatus(QDataStream::ReadCorruptData);
+    return R8Reference((R8Reference::EAccessType)accessType, value);
+}
+
+bool R8CompileCache::Load(const QString &path) {
+    QMutexLocker locker(&mMutex);
+    mResults.clear();
+    mIsChanged = false;
+
+    QFile file(path);
+    if (!file.exists())
+        return true;
+    if (!file.open(QFile::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    quint32 magic = 0;
+    quint16 version = 0;
+    quint32 count = 0;
+    stream >> magic >> version;
+    if ((stream.status() != QDataStream::Ok) || (magic != R8_CACHE_MAGIC))
+        return false;
+    if (version != R8_CACHE_VERSION)
+        return true;
+
+    stream >> count;
+    for (quint32 i=0; (i<count) && (stream.status() == QDataStream::Ok); ++i) {
+        quint64         key = 0;
+        quint32         length = 0;
+        TEntry          entry;
+        R8CompileResult& result = entry.Result;
+        stream >> key >> entry.Tokens >> result.Error >> length;
+        for (quint32 ip=0; (ip<length) && (stream.status() == QDataStream::Ok); ++ip) {
+            quint8 opcode = 0;
+            stream >> opcode;
+            if (opcode > R8Instruction::JO_OPCODE)
+                stream.setStatus(QDataStream::ReadCorruptData);
+            const R8Reference operand1 = R8ReadReference(stream);
+            const R8Reference operand2 = R8ReadReference(stream);
+            const R8Reference r        = R8ReadReference(stream);
+            result.Program.AddInstruction(R8Instruction((R8Instruction::EOpcode)opcode, operand1, operand2, r));
+        }
+        stream >> result.SourceLines;
+        mResults.insert(key, entry);
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        mResults.clear();
+        return false;
+    }
+    return true;
+}
+
+bool R8CompileCache::Save(const QString &path) const {
+    QMutexLocker locker(&mMutex);
+
+    QFile file(path);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate))
+        return false;
+
+    QDataStream stream(&file);
+    stream << R8_CACHE_MAGIC << R8_CACHE_VERSION << (quint32)mResults.size();
+    for (TResults::const_iterator it = mResults.constBegin(); it != mResults.constEnd(); ++it) {
+        const R8CompileResult& result = it.value().Result;
+        stream << it.key() << it.value().Tokens << result.Error << (quint32)result.Program.Length();
+        for (int ip=0; ip<result.Program.Length(); ++ip) {
+            R8Instruction instruction = result.Program.Instruction(ip);
+            stream << (quint8)instruction.Opcode();
+            R8WriteReference(stream, instruction.Operand1());
+            R8WriteReference(stream, instruction.Operand2());
+            R8WriteReference(stream, instruction.Result());
+        }
+        stream << result.SourceLines;
+    }
+    return (stream.status() == QDataStream::Ok) && file.flush();
+}
@@ -0,0 +1,62 @@
+#ifndef R8COMPILECACHE_H
+#define R8COMPILECACHE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+#include "r8engine.h"
+
+// What a compile of a source gave
+struct R8CompileResult {
+    R8Program    Program;
+    QVector<int> SourceLines; // f: opcode_index -> source_line
+    QString      Error;       //empty when compiled
+};
+
+// A source as the cache sees it: its token stream (so spaces and comments do
+// not matter) with the command set variant, and a hash of it. The lines of the
+// tokens are in the stream too, as the ip -> line map and the line of an
+// error depend on them.
+struct R8CompileKey {
+    quint64    Hash;
+    QByteArray Tokens; //the variant, then the type, line, length and characters of every token
+};
+
+// Compile results by the content of their sources: a result is found by the
+// hash of its key and taken only if the token streams are equal, so a hash
+// collision is a miss. Threads may share a cache; it is kept in an .r8cache
+// file between the runs of the grader.
+class R8CompileCache {
+public:
+    R8CompileCache() : mIsChanged(false) {}
+
+    static bool Key(const QString& source, int variant, R8CompileKey *key); //false if the source can not be lexed
+
+    bool Find(const R8CompileKey& key, R8CompileResult *result) const;
+    void Insert(const R8CompileKey& key, const R8CompileResult& result);
+
+    int  Count() const;
+    bool IsChanged() const; //since Load()
+
+    bool Load(const QString& path); //false if it is not a cache file; no file or another version is an empty cache
+    bool Save(const QString& path) const;
+
+private:
+    struct TEntry {
+        QByteArray      Tokens; //of the key
+        R8CompileResult Result;
+    };
+
+    typedef QHash<quint64, TEntry> TResults; //by the hash of the key, the last one of colliding keys
+
+    mutable QMutex mMutex;
+    TResults       mResults;
+    bool           mIsChanged;
+
+    Q_DISABLE_COPY(R8CompileCache)
+};
+
+#endif // R8COMPILECACHE_H
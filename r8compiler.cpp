@@ -1,9 +1,192 @@
 #include "r8compiler.h"
 
-R8Compiler::R8Compiler() {
+QString R8CompilerException::Description() const {
+    switch (mType) {
+    case R8CompilerException::BAD_EXPRESSION:       return QString("bad expression \"%1\"").arg(mInfo);
+    case R8CompilerException::UNRESOLVED_LABEL:     return QString("unresolved label \"%1\"").arg(mInfo);
+    case R8CompilerException::COMMA_EXPECTED:       return QString("comma expected");
+    case R8CompilerException::LABEL_REDEFINITION:   return QString("label \"%1\" redefinition").arg(mInfo);
+    case R8CompilerException::UNDEFINED_COMMAND:    return QString("undefined \"%1\" command").arg(mInfo);
+    case R8CompilerException::BAD_REFERENCE:        return QString("bad memory reference");
+    case R8CompilerException::REFERENCE_EXPECTED:   return QString("reference expected");
+    case R8CompilerException::RBRACE_EXPECTED:      return QString("rbrace \"]\" expected");
+    case R8CompilerException::LABEL_EXPECTED:       return QString("label expected");
+    case R8CompilerException::REGISTER_EXPECTED:    return QString("register name expected instead \"%1\"").arg(mInfo);
+    case R8CompilerException::MODULE_EXPECTED:      return QString("module name expected");
+    case R8CompilerException::INCLUDE_NOT_ALLOWED:  return QString("\"include %1\" is allowed in modules only").arg(mInfo);
+    case R8CompilerException::MODULE_NOT_FOUND:     return QString("module \"%1\" not found").arg(mInfo);
+    case R8CompilerException::INCLUDE_CYCLE:        return QString("module \"%1\" includes itself").arg(mInfo);
+    default:                                        return QString("error of unknown type");
+    }
+}
+
+R8SymbolTable::R8SymbolTable() {
+    mSlots.fill(-1, INITIAL_SLOTS_COUNT);
+}
+
+void R8SymbolTable::Clear() {
+    mNames.truncate(0);
+    mSymbols.resize(0);
+    mSlots.fill(-1);
+}
+
+// FNV-1a of the folded chars; seeds give other hashes for R8CommandTable
+uint R8SymbolTable::Hash(const QChar *text, int length, uint seed) {
+    uint hash = 2166136261u ^ seed;
+    for (int i=0; i<length; ++i) {
+        hash ^= Fold(text[i]);
+        hash *= 16777619u;
+    }
+    return hash ^ (hash >> 15);
+}
+
+bool R8SymbolTable::IsEqual(const QChar *text, int length, const QChar *folded) {
+    for (int i=0; i<length; ++i) {
+        if (Fold(text[i]) != folded[i].unicode())
+            return false;
+    }
+    return true;
+}
+
+int R8SymbolTable::Intern(const QChar *text, int length) {
+    if (2*(mSymbols.size() + 1) > mSlots.size())
+        Rehash(2*mSlots.size());
+
+    const uint hash = Hash(text, length);
+    const int  mask = mSlots.size() - 1;
+    int slot = (int)(hash & mask);
+    for (; mSlots[slot] >= 0; slot = (slot + 1) & mask) {
+        const TSymbol& symbol = mSymbols[mSlots[slot]];
+        if ((symbol.Hash == hash) && (symbol.Length == length) && IsEqual(text, length, mNames.constData() + symbol.Offset))
+            return mSlots[slot];
+    }
+
+    TSymbol symbol;
+    symbol.Offset = mNames.length();
+    symbol.Length = length;
+    symbol.Hash   = hash;
+    for (int i=0; i<length; ++i)
+        mNames += QChar(Fold(text[i]));
+
+    mSymbols.append(symbol);
+    mSlots[slot] = mSymbols.size() - 1;
+    return mSlots[slot];
+}
+
+void R8SymbolTable::Rehash(int slotsCount) {
+    mSlots.fill(-1, slotsCount);
+    const int mask = slotsCount - 1;
+    for (int i=0; i<mSymbols.size(); ++i) {
+        int slot = (int)(mSymbols[i].Hash & mask);
+        while (mSlots[slot] >= 0)
+            slot = (slot + 1) & mask;
+        mSlots[slot] = i;
+    }
+}
+
+
+void R8CommandTable::Clear() {
+    mCommands.clear();
+    mIsBuilt = false;
+}
+
+void R8CommandTable::Set(const QString &name, const R8CommandDescriptor &descriptor) {
+    const QString folded = name.toUpper();
+    for (int i=0; i<mCommands.size(); ++i) {
+        if (mCommands[i].Name == folded) {
+            mCommands[i].Descriptor = descriptor;
+            return;
+        }
+    }
+
+    TCommand command;
+    command.Name       = folded;
+    command.Descriptor = descriptor;
+    mCommands.append(command);
+    mIsBuilt = false;
+}
+
+// With 4 slots per command one of the first seeds leaves no collisions; if
+// none of them does, the table doubles.
+void R8CommandTable::Build() {
+    if (mIsBuilt)
+        return;
+
+    int slotsCount = 4;
+    while (slotsCount < 4*mCommands.size())
+        slotsCount *= 2;
+
+    for (;; slotsCount *= 2) {
+        for (uint seed=0; seed<1024; ++seed) {
+            if (TryBuild(slotsCount, seed)) {
+                mIsBuilt = true;
+                return;
+            }
+        }
+    }
+}
+
+bool R8CommandTable::TryBuild(int slotsCount, uint seed) {
+    mSlots.fill(-1, slotsCount);
+    mSeed = seed;
+    for (int i=0; i<mCommands.size(); ++i) {
+        const uint slot = R8SymbolTable::Hash(mCommands[i].Name.constData(), mCommands[i].Name.length(), seed) & (slotsCount - 1);
+        if (mSlots[slot] >= 0)
+            return false;
+        mSlots[slot] = i;
+    }
+    return true;
+}
+
+const R8CommandDescriptor *R8CommandTable::Find(const QChar *text, int length) const {
+    Q_ASSERT(mIsBuilt);
+
+    const int index = mSlots[R8SymbolTable::Hash(text, length, mSeed) & (mSlots.size() - 1)];
+    if (index < 0)
+        return 0;
+
+    const TCommand& command = mCommands[index];
+    if ((command.Name.length() != length) || !R8SymbolTable::IsEqual(text, length, command.Name.constData()))
+        return 0;
+    return &command.Descriptor;
+}
+
+
+static const QChar INCLUDE_KEYWORD[] = {QLatin1Char('I'), QLatin1Char('N'), QLatin1Char('C'), QLatin1Char('L'), QLatin1Char('U'), QLatin1Char('D'), QLatin1Char('E')}; //folded
+
+R8Compiler::R8Compiler() : mIsFragment(false),mIncludes(0) {
 }
 
 void R8Compiler::Compile() {
+    mIsFragment = false;
+    mIncludes   = 0;
+    CompileSource();
+
+    CheckUnresolvedLabels();
+    MapSourceLines();
+}
+
+void R8Compiler::CompileFragment(QVector<R8LabelUse> *labels, QVector<R8LabelUse> *jumps, QVector<R8Include> *includes) {
+    mIsFragment = true;
+    mIncludes   = includes;
+    CompileSource();
+    mIncludes   = 0;
+
+    R8LabelUse use;
+    for (int symbol=0; symbol<mLabels.size(); ++symbol) {
+        use.Name = mSymbols.Name(symbol);
+        if (mLabels[symbol] >= 0) {
+            use.Ip = mLabels[symbol];
+            labels->append(use);
+        }
+        for (unsigned int ip = mPatchChains[symbol]; ip != NO_PATCH; ip = NextPatch(ip)) {
+            use.Ip = ip;
+            jumps->append(use);
+        }
+    }
+}
+
+void R8Compiler::CompileSource() {
     InitCompile();
 
     NextToken();
@@ -16,58 +199,68 @@ void R8Compiler::Compile() {
             NextToken();
             if (CurrentToken().Type() == R8Token::COLON) {
                 CompileLabel(idToken);
+            } else if ((idToken.Length() == 7) && R8SymbolTable::IsEqual(idToken.Text(), 7, INCLUDE_KEYWORD)) {
+                CompileInclude(commandStartLine);
             } else {
-                mIps[CompiledInstructionIndex()] = commandStartLine;
+                mSourceLines.append(commandStartLine); //a command is one instruction
                 CompileCommand(idToken);
+                mNewLabels.resize(0);
             }
         } else
             throw R8CompilerException(R8CompilerException::BAD_EXPRESSION, CurrentLine(), CurrentToken().TokenString()); //
     }
-
-    ResolveReferences();
 }
 
-void R8Compiler::ClearAvailableCommands() { mCommands.clear(); }
+void R8Compiler::ClearAvailableCommands() { mCommands.Clear(); }
 
 void R8Compiler::SetAvailableCommand(const QString &name, const R8CommandDescriptor& descriptor) {
-    mCommands[name] = descriptor;
+    mCommands.Set(name, descriptor);
 }
 
-int R8Compiler::SourceLineForIp(int ip) const {
-    if (mIps.contains(ip))
-        return mIps[ip];
-    return -1;
-}
-
-void R8Compiler::ResolveReferences() {
-    QList<QString> labelNames = mGoTos.keys();
-    for (QList<QString>::iterator it = labelNames.begin(); it != labelNames.end(); ++it) {
-        if (!mLabels.contains(*it)) {
-            QList<unsigned int> ips = mGoTos.values(*it);
-
-            unsigned int ip = 0;
-            QListIterator<unsigned int> ipsIt(ips);
-            while (ipsIt.hasNext()) {
-                unsigned int currIp = ipsIt.next();
-                ip = (ip < currIp) ? ip : currIp;
+// Jumps to a label not defined yet wait for it in its patch chain; the result of
+// every such jump is the index of the previous one, its own for the first (so
+// it fits in an instruction word, see R8Program). The first jump to a label
+// that is never defined is reported.
+void R8Compiler::CheckUnresolvedLabels() {
+    int          symbol = -1;
+    unsigned int firstIp = NO_PATCH;
+    for (int label=0; label<mPatchChains.size(); ++label) {
+        for (unsigned int ip = mPatchChains[label]; ip != NO_PATCH; ip = NextPatch(ip)) {
+            if (ip < firstIp) {
+                firstIp = ip;
+                symbol  = label;
             }
+        }
+    }
 
-            int line = SourceLineForIp(ip);
-            if (line < 0)
-                line = 0;
+    if (symbol >= 0)
+        throw R8CompilerException(R8CompilerException::UNRESOLVED_LABEL, SourceLineForIp(firstIp), mSymbols.Name(symbol));
+}
 
-            throw R8CompilerException(R8CompilerException::UNRESOLVED_LABEL, line, *it);
-        }
+unsigned int R8Compiler::NextPatch(unsigned int ip) const {
+    const unsigned int previous = mProgram.Instruction(ip).Result().Value();
+    return (previous == ip) ? NO_PATCH : previous;
+}
 
-        unsigned int labelIndex = mLabels[*it];
-        QList<unsigned int> gotoIndexes = mGoTos.values(*it);
-        for (QList<unsigned int>::iterator gotoIt = gotoIndexes.begin(); gotoIt != gotoIndexes.end(); ++gotoIt) {
-            unsigned int gotoIndex = *gotoIt;
-            R8Instruction gotoInstruction = mProgram.Instruction(gotoIndex);
-            R8Reference   labelReference(R8Reference::INSTRUCTION_INDEX, labelIndex);
-            gotoInstruction.SetResult(labelReference);
-            mProgram.UpdateInstruction(gotoIndex, gotoInstruction);
-        }
+int R8Compiler::LabelSymbol(const R8Token &token) {
+    const int symbol = mSymbols.Intern(token.Text(), token.Length());
+    if (symbol == mLabels.size()) {
+        mLabels.append(-1);
+        mPatchChains.append((unsigned int)NO_PATCH); //a copy: append() binds a reference
+    }
+    return symbol;
+}
+
+// A line belongs to the command on it or to the last command before it, but
+// the lines after the last command and before the first one belong to none.
+void R8Compiler::MapSourceLines() {
+    for (int ip=0; ip<mSourceLines.size(); ++ip) {
+        const int line = mSourceLines[ip];
+        if (line < mIps.size())
+            continue; //not the first command on the line
+        while (mIps.size() < line)
+            mIps.append(ip - 1);
+        mIps.append(ip);
     }
 }
 
@@ -79,25 +272,67 @@ void R8Compiler::SkipCommaToken() {
 }
 
 void R8Compiler::InitCompile() {
+    mCommands.Build();
+
     mProgram.Clear();
-    mLabels.clear();
-    mGoTos.clear();
+    mSymbols.Clear();
+    mLabels.resize(0);
+    mPatchChains.resize(0);
+    mSourceLines.clear();
     mIps.clear();
+    mNewLabels.resize(0);
 }
 
 void R8Compiler::CompileLabel(const R8Token &token) {
-    if (mLabels.contains(token.TokenString().toUpper()))
+    const int symbol = LabelSymbol(token);
+    if (mLabels[symbol] >= 0)
         throw R8CompilerException(R8CompilerException::LABEL_REDEFINITION, CurrentLine(), token.TokenString());
 
-    mLabels[token.TokenString().toUpper()] = CompiledInstructionIndex(); //point next command
+    const unsigned int labelIndex = CompiledInstructionIndex(); //point next command
+    mLabels[symbol] = labelIndex;
+    mNewLabels.append(symbol);
+    if (mIsFragment) {
+        NextToken();
+        return;
+    }
+
+    const R8Reference labelReference(R8Reference::INSTRUCTION_INDEX, labelIndex);
+    for (unsigned int gotoIndex = mPatchChains[symbol]; gotoIndex != NO_PATCH; ) {
+        const unsigned int nextIndex = NextPatch(gotoIndex);
+        mProgram.SetInstructionResult(gotoIndex, labelReference);
+        gotoIndex = nextIndex;
+    }
+    mPatchChains[symbol] = NO_PATCH;
+
+    NextToken();
+}
+
+// "include name": the code of the module goes in its place when the program is
+// linked, so the labels defined right before it point to the included code
+void R8Compiler::CompileInclude(int line) {
+    if (CurrentToken().Type() != R8Token::IDENTIFIER)
+        throw R8CompilerException(R8CompilerException::MODULE_EXPECTED, CurrentLine(), CurrentToken().TokenString());
+    if (mIncludes == 0)
+        throw R8CompilerException(R8CompilerException::INCLUDE_NOT_ALLOWED, CurrentLine(), CurrentToken().TokenString());
+
+    R8Include include;
+    include.Name = CurrentToken().TokenString();
+    include.Ip   = CompiledInstructionIndex();
+    include.Line = line;
+    for (int i=0; i<mNewLabels.size(); ++i)
+        include.Labels.append(mSymbols.Name(mNewLabels[i]));
+    mIncludes->append(include);
+    mNewLabels.resize(0);
+
     NextToken();
 }
 
 void R8Compiler::CompileCommand(const R8Token &opcodeToken) {
-    if (!mCommands.contains(opcodeToken.TokenString().toUpper()))
+    const R8CommandDescriptor *found = mCommands.Find(opcodeToken.Text(), opcodeToken.Length());
+    if (found == 0)
         throw R8CompilerException(R8CompilerException::UNDEFINED_COMMAND, CurrentLine(), opcodeToken.TokenString());
 
-    R8CommandDescriptor descriptor = mCommands[opcodeToken.TokenString().toUpper()];
+    const R8CommandDescriptor descriptor = *found;
     switch (descriptor.Type()) {
     case R8CommandDescriptor::ARGS_NO:          CompileArgsNoCommand(descriptor.Opcode());         break;
     case R8CommandDescriptor::ARGS_SRC:         CompileArgsSrcCommand(descriptor.Opcode());        break;
@@ -168,7 +403,7 @@ void R8Compiler::CompileArgsSrcLabelCommand(R8Instruction::EOpcode opcode) {
 R8Reference R8Compiler::CompileSrcReference(){
     R8Reference ref;
     if (CurrentToken().Type() == R8Token::IDENTIFIER) { //must be a register r0,..,r7
-        ref = R8Reference(RegisterReferenceBy(CurrentToken().TokenString()));
+        ref = R8Reference(RegisterReferenceBy(CurrentToken()));
         NextToken();
     } else if (CurrentToken().Type() == R8Token::NUMBER) { //constant
         ref = R8Reference(R8Reference::CONSTANT, CurrentToken().Value());
@@ -176,7 +411,7 @@ R8Reference R8Compiler::CompileSrcReference(){
     } else if (CurrentToken().Type() == R8Token::LEFT_SBRACE) { //start of [12] or [r1]
         NextToken();
         if (CurrentToken().Type() == R8Token::IDENTIFIER) {
-            ref = MemoryByRegisterReferenceBy(CurrentToken().TokenString());
+            ref = MemoryByRegisterReferenceBy(CurrentToken());
         } else if (CurrentToken().Type() == R8Token::NUMBER) {
             ref = R8Reference(R8Reference::MEMORY_BY_CONSTANT, CurrentToken().Value());
         } else
@@ -191,33 +426,33 @@ R8Reference R8Compiler::CompileSrcReference(){
     return ref;
 }
 
-R8Reference R8Compiler::MemoryByRegisterReferenceBy(QString str) {
-    return R8Reference(R8Reference::MEMORY_BY_REGISTER, RegisterIndexFrom(str));
+R8Reference R8Compiler::MemoryByRegisterReferenceBy(const R8Token &token) {
+    return R8Reference(R8Reference::MEMORY_BY_REGISTER, RegisterIndexFrom(token));
 }
 
-R8Reference R8Compiler::RegisterReferenceBy(QString str) {
-    return R8Reference(R8Reference::REGISTER, RegisterIndexFrom(str));
+R8Reference R8Compiler::RegisterReferenceBy(const R8Token &token) {
+    return R8Reference(R8Reference::REGISTER, RegisterIndexFrom(token));
 }
 
-unsigned char R8Compiler::RegisterIndexFrom(QString str) {
-    if (str.length() == 2) {
-        QChar rch   = str[0];
-        QChar idxch = str[1];
+unsigned char R8Compiler::RegisterIndexFrom(const R8Token &token) {
+    if (token.Length() == 2) {
+        QChar rch   = token.Text()[0];
+        QChar idxch = token.Text()[1];
         if (((rch == QChar('r')) || (rch == QChar('R'))) && ((QChar('0') <= idxch) && (idxch <= QChar('7'))))
             return (unsigned char)(idxch.unicode() - QChar('0').unicode());
     }
-    throw R8CompilerException(R8CompilerException::REGISTER_EXPECTED, CurrentLine(), str);
+    throw R8CompilerException(R8CompilerException::REGISTER_EXPECTED, CurrentLine(), token.TokenString());
 }
 
 R8Reference R8Compiler::CompileDstReference() {
     R8Reference ref;
     if (CurrentToken().Type() == R8Token::IDENTIFIER) { //must be a register r0,..,r7
-        ref = R8Reference(RegisterReferenceBy(CurrentToken().TokenString()));
+        ref = R8Reference(RegisterReferenceBy(CurrentToken()));
         NextToken();
     } else if (CurrentToken().Type() == R8Token::LEFT_SBRACE) { //start of [12] or [r1]
         NextToken();
         if (CurrentToken().Type() == R8Token::IDENTIFIER) {
-            ref = MemoryByRegisterReferenceBy(CurrentToken().TokenString());
+            ref = MemoryByRegisterReferenceBy(CurrentToken());
         } else if (CurrentToken().Type() == R8Token::NUMBER) {
             ref = R8Reference(R8Reference::MEMORY_BY_CONSTANT, CurrentToken().Value());
         } else
@@ -234,9 +469,15 @@ R8Reference R8Compiler::CompileDstReference() {
 
 R8Reference R8Compiler::CompileLabelReference() {
     if (CurrentToken().Type() == R8Token::IDENTIFIER) {
-        mGoTos.insert(CurrentToken().TokenString().toUpper(), CompiledInstructionIndex());
+        const int symbol = LabelSymbol(CurrentToken());
         NextToken();
-        return R8Reference(R8Reference::INSTRUCTION_INDEX, 0);
+        if ((mLabels[symbol] >= 0) && !mIsFragment)
+            return R8Reference(R8Reference::INSTRUCTION_INDEX, mLabels[symbol]);
+
+        const unsigned int index = CompiledInstructionIndex();
+        const unsigned int previousIndex = (mPatchChains[symbol] == NO_PATCH) ? index : mPatchChains[symbol]; //see CheckUnresolvedLabels()
+        mPatchChains[symbol] = index;
+        return R8Reference(R8Reference::INSTRUCTION_INDEX, previousIndex);
     } else
         throw R8CompilerException(R8CompilerException::LABEL_EXPECTED, CurrentLine(), CurrentToken().TokenString());
 }
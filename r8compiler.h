@@ -2,8 +2,7 @@
 #define R8COMPILER_H
 
 #include <QString>
-#include <QMap>
-#include <QMultiMap>
+#include <QVector>
 
 #include "r8engine.h"
 #include "r8lexer.h"
@@ -20,7 +19,11 @@ public:
         REFERENCE_EXPECTED,
         RBRACE_EXPECTED,
         LABEL_EXPECTED,
-        REGISTER_EXPECTED
+        REGISTER_EXPECTED,
+        MODULE_EXPECTED,
+        INCLUDE_NOT_ALLOWED,
+        MODULE_NOT_FOUND,
+        INCLUDE_CYCLE
     };
 
     R8CompilerException(EType type, unsigned int lineNumber, const QString& info = QString()) :
@@ -29,6 +32,7 @@ public:
     EType Type() const {return mType;}
     unsigned int LineNumber() const {return mLineNumber;}
     QString Info() const {return mInfo;}
+    QString Description() const; //not translated, for batch tools
 private:
     EType mType;
     unsigned int mLineNumber;
@@ -57,31 +61,114 @@ private:
     R8Instruction::EOpcode  mOpcode;
 };
 
+// Identifiers folded to upper case, each kept once: a symbol is its index, so
+// the compiler keeps labels in vectors and never builds a string to find one.
+class R8SymbolTable {
+public:
+    R8SymbolTable();
+
+    void Clear();
+    int  Intern(const QChar *text, int length); //the symbol of the identifier, added if new
+    int  Count() const {return mSymbols.size();}
+    QString Name(int symbol) const {return mNames.mid(mSymbols[symbol].Offset, mSymbols[symbol].Length);}
+
+    static uint Hash(const QChar *text, int length, uint seed = 0); //of the folded text
+    static bool IsEqual(const QChar *text, int length, const QChar *folded);
+    static ushort Fold(QChar ch) {return ((ch >= QChar('a')) && (ch <= QChar('z'))) ? (ch.unicode() - 'a' + 'A') : ch.unicode();}
+
+private:
+    static const int INITIAL_SLOTS_COUNT = 64;
+
+    struct TSymbol {
+        int  Offset; //in mNames
+        int  Length;
+        uint Hash;
+    };
+
+    QString          mNames;   //folded, one after another
+    QVector<TSymbol> mSymbols;
+    QVector<int>     mSlots;   //open addressing by hash, -1 is free
+
+    void Rehash(int slotsCount);
+};
+
+// Commands of a command set variant by name: Build() searches for a hash seed
+// that gives every command its own slot, so a lookup is one hash and one compare.
+class R8CommandTable {
+public:
+    R8CommandTable() : mSeed(0),mIsBuilt(false) {}
+
+    void Clear();
+    void Set(const QString& name, const R8CommandDescriptor& descriptor);
+    void Build();
+    const R8CommandDescriptor *Find(const QChar *text, int length) const; //0 if not a command
+
+private:
+    struct TCommand {
+        QString             Name; //folded
+        R8CommandDescriptor Descriptor;
+    };
+
+    QVector<TCommand> mCommands;
+    QVector<int>      mSlots;  //-1 is free
+    uint              mSeed;
+    bool              mIsBuilt;
+
+    bool TryBuild(int slotsCount, uint seed);
+};
+
+// A label defined or jumped to in a fragment, see R8Compiler::CompileFragment()
+struct R8LabelUse {
+    QString      Name; //folded
+    unsigned int Ip;   //of the fragment: the command it points to, or the jump
+};
+
+// "include name" in a module, see R8Compiler::CompileFragment()
+struct R8Include {
+    QString          Name;   //as written, the module is the file "name.r8"
+    unsigned int     Ip;     //of the fragment: the included code goes before this command
+    int              Line;
+    QVector<QString> Labels; //folded, defined right before the include: they point to the included code
+};
+
 class R8Compiler {
 public:
     R8Compiler();
     void SetSource(R8CharStream *charStream) {mLexer.SetSource(charStream);}
     void Compile();
+    // A part of a program: its jumps are not resolved but listed for the one
+    // who links the parts, and so are its labels. A module may also include
+    // other modules: the includes are listed too, 0 - they are not allowed.
+    void CompileFragment(QVector<R8LabelUse> *labels, QVector<R8LabelUse> *jumps, QVector<R8Include> *includes = 0);
     void ClearAvailableCommands();
     void SetAvailableCommand(const QString& name, const R8CommandDescriptor& descriptor);
-    int  SourceLineForIp(int ip) const;
+    int  SourceLineForIp(int ip) const {return ((unsigned int)ip < (unsigned int)mSourceLines.size()) ? mSourceLines[ip] : -1;}
+    int  IpForSourceLine(int line) const {return ((unsigned int)line < (unsigned int)mIps.size()) ? mIps[line] : -1;}
+    const QVector<int>& SourceLines() const {return mSourceLines;} // f: opcode_index -> source_line
     const R8Program& CompiledCode() const {return mProgram;}
 
 private:
-    typedef QMap<QString, unsigned int> TLabelsMapng;
-    typedef QMultiMap<QString, unsigned int> TGoToMapping;
-    typedef QMap<QString, R8CommandDescriptor>  TCommandNameMapping;
-    typedef QMap<int, int>  TIpMapping;
+    typedef QVector<int>  TIpMapping;
+
+    static const unsigned int NO_PATCH = ~0u; //the end of a patch chain
 
     R8Program     mProgram;
     R8Lexer       mLexer;
-
-    TLabelsMapng         mLabels;   // f: label_name -> command_index_label_points_to
-    TGoToMapping         mGoTos;    // f: label_name -> { goto_command_index }
-    TCommandNameMapping  mCommands; // f: command_name -> command_descriptor_for_compile
-    TIpMapping           mIps;      // f: opcode_index -> source_line
-
-    void ResolveReferences();
+    bool          mIsFragment; //jumps are not resolved
+    QVector<R8Include> *mIncludes;      //0 if includes are not allowed
+
+    R8SymbolTable         mSymbols;
+    R8CommandTable        mCommands;    // f: command_name -> command_descriptor_for_compile
+    QVector<int>          mLabels;      // f: label_symbol -> command_index_label_points_to, -1 if not yet defined
+    QVector<unsigned int> mPatchChains; // f: label_symbol -> last goto_command_index waiting for the label
+    TIpMapping            mSourceLines; // f: opcode_index -> source_line
+    TIpMapping            mIps;         // f: source_line -> opcode_index of the command the line belongs to
+    QVector<int>          mNewLabels;   //symbols of the labels defined after the last command or include
+
+    void CheckUnresolvedLabels();
+    unsigned int NextPatch(unsigned int ip) const; //in the patch chain, NO_PATCH after the first jump
+    void MapSourceLines();
+    int  LabelSymbol(const R8Token& token);
 
     int CurrentLine() {return mLexer.CurrentLine();}
     const R8Token& CurrentToken() {return mLexer.CurrentToken();}
@@ -91,7 +178,9 @@ private:
     void SkipCommaToken();
 
     void InitCompile();
+    void CompileSource();
     void CompileLabel(const R8Token& token);
+    void CompileInclude(int line);
     void CompileCommand(const R8Token& token);
 
     void CompileArgsNoCommand(R8Instruction::EOpcode opcode);
@@ -102,9 +191,9 @@ private:
     void CompileArgsSrcLabelCommand(R8Instruction::EOpcode opcode);
 
     R8Reference CompileSrcReference();
-    R8Reference MemoryByRegisterReferenceBy(QString str);
-    R8Reference RegisterReferenceBy(QString str);
-    unsigned char RegisterIndexFrom(QString str);
+    R8Reference MemoryByRegisterReferenceBy(const R8Token& token);
+    R8Reference RegisterReferenceBy(const R8Token& token);
+    unsigned char RegisterIndexFrom(const R8Token& token);
     R8Reference CompileDstReference();
     R8Reference CompileLabelReference();
 };
@@ -0,0 +1,38 @@
+# Simulator core shared by the r8asm (GUI) and r8run (headless) targets.
+
+INCLUDEPATH += $$PWD
+
+# R8_ASSEMBLE() fills a std::array in constant expressions, see r8staticassembler.h
+CONFIG += c++17
+
+SOURCES += \
+    $$PWD/r8engine.cpp \
+    $$PWD/r8ports.cpp \
+    $$PWD/r8jit.cpp \
+    $$PWD/r8vectorengine.cpp \
+    $$PWD/r8bitlanes.cpp \
+    $$PWD/r8grader.cpp \
+    $$PWD/r8compilecache.cpp \
+    $$PWD/r8object.cpp \
+    $$PWD/r8linker.cpp \
+    $$PWD/r8testsuite.cpp \
+    $$PWD/r8compiler.cpp \
+    $$PWD/r8commandset.cpp \
+    $$PWD/r8charstream.cpp \
+    $$PWD/r8lexer.cpp
+
+HEADERS += \
+    $$PWD/r8engine.h \
+    $$PWD/r8ports.h \
+    $$PWD/r8jit.h \
+    $$PWD/r8vectorengine.h \
+    $$PWD/r8grader.h \
+    $$PWD/r8compilecache.h \
+    $$PWD/r8object.h \
+    $$PWD/r8linker.h \
+    $$PWD/r8testsuite.h \
+    $$PWD/r8staticassembler.h \
+    $$PWD/r8compiler.h \
+    $$PWD/r8commandset.h \
+    $$PWD/r8charstream.h \
+    $$PWD/r8lexer.h
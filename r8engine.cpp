@@ -1,21 +1,834 @@
+#include <climits>
+#include <cstring>
+
+#include <QCoreApplication>
+#include <QDataStream>
+
 #include "r8engine.h"
+#include "r8jit.h"
 
-R8Engine::R8Engine() {
+template<class TObserver>
+R8BasicEngine<TObserver>::R8BasicEngine() :
+    mInputPort(0),mOutputPort(0),mIsJitEnabled(false),mGeneration(1),mTouchedCount(0),mIsMemoryDirty(true),
+    mBreakpointsCount(0),mIsRunning(false),mIsLoopDetectionEnabled(false),mLoopPower(0),mLoopLength(0) {
+    std::memset(mCellGenerations, 0, sizeof(mCellGenerations));
+    Decode();
     Reset();
 }
 
-void R8Engine::Reset() {
+template<class TObserver>
+R8BasicEngine<TObserver>::~R8BasicEngine() {}
+
+template<class TObserver>
+void R8BasicEngine<TObserver>::Reset() {
     mIP = 0;
     mExecutionTime = 0;
     for (unsigned int i=0; i<REGISTERS_COUNT; ++i)
         mRegisters[i] = 0;
-    for (unsigned int i=0; i<MEMORY_SIZE; ++i)
-        mMemoryCells[i] = 0;
 
-    emit SignalReset();
+    if (mIsMemoryDirty) {
+        std::memset(mMemoryCells, 0, sizeof(mMemoryCells));
+        mIsMemoryDirty = false;
+    } else {
+        for (unsigned int i=0; i<mTouchedCount; ++i)
+            mMemoryCells[mTouchedCells[i]] = 0;
+    }
+
+    mLoopPower = 0;
+    mTouchedCount = 0;
+    if (++mGeneration == 0) { //wrapped, old generations would match again
+        std::memset(mCellGenerations, 0, sizeof(mCellGenerations));
+        mGeneration = 1;
+    }
+
+    this->NotifyReset();
+}
+
+template<class TObserver>
+void R8BasicEngine<TObserver>::Snapshot(R8State *state) const {
+    std::memcpy(state->Registers, mRegisters, sizeof(mRegisters));
+    std::memcpy(state->Memory, mMemoryCells, sizeof(mMemoryCells));
+    state->IP   = mIP;
+    state->Time = mExecutionTime;
+}
+
+template<class TObserver>
+void R8BasicEngine<TObserver>::Restore(const R8State &state) {
+    std::memcpy(mRegisters, state.Registers, sizeof(mRegisters));
+    std::memcpy(mMemoryCells, state.Memory, sizeof(mMemoryCells));
+    mIP = state.IP;
+    mExecutionTime = state.Time;
+    mIsMemoryDirty = true;
+    mLoopPower = 0;
+
+    this->NotifyRestore();
+}
+
+template<class TObserver>
+void R8BasicEngine<TObserver>::SetProgram(const R8Program &program) {
+    mProgram = program;
+    Decode();
+    CompileNative();
+    Reset();
+}
+
+template<class TObserver>
+void R8BasicEngine<TObserver>::SetJitEnabled(bool isEnabled) {
+    mIsJitEnabled = isEnabled;
+    CompileNative();
+}
+
+template<class TObserver>
+void R8BasicEngine<TObserver>::CompileNative() {
+    mJit.reset();
+    if (!mIsJitEnabled || !R8JitCode::IsSupported())
+        return;
+
+    QScopedPointer<R8JitCode> jit(new R8JitCode());
+    if (jit->Compile(mDecoded, JUMP_TIME))
+        mJit.swap(jit);
+}
+
+template<class TObserver>
+unsigned int R8BasicEngine<TObserver>::Execute(unsigned int count) {
+    bool isHalted;
+    return RunSteps(count, &isHalted);
+}
+
+template<class TObserver>
+unsigned int R8BasicEngine<TObserver>::RunSteps(unsigned int count, bool *isHalted) {
+    if (mIsLoopDetectionEnabled)
+        return ExecuteDetectingLoops(count, isHalted);
+    if (mJit.isNull() || (mIsRunning && (mBreakpointsCount != 0))) //native code runs over breakpoints
+        return Interpret(count, isHalted);
+    return ExecuteNative(count, isHalted);
+}
+
+template<class TObserver>
+typename R8BasicEngine<TObserver>::ERunStatus R8BasicEngine<TObserver>::Run(unsigned long maxSteps, unsigned long maxTime, unsigned long *steps) {
+    const unsigned int startTime = mExecutionTime;
+
+    unsigned long executed = 0;
+    ERunStatus status;
+    try {
+        for (;;) {
+            const unsigned long time = mExecutionTime - startTime;
+            if (IsHalted()) { //came to the end, possibly on the last step of the budget
+                Halt();
+                status = HALTED_STATUS;
+                break;
+            }
+            if ((maxTime != 0) && (time >= maxTime)) {
+                status = TIME_EXCEEDED_STATUS;
+                break;
+            }
+            if ((maxSteps != 0) && (executed == maxSteps)) {
+                status = STEPS_EXCEEDED_STATUS;
+                break;
+            }
+            if ((mDecoded[mIP].Handler == R8DecodedInstruction::IN_HANDLER) && !mInputPort->HasInput()) {
+                status = INPUT_NEEDED_STATUS;
+                break;
+            }
+
+            // The first step runs alone, as it may be at a breakpoint. No
+            // step of a chunk can pass maxTime but the last one.
+            unsigned long count = (executed == 0) ? 1 : UINT_MAX;
+            if (maxSteps != 0)
+                count = qMin(count, maxSteps - executed);
+            if (maxTime != 0)
+                count = qMin(count, qMax<unsigned long>((maxTime - time) / MAX_INSTRUCTION_TIME, 1));
+
+            bool isHalted;
+            mIsRunning = (executed != 0);
+            const unsigned int done = RunSteps((unsigned int)count, &isHalted);
+            mIsRunning = false;
+
+            executed += done;
+            if (isHalted) {
+                status = HALTED_STATUS;
+                break;
+            }
+            if (done < count) { //stopped before a breakpoint or "in"
+                const bool isInputNeeded = (mDecoded[mIP].Handler == R8DecodedInstruction::IN_HANDLER) && !mInputPort->HasInput();
+                status = isInputNeeded ? INPUT_NEEDED_STATUS : BREAKPOINT_STATUS;
+                break;
+            }
+        }
+    } catch (...) {
+        mIsRunning = false;
+        throw;
+    }
+
+    if (steps != 0)
+        *steps = executed;
+    return status;
+}
+
+template<class TObserver>
+void R8BasicEngine<TObserver>::SetBreakpoint(unsigned int ip, bool isSet) {
+    if ((ip >= (unsigned int)mBreakpoints.size()) || (mBreakpoints[ip] == isSet))
+        return;
+
+    mBreakpoints[ip] = isSet;
+    mBreakpointsCount += isSet ? 1 : -1;
+    Fuse();
+    mIsBound = false;
+}
+
+template<class TObserver>
+void R8BasicEngine<TObserver>::SetBreakpoints(const QVector<bool> &breakpoints) {
+    mBreakpointsCount = 0;
+    for (int ip=0; ip<mBreakpoints.size(); ++ip) {
+        mBreakpoints[ip] = (ip < breakpoints.size()) && breakpoints[ip];
+        mBreakpointsCount += mBreakpoints[ip] ? 1 : 0;
+    }
+    Fuse();
+    mIsBound = false;
+}
+
+template<class TObserver>
+void R8BasicEngine<TObserver>::ClearBreakpoints() {
+    mBreakpoints.fill(false);
+    mBreakpointsCount = 0;
+    Fuse();
+    mIsBound = false;
+}
+
+// Runs up to the next jump or "in" are interpreted at once; only the states
+// after them matter.
+template<class TObserver>
+unsigned int R8BasicEngine<TObserver>::ExecuteDetectingLoops(unsigned int count, bool *isHalted) {
+    unsigned int executed = 0;
+    *isHalted = false;
+    while ((executed < count) && !*isHalted) {
+        if (mIP >= (unsigned int)mProgram.Length()) //halted, or IP set beyond the program
+            return executed + Interpret(count - executed, isHalted);
+
+        const unsigned int runLength = mRunLengths[mIP];
+        const unsigned int end  = mIP + runLength - 1; //the jump, "in" or halt ending the run
+        const unsigned int done = Interpret(qMin(runLength, count - executed), isHalted);
+        executed += done;
+        if (done < runLength) //out of budget, stopped by Run(), or halted
+            break;
+
+        if (mDecoded[end].Opcode == R8Instruction::IN_OPCODE)
+            mLoopPower = 0; //the next states depend on the input
+        else if ((mDecoded[end].Opcode == R8Instruction::JZ_OPCODE) || (mDecoded[end].Opcode == R8Instruction::JO_OPCODE))
+            CheckLoop();
+    }
+    return executed;
+}
+
+// Every loop takes a jump, and the state after a jump decides the states
+// after the next ones, so they repeat once the program loops.
+template<class TObserver>
+void R8BasicEngine<TObserver>::CheckLoop() {
+    if (IsHalted())
+        return;
+
+    if (mLoopPower != 0) {
+        ++mLoopLength;
+        if ((mIP == mLoopState.IP) //mostly differs already
+                && (std::memcmp(mRegisters, mLoopState.Registers, sizeof(mRegisters)) == 0)
+                && (std::memcmp(mMemoryCells, mLoopState.Memory, sizeof(mMemoryCells)) == 0))
+            throw R8Exception(QCoreApplication::translate("R8Engine", "Infinite loop detected"));
+        if (mLoopLength < mLoopPower)
+            return;
+    }
+
+    Snapshot(&mLoopState);
+    mLoopPower  = (mLoopPower == 0) ? 1 : 2*mLoopPower;
+    mLoopLength = 0;
 }
 
-void R8Engine::Step() {
+// Native code runs whole blocks from block starts; the interpreter takes
+// everything else: in/out/halt, entries in the middle of a block and the
+// tail of the budget that is shorter than the next block.
+template<class TObserver>
+unsigned int R8BasicEngine<TObserver>::ExecuteNative(unsigned int count, bool *isHalted) {
+    R8JitContext context;
+    context.Registers = mRegisters;
+    context.Memory    = mMemoryCells;
+
+    unsigned int executed = 0;
+    *isHalted = false;
+    while ((executed < count) && !*isHalted) {
+        if (!mJit->IsEntry(mIP)) {
+            const unsigned int done = Interpret(1, isHalted);
+            if (done == 0) //stopped by Run()
+                break;
+            executed += done;
+            continue;
+        }
+
+        context.IP     = mIP;
+        context.Time   = mExecutionTime;
+        context.Budget = count - executed;
+        mJit->Run(&context);
+        mIsMemoryDirty = true; //native writes are not tracked
+
+        executed += (count - executed) - context.Budget;
+        mIP = context.IP;
+        mExecutionTime = context.Time;
+
+        if (mJit->IsEntry(mIP)) { //the next block is longer than the budget
+            executed += Interpret(count - executed, isHalted);
+            break;
+        }
+    }
+    return executed;
+}
+
+template<class TObserver>
+void R8BasicEngine<TObserver>::Decode() {
+    const unsigned int length = (unsigned int)mProgram.Length();
+
+    mDecoded.resize(length + 1);
+    for (unsigned int i=0; i<=length; ++i) {
+        R8Instruction instr = mProgram.Instruction(i); //HALT at i == length
+        R8DecodedInstruction& d = mDecoded[i];
+
+        d.Address  = 0;
+        d.Function = 0;
+        d.Target   = 0;
+        d.Cost     = OPERATION_TIME;
+        d.BlockCost = d.FallCost = d.JumpCost = 0;
+        d.Handler  = R8DecodedInstruction::INVALID_HANDLER;
+        d.Opcode   = (unsigned char)instr.Opcode();
+        d.Mode1 = d.Mode2 = d.ModeR = R8Reference::CONSTANT; //not used operands cost nothing
+        d.Value1 = d.Value2 = d.ValueR = 0;
+
+        bool isValid = false;
+        switch (instr.Opcode()) {
+        case R8Instruction::HALT_OPCODE:
+            d.Handler = R8DecodedInstruction::HALT_HANDLER;
+            d.Cost = 0;
+            isValid = true;
+            break;
+        case R8Instruction::IN_OPCODE:
+            d.Handler = R8DecodedInstruction::IN_HANDLER;
+            isValid = DecodeResult(instr.Result(), &d.ModeR, &d.ValueR, &d.Cost);
+            break;
+        case R8Instruction::OUT_OPCODE:
+            d.Handler = R8DecodedInstruction::OUT_HANDLER;
+            isValid = DecodeOperand(instr.Operand1(), &d.Mode1, &d.Value1, &d.Cost);
+            break;
+        case R8Instruction::NOT_OPCODE:
+            d.Handler = R8DecodedInstruction::ALU_HANDLER;
+            isValid = DecodeOperand(instr.Operand1(), &d.Mode1, &d.Value1, &d.Cost)
+                   && DecodeResult(instr.Result(), &d.ModeR, &d.ValueR, &d.Cost);
+            break;
+        case R8Instruction::ROR_OPCODE:
+        case R8Instruction::ROL_OPCODE:
+        case R8Instruction::OR_OPCODE:
+        case R8Instruction::AND_OPCODE:
+        case R8Instruction::NOR_OPCODE:
+        case R8Instruction::NAND_OPCODE:
+        case R8Instruction::XOR_OPCODE:
+        case R8Instruction::ADD_OPCODE:
+        case R8Instruction::SUB_OPCODE:
+            d.Handler = R8DecodedInstruction::ALU_HANDLER;
+            isValid = DecodeOperand(instr.Operand1(), &d.Mode1, &d.Value1, &d.Cost)
+                   && DecodeOperand(instr.Operand2(), &d.Mode2, &d.Value2, &d.Cost)
+                   && DecodeResult(instr.Result(), &d.ModeR, &d.ValueR, &d.Cost);
+            break;
+        case R8Instruction::JZ_OPCODE:
+        case R8Instruction::JO_OPCODE:
+            d.Target = instr.Result().Value();
+            isValid = DecodeOperand(instr.Operand1(), &d.Mode1, &d.Value1, &d.Cost)
+                   && (instr.Result().AccessType() == R8Reference::INSTRUCTION_INDEX)
+                   && (d.Target <= length); //the loop dispatches without IP checks
+            d.Handler = d.Mode1 + ((instr.Opcode() == R8Instruction::JZ_OPCODE)
+                                   ? R8DecodedInstruction::JZ_CONSTANT_HANDLER
+                                   : R8DecodedInstruction::JO_CONSTANT_HANDLER);
+            if ((d.Handler == R8DecodedInstruction::JZ_CONSTANT_HANDLER) && (d.Value1 == 0x00))
+                d.Handler = R8DecodedInstruction::GOTO_HANDLER;
+            if ((d.Handler == R8DecodedInstruction::JO_CONSTANT_HANDLER) && (d.Value1 == 0xFF))
+                d.Handler = R8DecodedInstruction::GOTO_HANDLER;
+            break;
+        default:
+            break;
+        }
+
+        if (!isValid)
+            d.Handler = R8DecodedInstruction::INVALID_HANDLER;
+        d.FusedHandler = d.Handler;
+        if (!isValid)
+            continue;
+
+        TAluHandler alu = 0;
+        switch (instr.Opcode()) {
+        case R8Instruction::ROR_OPCODE:  alu = SelectAlu<R8RorOperation>(d.Mode1, d.Mode2, d.ModeR);  break;
+        case R8Instruction::ROL_OPCODE:  alu = SelectAlu<R8RolOperation>(d.Mode1, d.Mode2, d.ModeR);  break;
+        case R8Instruction::NOT_OPCODE:  alu = SelectAlu<R8NotOperation>(d.Mode1, d.Mode2, d.ModeR);  break;
+        case R8Instruction::OR_OPCODE:   alu = SelectAlu<R8OrOperation>(d.Mode1, d.Mode2, d.ModeR);   break;
+        case R8Instruction::AND_OPCODE:  alu = SelectAlu<R8AndOperation>(d.Mode1, d.Mode2, d.ModeR);  break;
+        case R8Instruction::NOR_OPCODE:  alu = SelectAlu<R8NorOperation>(d.Mode1, d.Mode2, d.ModeR);  break;
+        case R8Instruction::NAND_OPCODE: alu = SelectAlu<R8NandOperation>(d.Mode1, d.Mode2, d.ModeR); break;
+        case R8Instruction::XOR_OPCODE:  alu = SelectAlu<R8XorOperation>(d.Mode1, d.Mode2, d.ModeR);  break;
+        case R8Instruction::ADD_OPCODE:  alu = SelectAlu<R8AddOperation>(d.Mode1, d.Mode2, d.ModeR);  break;
+        case R8Instruction::SUB_OPCODE:  alu = SelectAlu<R8SubOperation>(d.Mode1, d.Mode2, d.ModeR);  break;
+        default: break;
+        }
+        d.Function = reinterpret_cast<void (*)()>(alu);
+    }
+
+    mBreakpoints.fill(false, length + 1);
+    mBreakpointsCount = 0;
+
+    SumBlockCosts();
+    Fuse();
+    mIsBound = false;
+
+    mRunLengths.resize(length + 1);
+    mRunLengths[length] = 1;
+    for (int i=(int)length-1; i>=0; --i) {
+        const unsigned char opcode = mDecoded[i].Opcode;
+        const bool isRunEnd = (opcode == R8Instruction::JZ_OPCODE) || (opcode == R8Instruction::JO_OPCODE)
+                           || (opcode == R8Instruction::IN_OPCODE) || (opcode == R8Instruction::HALT_OPCODE);
+        mRunLengths[i] = isRunEnd ? 1 : mRunLengths[i + 1] + 1;
+    }
+}
+
+// Blocks end at jumps and before jump targets; the costs within a block are
+// static, so the interpreter charges them once per block entry and keeps the
+// exact time as "time - BlockCost of the current instruction".
+template<class TObserver>
+void R8BasicEngine<TObserver>::SumBlockCosts() {
+    const int length = mProgram.Length();
+
+    QVector<bool> isTarget(length + 1, false);
+    for (int i=0; i<length; ++i) {
+        const R8DecodedInstruction& d = mDecoded[i];
+        if ((d.Handler >= R8DecodedInstruction::JZ_CONSTANT_HANDLER) && (d.Handler <= R8DecodedInstruction::GOTO_HANDLER))
+            isTarget[d.Target] = true;
+    }
+
+    mDecoded[length].BlockCost = mDecoded[length].Cost;
+    for (int i=length-1; i>=0; --i) {
+        R8DecodedInstruction& d = mDecoded[i];
+        const R8DecodedInstruction& next = mDecoded[i + 1];
+
+        bool isJump = (d.Opcode == R8Instruction::JZ_OPCODE) || (d.Opcode == R8Instruction::JO_OPCODE);
+        if (isJump || isTarget[i + 1]) {
+            d.BlockCost = d.Cost;
+            d.FallCost  = next.BlockCost;
+        } else {
+            d.BlockCost = d.Cost + next.BlockCost;
+            d.FallCost  = 0;
+        }
+    }
+
+    for (int i=0; i<length; ++i) {
+        R8DecodedInstruction& d = mDecoded[i];
+        if (d.Target <= (unsigned int)length) //an invalid jump may go beyond
+            d.JumpCost = JUMP_TIME + mDecoded[d.Target].BlockCost;
+    }
+}
+
+// Student programs spend most of their time in "and/xor/sub ... + jz" loops,
+// so such pairs and triples are dispatched once. A superinstruction runs whole
+// only if the budget allows, otherwise its first instruction runs alone, so
+// Step() still stops at every instruction.
+//
+// Breakpoints are dispatched to BREAKPOINT_HANDLER, so Run() checks for them
+// only where they are; a superinstruction never spans one.
+template<class TObserver>
+void R8BasicEngine<TObserver>::Fuse() {
+    const int length = mProgram.Length(); //mDecoded[length] is HALT
+
+    for (int i=0; i<=length; ++i)
+        mDecoded[i].FusedHandler = mDecoded[i].Handler;
+
+    for (int i=0; i+1<length; ++i) {
+        R8DecodedInstruction& d = mDecoded[i];
+        if ((d.Handler != R8DecodedInstruction::ALU_HANDLER) || mBreakpoints[i + 1])
+            continue;
+
+        const R8DecodedInstruction& next = mDecoded[i + 1];
+        const R8DecodedInstruction& last = mDecoded[i + 2];
+
+        if (mBreakpoints[i + 2] && (next.Handler == R8DecodedInstruction::ALU_HANDLER))
+            continue; //not a pair either: "alu, alu" is not fused
+        if ((next.Handler == R8DecodedInstruction::ALU_HANDLER) && (last.Handler == R8DecodedInstruction::JZ_REGISTER_HANDLER))
+            d.FusedHandler = R8DecodedInstruction::ALU_ALU_JZ_HANDLER;
+        else if ((next.Handler == R8DecodedInstruction::ALU_HANDLER) && (last.Handler == R8DecodedInstruction::JO_REGISTER_HANDLER))
+            d.FusedHandler = R8DecodedInstruction::ALU_ALU_JO_HANDLER;
+        else if (next.Handler == R8DecodedInstruction::JZ_REGISTER_HANDLER)
+            d.FusedHandler = R8DecodedInstruction::ALU_JZ_HANDLER;
+        else if (next.Handler == R8DecodedInstruction::JO_REGISTER_HANDLER)
+            d.FusedHandler = R8DecodedInstruction::ALU_JO_HANDLER;
+        else if (next.Handler == R8DecodedInstruction::GOTO_HANDLER)
+            d.FusedHandler = R8DecodedInstruction::ALU_GOTO_HANDLER;
+    }
+
+    for (int i=0; i<=length; ++i) {
+        if (mBreakpoints[i])
+            mDecoded[i].FusedHandler = R8DecodedInstruction::BREAKPOINT_HANDLER;
+    }
+}
+
+template<class TObserver>
+bool R8BasicEngine<TObserver>::DecodeOperand(const R8Reference &ref, unsigned char *mode, unsigned char *value, unsigned int *cost) const {
+    *mode  = (unsigned char)ref.AccessType();
+    *value = (unsigned char)ref.Value();
+
+    switch (ref.AccessType()) {
+    case R8Reference::CONSTANT:
+        *cost += CONSTANT_ACCESS_TIME;
+        return true;
+    case R8Reference::REGISTER:
+        *cost += REGISTER_ACCESS_TIME;
+        return (*value < REGISTERS_COUNT);
+    case R8Reference::MEMORY_BY_CONSTANT:
+        *cost += MEMORY_ACCESS_TIME;
+        return true;
+    case R8Reference::MEMORY_BY_REGISTER:
+        *cost += REGISTER_ACCESS_TIME + MEMORY_ACCESS_TIME;
+        return (*value < REGISTERS_COUNT);
+    default:
+        return false;
+    }
+}
+
+template<class TObserver>
+bool R8BasicEngine<TObserver>::DecodeResult(const R8Reference &ref, unsigned char *mode, unsigned char *value, unsigned int *cost) const {
+    if (ref.AccessType() == R8Reference::CONSTANT)
+        return false;
+    return DecodeOperand(ref, mode, value, cost);
+}
+
+template<class TObserver>
+inline unsigned char R8BasicEngine<TObserver>::ReadOperand(unsigned char mode, unsigned char value) const {
+    switch (mode) {
+    case R8Reference::REGISTER:           return mRegisters[value];
+    case R8Reference::MEMORY_BY_CONSTANT: return mMemoryCells[value];
+    case R8Reference::MEMORY_BY_REGISTER: return mMemoryCells[mRegisters[value]];
+    default:                              return value; //CONSTANT
+    }
+}
+
+template<class TObserver>
+inline void R8BasicEngine<TObserver>::WriteResult(unsigned char mode, unsigned char value, unsigned char result) {
+    switch (mode) {
+    case R8Reference::REGISTER:
+        Write<R8Reference::REGISTER>(value, result);
+        break;
+    case R8Reference::MEMORY_BY_CONSTANT:
+        Write<R8Reference::MEMORY_BY_CONSTANT>(value, result);
+        break;
+    default:
+        Write<R8Reference::MEMORY_BY_REGISTER>(value, result);
+        break;
+    }
+}
+
+template<class TObserver>
+template<int MODE>
+inline unsigned char R8BasicEngine<TObserver>::Read(unsigned char value) const {
+    switch (MODE) {
+    case R8Reference::REGISTER:           return mRegisters[value];
+    case R8Reference::MEMORY_BY_CONSTANT: return mMemoryCells[value];
+    case R8Reference::MEMORY_BY_REGISTER: return mMemoryCells[mRegisters[value]];
+    default:                              return value;
+    }
+}
+
+template<class TObserver>
+inline void R8BasicEngine<TObserver>::TouchMemory(unsigned int index) {
+    if (mCellGenerations[index] != mGeneration) {
+        mCellGenerations[index] = mGeneration;
+        mTouchedCells[mTouchedCount++] = (unsigned char)index;
+    }
+}
+
+template<class TObserver>
+template<int MODE>
+inline void R8BasicEngine<TObserver>::Write(unsigned char value, unsigned char result) {
+    switch (MODE) {
+    case R8Reference::REGISTER:
+        mRegisters[value] = result;
+        this->NotifyWriteRegister(value);
+        break;
+    case R8Reference::MEMORY_BY_CONSTANT:
+        TouchMemory(value);
+        mMemoryCells[value] = result;
+        this->NotifyWriteMemory(value);
+        break;
+    default: { //MEMORY_BY_REGISTER
+        unsigned int index = mRegisters[value];
+        TouchMemory(index);
+        mMemoryCells[index] = result;
+        this->NotifyWriteMemory(index);
+        break;
+    }
+    }
+}
+
+template<class TObserver>
+template<class TOperation, int MODE1, int MODE2, int MODE_R>
+void R8BasicEngine<TObserver>::Alu(R8BasicEngine &engine, const R8DecodedInstruction &d) {
+    unsigned char x = engine.template Read<MODE1>(d.Value1);
+    unsigned char y = engine.template Read<MODE2>(d.Value2);
+    engine.template Write<MODE_R>(d.ValueR, TOperation::Apply(x, y));
+}
+
+template<class TObserver>
+template<class TOperation, int MODE1, int MODE2>
+typename R8BasicEngine<TObserver>::TAluHandler R8BasicEngine<TObserver>::SelectAluByResult(unsigned char modeR) {
+    switch (modeR) {
+    case R8Reference::REGISTER:           return &Alu<TOperation, MODE1, MODE2, R8Reference::REGISTER>;
+    case R8Reference::MEMORY_BY_CONSTANT: return &Alu<TOperation, MODE1, MODE2, R8Reference::MEMORY_BY_CONSTANT>;
+    default:                              return &Alu<TOperation, MODE1, MODE2, R8Reference::MEMORY_BY_REGISTER>;
+    }
+}
+
+template<class TObserver>
+template<class TOperation, int MODE1>
+typename R8BasicEngine<TObserver>::TAluHandler R8BasicEngine<TObserver>::SelectAluByOperand2(unsigned char mode2, unsigned char modeR) {
+    switch (mode2) {
+    case R8Reference::REGISTER:           return SelectAluByResult<TOperation, MODE1, R8Reference::REGISTER>(modeR);
+    case R8Reference::MEMORY_BY_CONSTANT: return SelectAluByResult<TOperation, MODE1, R8Reference::MEMORY_BY_CONSTANT>(modeR);
+    case R8Reference::MEMORY_BY_REGISTER: return SelectAluByResult<TOperation, MODE1, R8Reference::MEMORY_BY_REGISTER>(modeR);
+    default:                              return SelectAluByResult<TOperation, MODE1, R8Reference::CONSTANT>(modeR);
+    }
+}
+
+template<class TObserver>
+template<class TOperation>
+typename R8BasicEngine<TObserver>::TAluHandler R8BasicEngine<TObserver>::SelectAlu(unsigned char mode1, unsigned char mode2, unsigned char modeR) {
+    switch (mode1) {
+    case R8Reference::REGISTER:           return SelectAluByOperand2<TOperation, R8Reference::REGISTER>(mode2, modeR);
+    case R8Reference::MEMORY_BY_CONSTANT: return SelectAluByOperand2<TOperation, R8Reference::MEMORY_BY_CONSTANT>(mode2, modeR);
+    case R8Reference::MEMORY_BY_REGISTER: return SelectAluByOperand2<TOperation, R8Reference::MEMORY_BY_REGISTER>(mode2, modeR);
+    default:                              return SelectAluByOperand2<TOperation, R8Reference::CONSTANT>(mode2, modeR);
+    }
+}
+
+// Direct threading: every decoded instruction keeps the address of its handler
+// label and each handler jumps to the next one itself (GCC/Clang "labels as
+// values"). Other compilers get the same handlers as a switch in a loop.
+#if defined(__GNUC__) && !defined(R8_NO_THREADED_DISPATCH)
+#   define R8_THREADED_DISPATCH
+#endif
+
+#ifdef R8_THREADED_DISPATCH
+#   define R8_HANDLER(h)  L_##h:
+#   define R8_NEXT()      if (executed == count) goto L_EXIT; ++executed; d = code + ip; goto *d->Address
+#   define R8_DISPATCH(h) goto *sHandlers[h]
+#else
+#   define R8_HANDLER(h)  case R8DecodedInstruction::h:
+#   define R8_NEXT()      continue
+#   define R8_DISPATCH(h) handler = (h); goto L_DISPATCH
+#endif
+
+// IP and time live in locals inside the loop; time includes the prepaid rest
+// of the current block (see SumBlockCosts())
+#define R8_SYNC()   mIP = ip; mExecutionTime = time - code[ip].BlockCost
+#define R8_RELOAD() time = mExecutionTime + code[ip].BlockCost
+
+#define R8_ALU(d) reinterpret_cast<TAluHandler>((d)->Function)(*this, *(d)); time += (d)->FallCost
+
+// "alus" ALU instructions and a jump on a register; see Fuse()
+#define R8_FUSED_JUMP_HANDLER(h, alus, condition) \
+    R8_HANDLER(h) { \
+        R8_ALU(d); \
+        if (count - executed < (alus)) { \
+            ++ip; \
+        } else { \
+            executed += (alus); \
+            if ((alus) == 2) { \
+                R8_ALU(d + 1); \
+            } \
+            const R8DecodedInstruction *j = d + (alus); \
+            unsigned char x = mRegisters[j->Value1]; \
+            if (condition) { \
+                ip = j->Target; \
+                time += j->JumpCost; \
+            } else { \
+                ip += (alus) + 1; \
+                time += j->FallCost; \
+            } \
+        } \
+    } R8_NEXT();
+
+#define R8_JUMP_HANDLER(h, mode, condition) \
+    R8_HANDLER(h) { \
+        unsigned char x = Read<mode>(d->Value1); \
+        if (condition) { \
+            ip = d->Target; \
+            time += d->JumpCost; \
+        } else { \
+            ++ip; \
+            time += d->FallCost; \
+        } \
+    } R8_NEXT();
+
+template<class TObserver>
+unsigned int R8BasicEngine<TObserver>::Interpret(unsigned int count, bool *isHalted) {
+#ifdef R8_THREADED_DISPATCH
+    static const void *const sHandlers[R8DecodedInstruction::HANDLERS_COUNT] = {
+        &&L_HALT_HANDLER, &&L_IN_HANDLER, &&L_OUT_HANDLER, &&L_ALU_HANDLER,
+        &&L_JZ_CONSTANT_HANDLER, &&L_JZ_REGISTER_HANDLER, &&L_JZ_MEMORY_BY_CONSTANT_HANDLER, &&L_JZ_MEMORY_BY_REGISTER_HANDLER,
+        &&L_JO_CONSTANT_HANDLER, &&L_JO_REGISTER_HANDLER, &&L_JO_MEMORY_BY_CONSTANT_HANDLER, &&L_JO_MEMORY_BY_REGISTER_HANDLER,
+        &&L_GOTO_HANDLER,
+        &&L_INVALID_HANDLER,
+        &&L_ALU_JZ_HANDLER, &&L_ALU_JO_HANDLER, &&L_ALU_GOTO_HANDLER,
+        &&L_ALU_ALU_JZ_HANDLER, &&L_ALU_ALU_JO_HANDLER,
+        &&L_BREAKPOINT_HANDLER
+    };
+
+    if (!mIsBound) {
+        for (int i=0; i<mDecoded.size(); ++i)
+            mDecoded[i].Address = sHandlers[mDecoded[i].FusedHandler];
+        mIsBound = true;
+    }
+#endif
+
+    *isHalted = false;
+    if (count == 0)
+        return 0;
+
+    const unsigned int length = (unsigned int)mProgram.Length();
+    if (mIP > length) { //a step after a jump beyond the program
+        Halt();
+        *isHalted = true;
+        return 0;
+    }
+
+    const R8DecodedInstruction *code = mDecoded.constData();
+    const R8DecodedInstruction *d;
+    unsigned int ip = mIP;
+    unsigned int time = mExecutionTime + code[ip].BlockCost;
+    unsigned int executed = 0;
+
+#ifdef R8_THREADED_DISPATCH
+    R8_NEXT();
+#else
+    unsigned char handler;
+    for (;;) {
+        if (executed == count)
+            goto L_EXIT;
+        ++executed;
+        d = code + ip;
+        handler = d->FusedHandler;
+
+L_DISPATCH:
+        switch (handler) {
+#endif
+
+    R8_HANDLER(HALT_HANDLER) {
+        R8_SYNC();
+        Halt();
+        *isHalted = true;
+        return (ip < length) ? executed : executed - 1; //the halt at the end is no step: IsHalted() was true already
+    }
+
+    R8_HANDLER(IN_HANDLER) {
+        Q_ASSERT(mInputPort != 0);
+
+        R8_SYNC(); //the port may throw
+        if (mIsRunning && !mInputPort->HasInput()) { //Run() waits for input
+            return executed - 1;
+        }
+        unsigned char x = mInputPort->Input();
+        if (mInputPort->IsFailure()) {
+            Halt();
+            *isHalted = true;
+            return executed;
+        }
+        WriteResult(d->ModeR, d->ValueR, x);
+        time += d->FallCost;
+        ++ip;
+    } R8_NEXT();
+
+    R8_HANDLER(OUT_HANDLER) {
+        unsigned char x = ReadOperand(d->Mode1, d->Value1);
+        if (mOutputPort != 0)
+            mOutputPort->Output(x);
+        else
+            this->NotifyOutput(x);
+        time += d->FallCost;
+        ++ip;
+    } R8_NEXT();
+
+    R8_HANDLER(ALU_HANDLER) {
+        R8_ALU(d);
+        ++ip;
+    } R8_NEXT();
+
+    R8_JUMP_HANDLER(JZ_CONSTANT_HANDLER,           R8Reference::CONSTANT,           x == 0)
+    R8_JUMP_HANDLER(JZ_REGISTER_HANDLER,           R8Reference::REGISTER,           x == 0)
+    R8_JUMP_HANDLER(JZ_MEMORY_BY_CONSTANT_HANDLER, R8Reference::MEMORY_BY_CONSTANT, x == 0)
+    R8_JUMP_HANDLER(JZ_MEMORY_BY_REGISTER_HANDLER, R8Reference::MEMORY_BY_REGISTER, x == 0)
+
+    R8_JUMP_HANDLER(JO_CONSTANT_HANDLER,           R8Reference::CONSTANT,           x == 0xFF)
+    R8_JUMP_HANDLER(JO_REGISTER_HANDLER,           R8Reference::REGISTER,           x == 0xFF)
+    R8_JUMP_HANDLER(JO_MEMORY_BY_CONSTANT_HANDLER, R8Reference::MEMORY_BY_CONSTANT, x == 0xFF)
+    R8_JUMP_HANDLER(JO_MEMORY_BY_REGISTER_HANDLER, R8Reference::MEMORY_BY_REGISTER, x == 0xFF)
+
+    R8_HANDLER(GOTO_HANDLER) {
+        time += d->JumpCost;
+        ip = d->Target;
+    } R8_NEXT();
+
+    R8_FUSED_JUMP_HANDLER(ALU_JZ_HANDLER,     1, x == 0)
+    R8_FUSED_JUMP_HANDLER(ALU_JO_HANDLER,     1, x == 0xFF)
+    R8_FUSED_JUMP_HANDLER(ALU_ALU_JZ_HANDLER, 2, x == 0)
+    R8_FUSED_JUMP_HANDLER(ALU_ALU_JO_HANDLER, 2, x == 0xFF)
+
+    R8_HANDLER(ALU_GOTO_HANDLER) {
+        R8_ALU(d);
+        if (count - executed < 1) {
+            ++ip;
+        } else {
+            ++executed;
+            time += d[1].JumpCost;
+            ip = d[1].Target;
+        }
+    } R8_NEXT();
+
+    R8_HANDLER(BREAKPOINT_HANDLER) {
+        if (mIsRunning) {
+            R8_SYNC();
+            return executed - 1;
+        }
+        R8_DISPATCH(d->Handler);
+    }
+
+    R8_HANDLER(INVALID_HANDLER) {
+        R8_SYNC();
+        ReferenceStep(); //throws the exception of the instruction
+        ip = mIP;
+        if (ip > length) {
+            *isHalted = true;
+            return executed;
+        }
+        R8_RELOAD();
+    } R8_NEXT();
+
+#ifndef R8_THREADED_DISPATCH
+        }
+    }
+#endif
+
+L_EXIT:
+    R8_SYNC();
+    return executed;
+}
+
+#undef R8_JUMP_HANDLER
+#undef R8_FUSED_JUMP_HANDLER
+#undef R8_ALU
+#undef R8_RELOAD
+#undef R8_SYNC
+#undef R8_DISPATCH
+#undef R8_NEXT
+#undef R8_HANDLER
+
+template<class TObserver>
+void R8BasicEngine<TObserver>::ReferenceStep() {
     int ip = mIP;
 
     R8Instruction Instr = mProgram.Instruction(ip);
@@ -36,41 +849,59 @@ void R8Engine::Step() {
     case R8Instruction::JZ_OPCODE:   Jz(Instr);   break;
     case R8Instruction::JO_OPCODE:   Jo(Instr);   break;
     default:
-        throw R8Exception(tr("Uncnown opcode"));
+        throw R8Exception(QCoreApplication::translate("R8Engine", "Uncnown opcode"));
     }
 }
 
-unsigned char R8Engine::Register(unsigned int index) {
+template<class TObserver>
+unsigned char R8BasicEngine<TObserver>::Register(unsigned int index) {
     if (index < REGISTERS_COUNT)
         return mRegisters[index];
 
-    throw R8Exception(tr("Incorrect register index"));
+    throw R8Exception(QCoreApplication::translate("R8Engine", "Incorrect register index"));
+}
+
+template<class TObserver>
+void R8BasicEngine<TObserver>::SetRegister(unsigned int index, unsigned char value) {
+    WriteRegister(index, value);
+    mLoopPower = 0; //not a step of the program
 }
 
-void R8Engine::SetRegister(unsigned int index, unsigned char value) {
+template<class TObserver>
+void R8BasicEngine<TObserver>::WriteRegister(unsigned int index, unsigned char value) {
     if (index < REGISTERS_COUNT) {
         mRegisters[index] = value;
-        emit SignalWriteRegister(index);
+        this->NotifyWriteRegister(index);
     } else
-        throw R8Exception(tr("Incorrect register index"));
+        throw R8Exception(QCoreApplication::translate("R8Engine", "Incorrect register index"));
 }
 
-unsigned char R8Engine::MemoryCell(unsigned int index) {
+template<class TObserver>
+unsigned char R8BasicEngine<TObserver>::MemoryCell(unsigned int index) {
     if (index < MEMORY_SIZE)
         return mMemoryCells[index];
 
-    throw R8Exception(tr("Incorrect memory index"));
+    throw R8Exception(QCoreApplication::translate("R8Engine", "Incorrect memory index"));
 }
 
-void R8Engine::SetMemoryCell(unsigned int index, unsigned char value) {
+template<class TObserver>
+void R8BasicEngine<TObserver>::SetMemoryCell(unsigned int index, unsigned char value) {
+    WriteMemoryCell(index, value);
+    mLoopPower = 0; //not a step of the program
+}
+
+template<class TObserver>
+void R8BasicEngine<TObserver>::WriteMemoryCell(unsigned int index, unsigned char value) {
     if (index < MEMORY_SIZE) {
+        TouchMemory(index);
         mMemoryCells[index] = value;
-        emit SignalWriteMemory(index);
+        this->NotifyWriteMemory(index);
     } else
-        throw R8Exception(tr("Incorrect memory index"));
+        throw R8Exception(QCoreApplication::translate("R8Engine", "Incorrect memory index"));
 }
 
-unsigned char R8Engine::GetOperand(const R8Reference &ref) {
+template<class TObserver>
+unsigned char R8BasicEngine<TObserver>::GetOperand(const R8Reference &ref) {
     switch (ref.AccessType()) {
     case R8Reference::CONSTANT:
         UpdateExecutionTime(CONSTANT_ACCESS_TIME);
@@ -86,52 +917,59 @@ unsigned char R8Engine::GetOperand(const R8Reference &ref) {
         UpdateExecutionTime(MEMORY_ACCESS_TIME);
         return MemoryCell((unsigned int)Register((unsigned char)ref.Value()));
     default:
-        throw R8Exception(tr("Bad reference for operand"));
+        throw R8Exception(QCoreApplication::translate("R8Engine", "Bad reference for operand"));
     }
 }
 
-void R8Engine::SetResult(const R8Reference &ref, unsigned char result) {
+template<class TObserver>
+void R8BasicEngine<TObserver>::SetResult(const R8Reference &ref, unsigned char result) {
     switch (ref.AccessType()) {
     case R8Reference::REGISTER:
         UpdateExecutionTime(REGISTER_ACCESS_TIME);
-        SetRegister((unsigned char)ref.Value(), result);
+        WriteRegister((unsigned char)ref.Value(), result);
         break;
     case R8Reference::MEMORY_BY_CONSTANT:
         UpdateExecutionTime(MEMORY_ACCESS_TIME);
-        SetMemoryCell((unsigned char)ref.Value(), result);
+        WriteMemoryCell((unsigned char)ref.Value(), result);
         break;
     case R8Reference::MEMORY_BY_REGISTER:
         UpdateExecutionTime(REGISTER_ACCESS_TIME);
         UpdateExecutionTime(MEMORY_ACCESS_TIME);
-        SetMemoryCell((unsigned int)Register((unsigned char)ref.Value()), result);
+        WriteMemoryCell((unsigned int)Register((unsigned char)ref.Value()), result);
         break;
     default:
-        throw R8Exception(tr("Bad reference for result"));
+        throw R8Exception(QCoreApplication::translate("R8Engine", "Bad reference for result"));
     }
 }
 
-unsigned int R8Engine::GetIP(const R8Reference &ref) {
+template<class TObserver>
+unsigned int R8BasicEngine<TObserver>::GetIP(const R8Reference &ref) {
     if (ref.AccessType() == R8Reference::INSTRUCTION_INDEX)
         return ref.Value();
-    throw R8Exception(tr("It is not an LABEL reference"));
+    throw R8Exception(QCoreApplication::translate("R8Engine", "It is not an LABEL reference"));
 }
 
-void R8Engine::GoToNextInstruction() {
+template<class TObserver>
+void R8BasicEngine<TObserver>::GoToNextInstruction() {
     mIP++;
 }
 
-void R8Engine::GoToInstruction(unsigned int index) {
+template<class TObserver>
+void R8BasicEngine<TObserver>::GoToInstruction(unsigned int index) {
     mIP = index;
 }
 
-void R8Engine::GotoInHaltState() {mIP = mProgram.Length();}
+template<class TObserver>
+void R8BasicEngine<TObserver>::GotoInHaltState() {mIP = mProgram.Length();}
 
-void R8Engine::Halt() {
+template<class TObserver>
+void R8BasicEngine<TObserver>::Halt() {
     GotoInHaltState();
-    emit SignalHalt();
+    this->NotifyHalt();
 }
 
-void R8Engine::In(const R8Instruction &I) {
+template<class TObserver>
+void R8BasicEngine<TObserver>::In(const R8Instruction &I) {
     Q_ASSERT(mInputPort != 0);
 
     unsigned char x = mInputPort->Input();
@@ -145,16 +983,21 @@ void R8Engine::In(const R8Instruction &I) {
     }
 }
 
-void R8Engine::Out(const R8Instruction &I) {
+template<class TObserver>
+void R8BasicEngine<TObserver>::Out(const R8Instruction &I) {
     //todo: вывод (через метод контроллеров?)
     unsigned char o = GetOperand(I.Operand1());
-    emit SignalOutput(o);
+    if (mOutputPort != 0)
+        mOutputPort->Output(o);
+    else
+        this->NotifyOutput(o);
     GoToNextInstruction();
 
     UpdateExecutionTime(OPERATION_TIME);
 }
 
-void R8Engine::Ror(const R8Instruction &I) {
+template<class TObserver>
+void R8BasicEngine<TObserver>::Ror(const R8Instruction &I) {
     unsigned char x = GetOperand(I.Operand1());
     unsigned char n = GetOperand(I.Operand2());
     n = (n % 8);
@@ -165,7 +1008,8 @@ void R8Engine::Ror(const R8Instruction &I) {
     UpdateExecutionTime(OPERATION_TIME);
 }
 
-void R8Engine::Rol(const R8Instruction &I) {
+template<class TObserver>
+void R8BasicEngine<TObserver>::Rol(const R8Instruction &I) {
     unsigned char x = GetOperand(I.Operand1());
     unsigned char n = GetOperand(I.Operand2());
     n = (n % 8);
@@ -176,7 +1020,8 @@ void R8Engine::Rol(const R8Instruction &I) {
     UpdateExecutionTime(OPERATION_TIME);
 }
 
-void R8Engine::Not(const R8Instruction &I) {
+template<class TObserver>
+void R8BasicEngine<TObserver>::Not(const R8Instruction &I) {
     unsigned char x = GetOperand(I.Operand1());
     SetResult(I.Result(), ~x);
     GoToNextInstruction();
@@ -184,7 +1029,8 @@ void R8Engine::Not(const R8Instruction &I) {
     UpdateExecutionTime(OPERATION_TIME);
 }
 
-void R8Engine::Or(const R8Instruction &I) {
+template<class TObserver>
+void R8BasicEngine<TObserver>::Or(const R8Instruction &I) {
     unsigned char x = GetOperand(I.Operand1());
     unsigned char y = GetOperand(I.Operand2());
     unsigned char r = (x | y);
@@ -194,7 +1040,8 @@ void R8Engine::Or(const R8Instruction &I) {
     UpdateExecutionTime(OPERATION_TIME);
 }
 
-void R8Engine::And(const R8Instruction &I) {
+template<class TObserver>
+void R8BasicEngine<TObserver>::And(const R8Instruction &I) {
     unsigned char x = GetOperand(I.Operand1());
     unsigned char y = GetOperand(I.Operand2());
     unsigned char r = (x & y);
@@ -204,7 +1051,8 @@ void R8Engine::And(const R8Instruction &I) {
     UpdateExecutionTime(OPERATION_TIME);
 }
 
-void R8Engine::Nor(const R8Instruction &I) {
+template<class TObserver>
+void R8BasicEngine<TObserver>::Nor(const R8Instruction &I) {
     unsigned char x = GetOperand(I.Operand1());
     unsigned char y = GetOperand(I.Operand2());
     unsigned char r = ~(x | y);
@@ -214,7 +1062,8 @@ void R8Engine::Nor(const R8Instruction &I) {
     UpdateExecutionTime(OPERATION_TIME);
 }
 
-void R8Engine::Nand(const R8Instruction &I) {
+template<class TObserver>
+void R8BasicEngine<TObserver>::Nand(const R8Instruction &I) {
     unsigned char x = GetOperand(I.Operand1());
     unsigned char y = GetOperand(I.Operand2());
     unsigned char r = ~(x & y);
@@ -224,7 +1073,8 @@ void R8Engine::Nand(const R8Instruction &I) {
     UpdateExecutionTime(OPERATION_TIME);
 }
 
-void R8Engine::Xor(const R8Instruction &I) {
+template<class TObserver>
+void R8BasicEngine<TObserver>::Xor(const R8Instruction &I) {
     unsigned char x = GetOperand(I.Operand1());
     unsigned char y = GetOperand(I.Operand2());
     unsigned char r = (x ^ y);
@@ -234,7 +1084,8 @@ void R8Engine::Xor(const R8Instruction &I) {
     UpdateExecutionTime(OPERATION_TIME);
 }
 
-void R8Engine::Add(const R8Instruction &I) {
+template<class TObserver>
+void R8BasicEngine<TObserver>::Add(const R8Instruction &I) {
     unsigned char x = GetOperand(I.Operand1());
     unsigned char y = GetOperand(I.Operand2());
     unsigned char r = x + y;
@@ -244,7 +1095,8 @@ void R8Engine::Add(const R8Instruction &I) {
     UpdateExecutionTime(OPERATION_TIME);
 }
 
-void R8Engine::Sub(const R8Instruction &I) {
+template<class TObserver>
+void R8BasicEngine<TObserver>::Sub(const R8Instruction &I) {
     unsigned char x = GetOperand(I.Operand1());
     unsigned char y = GetOperand(I.Operand2());
     unsigned char r = x + (~y) + 1;
@@ -254,7 +1106,8 @@ void R8Engine::Sub(const R8Instruction &I) {
     UpdateExecutionTime(OPERATION_TIME);
 }
 
-void R8Engine::Jz(const R8Instruction &I) {
+template<class TObserver>
+void R8BasicEngine<TObserver>::Jz(const R8Instruction &I) {
     unsigned char x = GetOperand(I.Operand1());
     if (x==0) {
         GoToInstruction( GetIP(I.Result()) );
@@ -266,7 +1119,8 @@ void R8Engine::Jz(const R8Instruction &I) {
     UpdateExecutionTime(OPERATION_TIME);
 }
 
-void R8Engine::Jo(const R8Instruction &I) {
+template<class TObserver>
+void R8BasicEngine<TObserver>::Jo(const R8Instruction &I) {
     unsigned char x = GetOperand(I.Operand1());
     if (x==0xFF) {
         GoToInstruction( GetIP(I.Result()) );
@@ -278,24 +1132,238 @@ void R8Engine::Jo(const R8Instruction &I) {
     UpdateExecutionTime(OPERATION_TIME);
 }
 
+// A word of R8Program:
+//   bits 0..3   opcode; WIDE_OPCODE if the operands do not fit in the word,
+//               then bits 4..31 are the index of the instruction in mWideWords
+//   bits 4..9   access types, mode1 + 4*(mode2 + 5*modeR): mode2 is SAME_OPERAND
+//               if operand 2 is operand 1 (the compiler copies it for commands
+//               with one source), modeR is the one of the result less REGISTER
+//   bits 10..31 values of operand 1, operand 2 and the result, of the ones the
+//               opcode has: 3 bits for REGISTER and MEMORY_BY_REGISTER, 8 bits
+//               for the others; the target of a jump takes the bits left
+// The operands an opcode has not are CONSTANT 0. Three 8-bit values do not fit,
+// nor does a far target or a constant result. A wide instruction stays wide
+// when it is set again, so mWideWords has no holes.
+bool R8Program::HasOperand(quint32 opcode, int operand) {
+    switch (opcode) {
+    case R8Instruction::HALT_OPCODE: return false;
+    case R8Instruction::IN_OPCODE:   return (operand == 2);
+    case R8Instruction::OUT_OPCODE:  return (operand == 0);
+    case R8Instruction::NOT_OPCODE:
+    case R8Instruction::JZ_OPCODE:
+    case R8Instruction::JO_OPCODE:   return (operand != 1);
+    default:                         return true;
+    }
+}
+
+static bool R8IsJumpOpcode(quint32 opcode) {
+    return (opcode == R8Instruction::JZ_OPCODE) || (opcode == R8Instruction::JO_OPCODE);
+}
+
+static int R8ValueBits(R8Reference::EAccessType accessType) {
+    return ((accessType == R8Reference::REGISTER) || (accessType == R8Reference::MEMORY_BY_REGISTER)) ? 3 : 8;
+}
+
+bool R8Program::Pack(R8Instruction instruction, quint32 *word) {
+    const quint32 opcode = instruction.Opcode();
+    if (opcode >= WIDE_OPCODE)
+        return false;
+
+    const R8Reference operands[3] = {instruction.Operand1(), instruction.Operand2(), instruction.Result()};
+    const bool isSame = (operands[1].AccessType() == operands[0].AccessType()) && (operands[1].Value() == operands[0].Value());
+
+    quint32 modes[3] = {0, isSame ? SAME_OPERAND : 0, 0};
+    quint32 packed = opcode;
+    int bit = FIRST_VALUE_BIT;
+    for (int i=0; i<3; ++i) {
+        const R8Reference& ref = operands[i];
+        if ((i == 1) && isSame)
+            continue;
+        if (!HasOperand(opcode, i)) {
+            if ((ref.AccessType() != R8Reference::CONSTANT) || (ref.Value() != 0))
+                return false;
+            continue;
+        }
+
+        int bits;
+        if (R8IsJumpOpcode(opcode) && (i == 2)) {
+            if (ref.AccessType() != R8Reference::INSTRUCTION_INDEX)
+                return false;
+            bits = 32 - bit;
+        } else {
+            if ((ref.AccessType() == R8Reference::INSTRUCTION_INDEX) || ((i == 2) && (ref.AccessType() == R8Reference::CONSTANT)))
+                return false;
+            modes[i] = (i == 2) ? (ref.AccessType() - R8Reference::REGISTER) : ref.AccessType();
+            bits = R8ValueBits(ref.AccessType());
+        }
+        if ((bit + bits > 32) || (((quint64)ref.Value() >> bits) != 0))
+            return false;
+        packed |= ref.Value() << bit;
+        bit += bits;
+    }
+    *word = packed | ((modes[0] + 4*(modes[1] + 5*modes[2])) << 4);
+    return true;
+}
+
+R8Instruction R8Program::Unpack(quint32 word) {
+    const quint32 opcode = word & WIDE_OPCODE;
+    const quint32 modes  = (word >> 4) & ((1u << (FIRST_VALUE_BIT - 4)) - 1);
+    const quint32 mode2  = (modes / 4) % 5;
+
+    R8Reference operands[3];
+    int bit = FIRST_VALUE_BIT;
+    for (int i=0; i<3; ++i) {
+        if ((i == 1) && (mode2 == SAME_OPERAND)) {
+            operands[1] = operands[0];
+            continue;
+        }
+        if (!HasOperand(opcode, i))
+            continue;
+
+        R8Reference::EAccessType accessType;
+        int bits;
+        if (R8IsJumpOpcode(opcode) && (i == 2)) {
+            accessType = R8Reference::INSTRUCTION_INDEX;
+            bits = 32 - bit;
+        } else {
+            const quint32 mode = (i == 0) ? (modes % 4) : (i == 1) ? mode2 : (R8Reference::REGISTER + modes / 20);
+            accessType = (R8Reference::EAccessType)mode;
+            bits = R8ValueBits(accessType);
+        }
+        const quint32 value = (bit + bits <= 32) ? ((word >> bit) & ((1u << bits) - 1)) : 0; //0 in a bad word
+        operands[i] = R8Reference(accessType, value);
+        bit += bits;
+    }
+    return R8Instruction((R8Instruction::EOpcode)opcode, operands[0], operands[1], operands[2]);
+}
+
+R8Instruction R8Program::UnpackWide(quint32 index) const {
+    const quint32 *wide = reinterpret_cast<const quint32*>(mWideWords.constData()) + index*WIDE_WORDS;
+    return R8Instruction((R8Instruction::EOpcode)(wide[0] & 0xFF),
+                         R8Reference((R8Reference::EAccessType)((wide[0] >> 8) & 0xFF), wide[1]),
+                         R8Reference((R8Reference::EAccessType)((wide[0] >> 16) & 0xFF), wide[2]),
+                         R8Reference((R8Reference::EAccessType)((wide[0] >> 24) & 0xFF), wide[3]));
+}
+
+void R8Program::SetWord(unsigned int index, const R8Instruction &instruction) {
+    quint32 *words = reinterpret_cast<quint32*>(mWords.data());
+    if ((words[index] & WIDE_OPCODE) != WIDE_OPCODE) {
+        quint32 word;
+        if (Pack(instruction, &word)) {
+            words[index] = word;
+            return;
+        }
+        const quint32 wideIndex = mWideWords.size() / (WIDE_WORDS*sizeof(quint32));
+        Q_ASSERT(wideIndex < (1u << 28));
+        mWideWords.resize(mWideWords.size() + WIDE_WORDS*sizeof(quint32));
+        words[index] = WIDE_OPCODE | (wideIndex << 4);
+    }
+
+    R8Instruction copy = instruction;
+    quint32 *wide = reinterpret_cast<quint32*>(mWideWords.data()) + (words[index] >> 4)*WIDE_WORDS;
+    wide[0] = (quint32)copy.Opcode() | ((quint32)copy.Operand1().AccessType() << 8)
+            | ((quint32)copy.Operand2().AccessType() << 16) | ((quint32)copy.Result().AccessType() << 24);
+    wide[1] = copy.Operand1().Value();
+    wide[2] = copy.Operand2().Value();
+    wide[3] = copy.Result().Value();
+}
+
 void R8Program::Clear() {
-    mInstructions.clear();
+    mWords.clear();
+    mWideWords.clear();
 }
 
 R8Instruction R8Program::Instruction(unsigned int Index) const {
-    if (Index < (unsigned int)mInstructions.size())
-        return mInstructions[Index];
+    if (Index < (unsigned int)Length()) {
+        const quint32 word = Word(Index);
+        return ((word & WIDE_OPCODE) == WIDE_OPCODE) ? UnpackWide(word >> 4) : Unpack(word);
+    }
     return R8Instruction(R8Instruction::HALT_OPCODE); //останов!
 }
 
-void R8Program::UpdateInstruction(unsigned int Index, const R8Instruction &Instruction) {
-    if (Index < (unsigned int)mInstructions.size()) {
-        mInstructions[Index] = Instruction;
+void R8Program::SetInstruction(unsigned int Index, const R8Instruction &Instruction) {
+    if (Index < (unsigned int)Length()) {
+        SetWord(Index, Instruction);
+    } else
+        throw R8Exception("Instruction index outside of program!");
+}
+
+void R8Program::SetInstructionResult(unsigned int Index, const R8Reference &Result) {
+    if (Index < (unsigned int)Length()) {
+        R8Instruction instruction = Instruction(Index);
+        instruction.SetResult(Result);
+        SetWord(Index, instruction);
     } else
         throw R8Exception("Instruction index outside of program!");
 }
 
 unsigned int R8Program::AddInstruction(const R8Instruction &instruction) {
-    mInstructions.append(instruction);
-    return (mInstructions.size() - 1);
+    const quint32 halt = R8Instruction::HALT_OPCODE;
+    mWords.append(reinterpret_cast<const char*>(&halt), sizeof(halt));
+    SetWord(Length() - 1, instruction);
+    return (Length() - 1);
 }
+
+// Every word has to be the one its instruction is packed to, and every wide
+// instruction has to be in the side table with a known opcode and access types
+bool R8Program::FromWords(const QByteArray &words, const QByteArray &wideWords, R8Program *program) {
+    const int wideSize = WIDE_WORDS*sizeof(quint32);
+    if ((words.size() % sizeof(quint32) != 0) || (wideWords.size() % wideSize != 0))
+        return false;
+
+    const quint32 *wide = reinterpret_cast<const quint32*>(wideWords.constData());
+    const quint32  wideCount = wideWords.size() / wideSize;
+    for (quint32 i=0; i<wideCount; ++i) {
+        const quint32 header = wide[i*WIDE_WORDS];
+        if (((header & 0xFF) > R8Instruction::JO_OPCODE) || (((header >> 8) & 0xFF) > R8Reference::INSTRUCTION_INDEX)
+                || (((header >> 16) & 0xFF) > R8Reference::INSTRUCTION_INDEX) || ((header >> 24) > R8Reference::INSTRUCTION_INDEX))
+            return false;
+    }
+
+    program->mWords     = words;
+    program->mWideWords = wideWords;
+    for (int i=0; i<program->Length(); ++i) {
+        const quint32 word = program->Word(i);
+        quint32 packed = 0;
+        const bool isValid = ((word & WIDE_OPCODE) == WIDE_OPCODE) ? ((word >> 4) < wideCount)
+                                                                   : (Pack(Unpack(word), &packed) && (packed == word));
+        if (!isValid) {
+            program->Clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+static const quint32 R8_STATE_MAGIC   = 0x52385354; //"R8ST"
+static const quint16 R8_STATE_VERSION = 1;
+
+QDataStream& operator<<(QDataStream &stream, const R8State &state) {
+    stream << R8_STATE_MAGIC << R8_STATE_VERSION << (quint32)state.IP << (quint32)state.Time;
+    stream.writeRawData(reinterpret_cast<const char*>(state.Registers), sizeof(state.Registers));
+    stream.writeRawData(reinterpret_cast<const char*>(state.Memory), sizeof(state.Memory));
+    return stream;
+}
+
+QDataStream& operator>>(QDataStream &stream, R8State &state) {
+    quint32 magic = 0;
+    quint16 version = 0;
+    stream >> magic >> version;
+    if ((magic != R8_STATE_MAGIC) || (version != R8_STATE_VERSION)) {
+        stream.setStatus(QDataStream::ReadCorruptData);
+        return stream;
+    }
+
+    quint32 ip = 0, time = 0;
+    stream >> ip >> time;
+    stream.readRawData(reinterpret_cast<char*>(state.Registers), sizeof(state.Registers));
+    stream.readRawData(reinterpret_cast<char*>(state.Memory), sizeof(state.Memory));
+    state.IP   = ip;
+    state.Time = time;
+    return stream;
+}
+
+//engines with any other observer policy have to be instantiated here too
+template class R8BasicEngine<R8SilentObserver>;
+template class R8BasicEngine<R8OutputRecorder>;
+template class R8BasicEngine<R8SignalObserver>;
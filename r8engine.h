@@ -1,10 +1,15 @@
 #ifndef R8ENGINE_H
 #define R8ENGINE_H
 
+#include <QAtomicInt>
+#include <QByteArray>
 #include <QObject>
+#include <QScopedPointer>
 #include <QString>
 #include <QVector>
 
+class QDataStream;
+
 class R8Exception {
 public:
     R8Exception(QString message) : mMessage(message) {}
@@ -26,6 +31,7 @@ public:
     R8Reference() : mAccessType(CONSTANT), mValue(0) {}
     R8Reference(const R8Reference& Copy) : mAccessType(Copy.mAccessType), mValue(Copy.mValue) {}
     R8Reference(EAccessType  AccessType, unsigned int Value) : mAccessType(AccessType),mValue(Value) {}
+    R8Reference& operator=(const R8Reference& Copy) {mAccessType = Copy.mAccessType; mValue = Copy.mValue; return *this;}
 
     EAccessType  AccessType() const {return mAccessType;}
     unsigned int Value() const {return mValue;}
@@ -80,49 +86,340 @@ private:
 };
 
 
+// Instructions packed in 32-bit words (see r8engine.cpp), the ones whose
+// operands do not fit in a word in a side table. The words are kept as bytes,
+// so a program may view the words of a mapped .r8o file without a copy.
 class R8Program {
 public:
+    static const int WIDE_WORDS = 4; //of a wide instruction in WideWords(): opcode and access types, then the values
+
     void Clear();
     R8Instruction Instruction(unsigned int Index) const;
-    int Length() const {return mInstructions.size();}
-    void UpdateInstruction(unsigned int Index, const R8Instruction& Instruction); //compiler need it...
+    int Length() const {return mWords.size() / (int)sizeof(quint32);}
+    void SetInstruction(unsigned int Index, const R8Instruction& Instruction);
+    void SetInstructionResult(unsigned int Index, const R8Reference& Result); //compiler patches jumps with it
     unsigned int AddInstruction(const R8Instruction& instruction);
+
+    // Words in host byte order, as Words() and WideWords() give them; a raw
+    // QByteArray must outlive the program and its copies. False if they are
+    // not the words of a program.
+    static bool FromWords(const QByteArray& words, const QByteArray& wideWords, R8Program *program);
+    const QByteArray& Words() const {return mWords;}
+    const QByteArray& WideWords() const {return mWideWords;}
+
 private:
-    QVector<R8Instruction> mInstructions;
+    friend class R8StaticAssembler; //packs words at C++ compile time
+
+    static const quint32 WIDE_OPCODE     = 0xF; //the rest of the word is the index of the instruction in mWideWords
+    static const quint32 SAME_OPERAND    = 4;   //access type of operand 2 in a word: it is operand 1
+    static const int     FIRST_VALUE_BIT = 10;
+
+    QByteArray mWords;
+    QByteArray mWideWords;
+
+    quint32 Word(unsigned int index) const {return reinterpret_cast<const quint32*>(mWords.constData())[index];}
+    void SetWord(unsigned int index, const R8Instruction& instruction);
+
+    static bool HasOperand(quint32 opcode, int operand); //0 - operand 1, 1 - operand 2, 2 - result
+    static bool Pack(R8Instruction instruction, quint32 *word);
+    static R8Instruction Unpack(quint32 word);
+    R8Instruction UnpackWide(quint32 index) const;
 };
 
 
+// Ports keep a span of values (see SetBuffer()): Input() and Output() take or
+// put a value inline while the span lasts and call the virtual DoXxx() only
+// when it is over, so "in" and "out" cost no virtual call per value.
 class R8InputPort {
 public:
-    unsigned char Input() {return DoInput();}
+    R8InputPort() : mIsFailure(false),mBufferNext(0),mBufferEnd(0) {}
+    unsigned char Input() {return (mBufferNext != mBufferEnd) ? *mBufferNext++ : DoInput();}
     virtual ~R8InputPort() {}
 
     bool IsFailure() const {return mIsFailure;}
     void SetFailure(bool value) {mIsFailure = value;}
+
+    // false if Input() has no value now: R8BasicEngine::Run() stops before
+    // such "in" instead of halting
+    bool HasInput() const {return (mBufferNext != mBufferEnd) || HasMoreInput();}
+protected:
+    // Values Input() returns before it calls DoInput() again; the port keeps them
+    void SetBuffer(const unsigned char *begin, const unsigned char *end) {mBufferNext = begin; mBufferEnd = end;}
+    const unsigned char *BufferNext() const {return mBufferNext;}
+
+    virtual unsigned char DoInput() {return 0;} //the buffer is over
+    virtual bool HasMoreInput() const {return true;}
+private:
+    bool                 mIsFailure;
+    const unsigned char *mBufferNext;
+    const unsigned char *mBufferEnd;
+};
+
+// Takes the outputs instead of R8BasicEngine's observer, see SetOutputPort()
+class R8OutputPort {
+public:
+    R8OutputPort() : mBufferNext(0),mBufferEnd(0) {}
+    void Output(unsigned char value) {if (mBufferNext != mBufferEnd) *mBufferNext++ = value; else DoOutput(value);}
+    virtual ~R8OutputPort() {}
+
+    // Hands the buffered outputs over; the engine does not call it
+    void Flush() {DoFlush();}
+protected:
+    void SetBuffer(unsigned char *begin, unsigned char *end) {mBufferNext = begin; mBufferEnd = end;}
+    unsigned char *BufferNext() const {return mBufferNext;}
+
+    virtual void DoOutput(unsigned char value) = 0; //the buffer is full
+    virtual void DoFlush() {}
+private:
+    unsigned char *mBufferNext;
+    unsigned char *mBufferEnd;
+};
+
+
+// Load-time form of an R8Instruction: operands are checked once by
+// R8BasicEngine::Decode(), so the interpreter loop accesses registers and memory
+// without any checks. Instructions that would throw are decoded to
+// INVALID_HANDLER and executed by the reference interpreter.
+//
+// Time is accounted per basic block: entering an instruction charges the cost
+// of the rest of its block (BlockCost) in advance, so only block ends add time.
+struct R8DecodedInstruction {
+    enum EHandler {
+        HALT_HANDLER,
+        IN_HANDLER,
+        OUT_HANDLER,
+        ALU_HANDLER, //ror..sub, through Function
+
+        JZ_CONSTANT_HANDLER, //+ R8Reference::EAccessType of the operand
+        JZ_REGISTER_HANDLER,
+        JZ_MEMORY_BY_CONSTANT_HANDLER,
+        JZ_MEMORY_BY_REGISTER_HANDLER,
+
+        JO_CONSTANT_HANDLER,
+        JO_REGISTER_HANDLER,
+        JO_MEMORY_BY_CONSTANT_HANDLER,
+        JO_MEMORY_BY_REGISTER_HANDLER,
+
+        GOTO_HANDLER, //jz 0,lbl and jo 0xFF,lbl
+
+        INVALID_HANDLER,
+
+        // superinstructions (FusedHandler only): ALU instructions followed by
+        // a jump on a register or an unconditional one
+        ALU_JZ_HANDLER,
+        ALU_JO_HANDLER,
+        ALU_GOTO_HANDLER,
+        ALU_ALU_JZ_HANDLER,
+        ALU_ALU_JO_HANDLER,
+
+        BREAKPOINT_HANDLER, //FusedHandler only: Run() stops here, Execute() runs Handler
+
+        HANDLERS_COUNT
+    };
+
+    const void    *Address;  //handler label (direct threading), bound by R8BasicEngine::Interpret()
+    void         (*Function)(); //ALU_HANDLER: R8BasicEngine<>::TAluHandler specialized by operand modes
+    unsigned int   Target;   //jump target
+    unsigned int   Cost;     //execution time, without JUMP_TIME of a taken jump
+    unsigned int   BlockCost; //Cost of this instruction and the rest of its basic block
+    unsigned int   FallCost;  //charged on going to the next instruction: 0 inside a block
+    unsigned int   JumpCost;  //charged on a taken jump: JUMP_TIME + BlockCost of the target
+    unsigned char  Handler;  //EHandler of this instruction alone
+    unsigned char  FusedHandler; //EHandler of the superinstruction starting here, BREAKPOINT_HANDLER, or Handler
+    unsigned char  Opcode;   //R8Instruction::EOpcode
+    unsigned char  Mode1;    //R8Reference::EAccessType of operands
+    unsigned char  Mode2;
+    unsigned char  ModeR;
+    unsigned char  Value1;
+    unsigned char  Value2;
+    unsigned char  ValueR;
+};
+
+
+// ALU operations of the specialized handlers (R8BasicEngine, R8VectorEngine)
+struct R8RorOperation  {static unsigned char Apply(unsigned char x, unsigned char y) {y = (y % 8); return (x >> y) | (x << (8-y));}};
+struct R8RolOperation  {static unsigned char Apply(unsigned char x, unsigned char y) {y = (y % 8); return (x << y) | (x >> (8-y));}};
+struct R8NotOperation  {static unsigned char Apply(unsigned char x, unsigned char)   {return ~x;}};
+struct R8OrOperation   {static unsigned char Apply(unsigned char x, unsigned char y) {return (x | y);}};
+struct R8AndOperation  {static unsigned char Apply(unsigned char x, unsigned char y) {return (x & y);}};
+struct R8NorOperation  {static unsigned char Apply(unsigned char x, unsigned char y) {return ~(x | y);}};
+struct R8NandOperation {static unsigned char Apply(unsigned char x, unsigned char y) {return ~(x & y);}};
+struct R8XorOperation  {static unsigned char Apply(unsigned char x, unsigned char y) {return (x ^ y);}};
+struct R8AddOperation  {static unsigned char Apply(unsigned char x, unsigned char y) {return x + y;}};
+struct R8SubOperation  {static unsigned char Apply(unsigned char x, unsigned char y) {return x + (~y) + 1;}};
+
+
+// Registers, memory, IP and time of R8BasicEngine. A plain struct, so a
+// snapshot is a single copy; written to .r8state files by the operators below.
+struct R8State {
+    static const unsigned int REGISTERS_COUNT = 8;
+    static const unsigned int MEMORY_SIZE     = 256;
+
+    unsigned char Registers[REGISTERS_COUNT];
+    unsigned char Memory[MEMORY_SIZE];
+    unsigned int  IP;
+    unsigned int  Time;
+};
+
+QDataStream& operator<<(QDataStream& stream, const R8State& state);
+QDataStream& operator>>(QDataStream& stream, R8State& state); //ReadCorruptData if it is not a state
+
+
+// Observer policies of R8BasicEngine. The engine derives from its policy and
+// calls NotifyXxx() at every state change, so a policy with empty inline
+// notifications costs nothing in the interpreter loop.
+
+class R8SilentObserver {
+protected:
+    void NotifyReset() {}
+    void NotifyRestore() {}
+    void NotifyHalt() {}
+    void NotifyOutput(unsigned char) {}
+    void NotifyWriteRegister(unsigned int) {}
+    void NotifyWriteMemory(unsigned int) {}
+};
+
+class R8OutputRecorder {
+public:
+    const QVector<unsigned char>& Outputs() const {return mOutputs;}
+    void ClearOutputs() {mOutputs.clear();}
+
 protected:
-    virtual unsigned char DoInput() {return 0;}
+    void NotifyReset() {mOutputs.clear();}
+    void NotifyRestore() {} //outputs are not a part of the state
+    void NotifyHalt() {}
+    void NotifyOutput(unsigned char value) {mOutputs.append(value);}
+    void NotifyWriteRegister(unsigned int) {}
+    void NotifyWriteMemory(unsigned int) {}
+
 private:
-    bool mIsFailure;
+    QVector<unsigned char> mOutputs;
 };
 
+// Registers and memory cells written since the view took them. The engine sets
+// the bits and the view takes them, possibly on another thread, without locks;
+// a write after Take...() sets its bit again, so the view reads the values
+// after it takes the bits.
+class R8DirtyBits {
+public:
+    static const int MEMORY_WORDS_COUNT = R8State::MEMORY_SIZE / 32;
+
+    void SetRegister(unsigned int index) {Set(mRegisters, index);}
+    void SetMemoryCell(unsigned int index) {Set(mMemoryCells[index / 32], index % 32);}
 
-class R8Engine : public QObject {
+    unsigned int TakeRegisters() {return (unsigned int)mRegisters.fetchAndStoreAcquire(0);}
+    unsigned int TakeMemoryCells(int word) {return (unsigned int)mMemoryCells[word].fetchAndStoreAcquire(0);} //cells 32*word + bit
+
+private:
+    QAtomicInt mRegisters;
+    QAtomicInt mMemoryCells[MEMORY_WORDS_COUNT];
+
+    static void Set(QAtomicInt& bits, unsigned int bit) {
+        const int mask = (int)(1u << bit);
+        if ((bits.load() & mask) == 0) //loops write the same cells again and again
+            bits.fetchAndOrRelaxed(mask);
+    }
+};
+
+// Resets and halts are Qt signals; writes only set dirty bits, so the view
+// shows them at its own pace instead of a signal per instruction.
+class R8SignalObserver : public QObject {
     Q_OBJECT
 
 public:
-    R8Engine();
+    R8DirtyBits& DirtyBits() {return mDirtyBits;}
 
-    static const unsigned int REGISTERS_COUNT = 8;
-    static const unsigned int MEMORY_SIZE = (1 << REGISTERS_COUNT);
+protected:
+    void NotifyReset() {emit SignalReset();}
+    void NotifyRestore() {emit SignalReset();} //everything may have changed
+    void NotifyHalt() {emit SignalHalt();}
+    void NotifyOutput(unsigned char value) {emit SignalOutput(value);}
+    void NotifyWriteRegister(unsigned int index) {mDirtyBits.SetRegister(index);}
+    void NotifyWriteMemory(unsigned int index) {mDirtyBits.SetMemoryCell(index);}
 
+signals:
+    void SignalReset();
+    void SignalHalt();
+    void SignalOutput(unsigned char value);
+
+private:
+    R8DirtyBits mDirtyBits;
+};
+
+
+class R8JitCode;
+
+// Instantiated in r8engine.cpp for the observers above only.
+template<class TObserver>
+class R8BasicEngine : public TObserver {
+public:
+    R8BasicEngine();
+    ~R8BasicEngine();
+
+    static const unsigned int REGISTERS_COUNT = R8State::REGISTERS_COUNT;
+    static const unsigned int MEMORY_SIZE = R8State::MEMORY_SIZE;
+
+    enum ERunStatus {
+        HALTED_STATUS,
+        STEPS_EXCEEDED_STATUS,
+        TIME_EXCEEDED_STATUS,
+        INPUT_NEEDED_STATUS, //stopped before "in", see R8InputPort::HasInput()
+        BREAKPOINT_STATUS    //stopped before a breakpoint
+    };
+
+    // Zeroes only the memory cells written since the previous reset (see
+    // TouchMemory()), so resets between short runs cost next to nothing.
     void Reset();
-    void SetProgram(const R8Program& program) {mProgram = program; Reset();}
+    void Snapshot(R8State *state) const;
+    void Restore(const R8State& state);
+    void SetProgram(const R8Program& program);
     void SetInputPort(R8InputPort *port) {mInputPort = port;}
-    void Step();
+    void SetOutputPort(R8OutputPort *port) {mOutputPort = port;} //0 - outputs go to NotifyOutput()
+    void Step() {Execute(1);}
+
+    // Executes up to count instructions exactly as count Step() calls would,
+    // but stops once the engine has halted. Returns the number executed (the
+    // halt at the end of the program is none).
+    unsigned int Execute(unsigned int count);
+
+    // Runs until the program halts, maxSteps instructions are executed, the
+    // time grows by maxTime clocks or more (0 - no limit), or it comes to an
+    // "in" without input or to a breakpoint other than the IP it started at.
+    // Calls of Run() for the whole program take the same steps as Execute().
+    ERunStatus Run(unsigned long maxSteps, unsigned long maxTime = 0, unsigned long *steps = 0);
+
+    // Breakpoints of the current program, cleared by SetProgram()
+    void SetBreakpoint(unsigned int ip, bool isSet);
+    void SetBreakpoints(const QVector<bool>& breakpoints); //by ip, all at once
+    void ClearBreakpoints();
+    bool IsBreakpoint(unsigned int ip) const {return (ip < (unsigned int)mBreakpoints.size()) && mBreakpoints[ip];}
+
+    // Execute() runs native code where the host supports it (see R8JitCode).
+    // Register and memory writes of native code are not notified, so it is
+    // meant for batch observers.
+    void SetJitEnabled(bool isEnabled);
+    bool IsJitEnabled() const {return mIsJitEnabled;}
+    bool IsJitActive() const {return !mJit.isNull();}
+
+    // Execute() throws "Infinite loop detected" once the state (registers,
+    // memory, IP) after a jump repeats with no "in" between: the program would
+    // loop forever. Brent's algorithm over the states after jumps finds such
+    // a loop within about two of its lengths. Runs without native code.
+    void SetLoopDetectionEnabled(bool isEnabled) {mIsLoopDetectionEnabled = isEnabled; mLoopPower = 0;}
+    bool IsLoopDetectionEnabled() const {return mIsLoopDetectionEnabled;}
+
+    // The original switch interpreter over R8Program; Execute() must match it.
+    void ReferenceStep();
+
+    // mProgram + HALT at Length(), for other executors of the same program
+    const QVector<R8DecodedInstruction>& DecodedProgram() const {return mDecoded;}
 
     unsigned int IP() const {return mIP;}
     unsigned int ExecutionTime() const {return mExecutionTime;}
+    bool IsHalted() const {return (mIP >= (unsigned int)mProgram.Length());}
 
+    // The setters are for the debugger; a state they set is not a step of the
+    // program, so loop detection starts over
     unsigned char Register(unsigned int index);
     void SetRegister(unsigned int index, unsigned char value);
 
@@ -137,23 +434,88 @@ private:
     static const unsigned int CONSTANT_ACCESS_TIME  = 0;
     static const unsigned int OPERATION_TIME        = 1;
     static const unsigned int JUMP_TIME             = 8;
+    static const unsigned int MAX_INSTRUCTION_TIME  = OPERATION_TIME + 3*(REGISTER_ACCESS_TIME + MEMORY_ACCESS_TIME) + JUMP_TIME;
 
     unsigned char mRegisters[REGISTERS_COUNT];
     unsigned char mMemoryCells[MEMORY_SIZE];
     R8Program     mProgram;
     R8InputPort  *mInputPort;
+    R8OutputPort *mOutputPort;
+
+    QVector<R8DecodedInstruction> mDecoded; //mProgram + HALT at index Length()
+    bool                          mIsBound; //are handler addresses of mDecoded set?
+
+    bool                          mIsJitEnabled;
+    QScopedPointer<R8JitCode>     mJit;     //null if not enabled or not supported
 
     unsigned int  mIP;
 
     unsigned int  mExecutionTime;
 
+    // Memory cells written since Reset() are listed in mTouchedCells once:
+    // a cell is listed if its generation is mGeneration, so Reset() starts
+    // a new list by incrementing mGeneration.
+    unsigned int  mGeneration;
+    unsigned int  mCellGenerations[MEMORY_SIZE];
+    unsigned char mTouchedCells[MEMORY_SIZE];
+    unsigned int  mTouchedCount;
+    bool          mIsMemoryDirty; //any cell may be nonzero: after Restore() and native code
+
+    void TouchMemory(unsigned int index);
+
+    QVector<bool> mBreakpoints;     //by ip, patched into mDecoded by Fuse()
+    int           mBreakpointsCount;
+    bool          mIsRunning;       //in Run(): stop at breakpoints and at "in" without input
+
+    bool          mIsLoopDetectionEnabled;
+    R8State       mLoopState;  //saved state of Brent's algorithm
+    unsigned long mLoopPower;  //0 - no state is saved
+    unsigned long mLoopLength; //states after mLoopState
+    QVector<unsigned int> mRunLengths; //by ip: instructions up to and including the next jump, "in" or halt
+
+    unsigned int ExecuteDetectingLoops(unsigned int count, bool *isHalted);
+    void CheckLoop();
+
     unsigned char GetOperand(const R8Reference& ref);
     void SetResult(const R8Reference& ref, unsigned char result);
+    void WriteRegister(unsigned int index, unsigned char value);
+    void WriteMemoryCell(unsigned int index, unsigned char value);
     unsigned int GetIP(const R8Reference& ref);
     void GoToNextInstruction();
     void GoToInstruction(unsigned int index);
     void GotoInHaltState();
 
+    void Decode();
+    void SumBlockCosts();
+    void Fuse();
+    void CompileNative();
+
+    unsigned int Interpret(unsigned int count, bool *isHalted);
+    unsigned int RunSteps(unsigned int count, bool *isHalted);
+    unsigned int ExecuteNative(unsigned int count, bool *isHalted);
+    bool DecodeOperand(const R8Reference& ref, unsigned char *mode, unsigned char *value, unsigned int *cost) const;
+    bool DecodeResult(const R8Reference& ref, unsigned char *mode, unsigned char *value, unsigned int *cost) const;
+
+    unsigned char ReadOperand(unsigned char mode, unsigned char value) const;
+    void WriteResult(unsigned char mode, unsigned char value, unsigned char result);
+
+    // ALU instructions run through handlers specialized by the operation and
+    // the modes of all operands; the time is charged by the interpreter loop.
+    typedef void (*TAluHandler)(R8BasicEngine& engine, const R8DecodedInstruction& d);
+
+    template<int MODE> unsigned char Read(unsigned char value) const;
+    template<int MODE> void Write(unsigned char value, unsigned char result);
+
+    template<class TOperation, int MODE1, int MODE2, int MODE_R>
+    static void Alu(R8BasicEngine& engine, const R8DecodedInstruction& d);
+
+    template<class TOperation, int MODE1, int MODE2>
+    static TAluHandler SelectAluByResult(unsigned char modeR);
+    template<class TOperation, int MODE1>
+    static TAluHandler SelectAluByOperand2(unsigned char mode2, unsigned char modeR);
+    template<class TOperation>
+    static TAluHandler SelectAlu(unsigned char mode1, unsigned char mode2, unsigned char modeR);
+
     void In(const R8Instruction& I);
     void Out(const R8Instruction& I);
     void Ror(const R8Instruction& I);
@@ -170,13 +532,10 @@ private:
     void Jo(const R8Instruction& I);
 
     void UpdateExecutionTime(unsigned int time) {mExecutionTime += time;}
-signals:
-    void SignalReset();
-    void SignalHalt();
-    void SignalOutput(unsigned char value);
-    void SignalWriteRegister(unsigned int index);
-    void SignalWriteMemory(unsigned int index);
 };
 
+typedef R8BasicEngine<R8SignalObserver> R8Engine;      //GUI: resets and halts are Qt signals, writes are dirty bits
+typedef R8BasicEngine<R8OutputRecorder> R8BatchEngine; //batch runs: only outputs are kept
+
 
 #endif // R8ENGINE_H
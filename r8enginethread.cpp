@@ -0,0 +1,33 @@
+#include "r8enginethread.h"
+
+R8EngineThread::R8EngineThread(R8Engine *engine, R8OutputPort *outputPort, QObject *parent) :
+    QThread(parent),mEngine(engine),mOutputPort(outputPort),mStatus(R8Engine::HALTED_STATUS) {}
+
+void R8EngineThread::Start() {
+    mIsStopRequested.store(0);
+    start();
+}
+
+void R8EngineThread::Stop() {
+    mIsStopRequested.store(1);
+    wait();
+}
+
+void R8EngineThread::run() {
+    mErrorMessage.clear();
+    try {
+        mStatus = mEngine->Run(RUN_SLICE_STEPS);
+        mOutputPort->Flush();
+        while ((mStatus == R8Engine::STEPS_EXCEEDED_STATUS) && (mIsStopRequested.load() == 0)) {
+            if (mEngine->IsBreakpoint(mEngine->IP())) { //Run() steps over the one it starts at
+                mStatus = R8Engine::BREAKPOINT_STATUS;
+                break;
+            }
+            mStatus = mEngine->Run(RUN_SLICE_STEPS);
+            mOutputPort->Flush();
+        }
+    } catch (R8Exception& ex) {
+        mOutputPort->Flush();
+        mErrorMessage = ex.Message();
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef R8ENGINETHREAD_H
+#define R8ENGINETHREAD_H
+
+#include <QAtomicInt>
+#include <QThread>
+
+#include "r8engine.h"
+
+// Runs the engine on its own thread, RUN_SLICE_STEPS instructions at a time,
+// until Run() stops for another reason or Stop() is called. Meanwhile the
+// window must not change the engine; it only shows its dirty registers and
+// memory cells and the outputs flushed to the port after every slice.
+class R8EngineThread : public QThread {
+public:
+    R8EngineThread(R8Engine *engine, R8OutputPort *outputPort, QObject *parent = 0);
+
+    void Start();
+    void Stop(); //waits for the current slice
+
+    // When the thread is finished
+    R8Engine::ERunStatus Status() const {return mStatus;}
+    const QString& ErrorMessage() const {return mErrorMessage;} //empty if Run() did not throw
+
+protected:
+    virtual void run();
+
+private:
+    static const unsigned long RUN_SLICE_STEPS = 4096;
+
+    R8Engine             *mEngine;
+    R8OutputPort         *mOutputPort;
+    QAtomicInt            mIsStopRequested;
+    R8Engine::ERunStatus  mStatus;
+    QString               mErrorMessage;
+};
+
+#endif // R8ENGINETHREAD_H
@@ -0,0 +1,280 @@
+#include "r8grader.h"
+
+#include <QFile>
+#include <QMutex>
+#include <QThread>
+#include <QtAlgorithms>
+
+// Jobs [0, count) split into a range per worker: a worker takes jobs from the
+// front of its own range and, when it is over, steals the back half of the
+// largest range left. So neighbouring jobs (the tests of one submission) mostly
+// stay on one worker and its engine keeps the program decoded.
+class R8JobRanges {
+public:
+    R8JobRanges(int jobsCount, int workersCount);
+    ~R8JobRanges() {qDeleteAll(mRanges);}
+
+    bool Take(int worker, int *job);
+
+private:
+    struct TRange {
+        QMutex Mutex;
+        int    Begin;
+        int    End;
+    };
+
+    QVector<TRange*> mRanges;
+
+    bool Steal(int worker); //false when all ranges are empty
+
+    Q_DISABLE_COPY(R8JobRanges)
+};
+
+R8JobRanges::R8JobRanges(int jobsCount, int workersCount) {
+    for (int i=0; i<workersCount; ++i) {
+        TRange *range = new TRange();
+        range->Begin = (int)((qint64)jobsCount * i / workersCount);
+        range->End   = (int)((qint64)jobsCount * (i + 1) / workersCount);
+        mRanges.append(range);
+    }
+}
+
+bool R8JobRanges::Take(int worker, int *job) {
+    do {
+        TRange *range = mRanges[worker];
+        QMutexLocker locker(&range->Mutex);
+        if (range->Begin < range->End) {
+            *job = range->Begin++;
+            return true;
+        }
+    } while (Steal(worker));
+    return false;
+}
+
+bool R8JobRanges::Steal(int worker) {
+    int victim = -1;
+    int mostJobs = 0;
+    for (int i=0; i<mRanges.size(); ++i) {
+        QMutexLocker locker(&mRanges[i]->Mutex);
+        if ((i != worker) && (mRanges[i]->End - mRanges[i]->Begin > mostJobs)) {
+            victim = i;
+            mostJobs = mRanges[i]->End - mRanges[i]->Begin;
+        }
+    }
+    if (victim < 0)
+        return false;
+
+    int begin, end;
+    {
+        TRange *range = mRanges[victim];
+        QMutexLocker locker(&range->Mutex);
+        end   = range->End;
+        begin = end - (range->End - range->Begin + 1) / 2;
+        range->End = begin;
+    }
+
+    TRange *range = mRanges[worker];
+    QMutexLocker locker(&range->Mutex);
+    range->Begin = begin;
+    range->End   = end;
+    return true; //the victim may have been emptied meanwhile, so try again
+}
+
+
+class R8GraderThread : public QThread {
+public:
+    R8GraderThread(R8Grader *grader, R8Grader::EPhase phase, R8JobRanges *jobs, int index, R8TestResult *results) :
+        mGrader(grader),mPhase(phase),mJobs(jobs),mIndex(index),mResults(results) {}
+
+protected:
+    virtual void run();
+
+private:
+    R8Grader         *mGrader;
+    R8Grader::EPhase  mPhase;
+    R8JobRanges      *mJobs;
+    int               mIndex;
+    R8TestResult     *mResults; //TEST_PHASE: by job
+};
+
+void R8GraderThread::run() {
+    R8BatchEngine   engine;
+    R8BufferInputPort port;
+    engine.SetInputPort(&port);
+    engine.SetLoopDetectionEnabled(mGrader->mIsLoopDetectionEnabled);
+
+    int loadedSubmission = -1;
+    int job;
+    while (mJobs->Take(mIndex, &job)) {
+        if (mPhase == R8Grader::COMPILE_PHASE) {
+            mGrader->Compile(mGrader->mSubmissions.data()[job]); //distinct items, detached by Run()
+            continue;
+        }
+
+        const R8Grader& grader = *mGrader; //read only: const operator[] never detaches the shared vectors
+        const int submission = grader.mTestJobs[job].first;
+        if (submission != loadedSubmission) {
+            engine.SetProgram(grader.mSubmissions[submission].Program);
+            loadedSubmission = submission;
+        }
+        const R8Submission& loaded = grader.mSubmissions[submission];
+        mResults[job] = R8Grader::RunTest(engine, port, grader.mSuites[loaded.Suite].Test(grader.mTestJobs[job].second), grader.mMaxSteps, grader.mMaxTime);
+    }
+}
+
+
+R8Grader::R8Grader() : mMaxSteps(0), mMaxTime(0), mThreadsCount(0), mIsLoopDetectionEnabled(false), mCompileCache(0) {}
+
+int R8Grader::AddSuite(const R8TestSuite &suite) {
+    mSuites.append(suite);
+    return mSuites.size() - 1;
+}
+
+void R8Grader::AddSubmission(const QString &path, int variant, int suite) {
+    R8Submission submission;
+    submission.Path    = path;
+    submission.Variant = variant;
+    submission.Suite   = suite;
+    mSubmissions.append(submission);
+}
+
+void R8Grader::Run() {
+    mSubmissions.detach(); //workers write to its items
+    RunPhase(COMPILE_PHASE, mSubmissions.size());
+
+    mTestJobs.clear();
+    for (int i=0; i<mSubmissions.size(); ++i) {
+        if (!mSubmissions[i].CompileError.isEmpty())
+            continue;
+        for (int test=0; test<mSuites[mSubmissions[i].Suite].Count(); ++test)
+            mTestJobs.append(qMakePair(i, test));
+    }
+
+    QVector<R8TestResult> results(mTestJobs.size());
+    RunPhase(TEST_PHASE, mTestJobs.size(), results.data());
+
+    for (int job=0; job<mTestJobs.size(); ++job)
+        mSubmissions[mTestJobs[job].first].Results.append(results[job]);
+}
+
+void R8Grader::RunPhase(EPhase phase, int jobsCount, R8TestResult *results) {
+    int threadsCount = (mThreadsCount > 0) ? mThreadsCount : QThread::idealThreadCount();
+    threadsCount = qMin(qMax(threadsCount, 1), jobsCount);
+    if (threadsCount == 0)
+        return;
+
+    R8JobRanges jobs(jobsCount, threadsCount);
+    QVector<R8GraderThread*> threads;
+    for (int i=0; i<threadsCount; ++i)
+        threads.append(new R8GraderThread(this, phase, &jobs, i, results));
+
+    for (int i=0; i<threads.size(); ++i)
+        threads[i]->start();
+    for (int i=0; i<threads.size(); ++i)
+        threads[i]->wait();
+    qDeleteAll(threads);
+}
+
+void R8Grader::Compile(R8Submission &submission) {
+    QFile file(submission.Path);
+    if (!file.open(QFile::ReadOnly | QFile::Text)) {
+        submission.CompileError = QString("can not open file");
+        return;
+    }
+    const QString source = QString::fromUtf8(file.readAll());
+
+    R8CompileKey key;
+    const bool isCached = (mCompileCache != 0) && R8CompileCache::Key(source, submission.Variant, &key);
+
+    R8CompileResult result;
+    if (!isCached || !mCompileCache->Find(key, &result)) {
+        const bool isLinked = CompileSource(submission.Path, source, submission.Variant, &result);
+        if (isCached && !isLinked) //the key is of this source only, not of the modules
+            mCompileCache->Insert(key, result);
+    }
+
+    submission.Program      = result.Program;
+    submission.SourceLines  = result.SourceLines;
+    submission.CompileError = result.Error;
+}
+
+// True if the source includes modules, so the result depends on their files too
+bool R8Grader::CompileSource(const QString &path, const QString &source, int variant, R8CompileResult *result) {
+    R8Module main;
+    try {
+        R8ModuleLibrary::Compile(path, source, variant, &main);
+
+        R8Linker linker;
+        linker.Link(main, &mLibrary, variant);
+        result->Program     = linker.LinkedCode();
+        result->SourceLines = linker.SourceLines();
+    } catch (const R8LinkerException& ex) {
+        result->Error = QString("line %1: %2").arg(ex.LineNumber() + 1).arg(ex.Description());
+        if (ex.Path() != path)
+            result->Error.prepend(ex.Path() + " ");
+    }
+    return !main.Includes.isEmpty();
+}
+
+// Why the outputs [from, size) differ from the expected ones, empty if they do not
+QString R8Grader::CheckOutputs(const QVector<unsigned char> &outputs, const QVector<unsigned char> &expected, int from) {
+    for (int i=from; i<outputs.size(); ++i) {
+        if (i >= expected.size())
+            return QString("out %1: %2 is not expected").arg(i + 1).arg(outputs[i]);
+        if (outputs[i] != expected[i])
+            return QString("out %1: %2 instead of %3").arg(i + 1).arg(outputs[i]).arg(expected[i]);
+    }
+    return QString();
+}
+
+R8TestResult R8Grader::RunTest(R8BatchEngine &engine, R8BufferInputPort &port, const R8TestCase &test, unsigned long maxSteps, unsigned long maxTime) {
+    port.SetSpan(test.Inputs.constData(), test.Inputs.size());
+    engine.Reset();
+
+    R8TestResult result;
+    result.IsPassed = false;
+    try {
+        int checkedOutputs = 0;
+        unsigned long steps = 0;
+        for (;;) {
+            unsigned long count = CHECK_STEPS;
+            if (maxSteps != 0)
+                count = qMin(maxSteps - steps, count);
+
+            const unsigned long timeLeft = (maxTime == 0) ? 0 : (maxTime - engine.ExecutionTime()); //not 0, see below
+
+            unsigned long executed;
+            const R8BatchEngine::ERunStatus status = engine.Run(count, timeLeft, &executed);
+            steps += executed;
+
+            result.Message = CheckOutputs(engine.Outputs(), test.Outputs, checkedOutputs);
+            if (!result.Message.isEmpty())
+                break;
+            checkedOutputs = engine.Outputs().size();
+
+            if (status == R8BatchEngine::HALTED_STATUS) {
+                break;
+            } else if (status == R8BatchEngine::INPUT_NEEDED_STATUS) {
+                result.Message = QString("no more input values");
+                break;
+            } else if (status == R8BatchEngine::TIME_EXCEEDED_STATUS) {
+                result.Message = QString("stopped after %1 clocks").arg(maxTime);
+                break;
+            } else if ((maxSteps != 0) && (steps == maxSteps)) {
+                result.Message = QString("stopped after %1 steps").arg(maxSteps);
+                break;
+            }
+        }
+    } catch (const R8Exception& ex) {
+        result.Message = QString("execution error: \"%1\"").arg(ex.Message());
+    }
+
+    if (result.Message.isEmpty()) {
+        if (engine.Outputs().size() != test.Outputs.size())
+            result.Message = QString("%1 outs instead of %2").arg(engine.Outputs().size()).arg(test.Outputs.size());
+        else
+            result.IsPassed = true;
+    }
+    result.Time = engine.ExecutionTime();
+    return result;
+}
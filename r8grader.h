@@ -0,0 +1,83 @@
+#ifndef R8GRADER_H
+#define R8GRADER_H
+
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+#include "r8compilecache.h"
+#include "r8engine.h"
+#include "r8linker.h"
+#include "r8ports.h"
+#include "r8testsuite.h"
+
+struct R8TestResult {
+    bool         IsPassed;
+    unsigned int Time;
+    QString      Message; //why the test failed
+};
+
+struct R8Submission {
+    QString               Path;
+    int                   Variant;
+    int                   Suite;        //index in R8Grader
+    QString               CompileError; //empty when compiled
+    R8Program             Program;
+    QVector<int>          SourceLines;  // f: opcode_index -> source_line
+    QVector<R8TestResult> Results;      //by test of the suite
+};
+
+// Grades many submissions on their test suites on all cores. Every submission
+// is compiled once (or found in the compile cache) and linked with the modules
+// it includes, which are compiled once for all; then every (submission, test) pair is a job of a
+// work-stealing pool, and every worker reuses one engine for its jobs.
+class R8Grader {
+public:
+    R8Grader();
+
+    void SetMaxSteps(unsigned long maxSteps) {mMaxSteps = maxSteps;} //per test, 0 - no limit
+    void SetMaxTime(unsigned long maxTime) {mMaxTime = maxTime;}     //clocks per test, 0 - no limit
+    void SetThreadsCount(int count) {mThreadsCount = count;}
+    void SetLoopDetectionEnabled(bool isEnabled) {mIsLoopDetectionEnabled = isEnabled;} //see R8BasicEngine
+    void SetCompileCache(R8CompileCache *cache) {mCompileCache = cache;}               //0 - every submission is compiled
+
+    int  AddSuite(const R8TestSuite& suite); //returns its index
+    void AddSubmission(const QString& path, int variant, int suite);
+
+    void Run();
+
+    int SubmissionsCount() const {return mSubmissions.size();}
+    const R8Submission& Submission(int index) const {return mSubmissions[index];}
+    const R8TestSuite& Suite(int index) const {return mSuites[index];}
+
+    // Runs the program set to the engine on one test from its initial state;
+    // the run stops soon after the first "out" that differs from the test.
+    static R8TestResult RunTest(R8BatchEngine& engine, R8BufferInputPort& port, const R8TestCase& test, unsigned long maxSteps, unsigned long maxTime);
+
+private:
+    friend class R8GraderThread;
+
+    static const unsigned int CHECK_STEPS = 4096; //steps between checks of the outputs
+
+    enum EPhase {
+        COMPILE_PHASE, //a job is a submission
+        TEST_PHASE     //a job is mTestJobs[job]
+    };
+
+    unsigned long              mMaxSteps;
+    unsigned long              mMaxTime;
+    int                        mThreadsCount;
+    bool                       mIsLoopDetectionEnabled;
+    R8CompileCache            *mCompileCache;
+    R8ModuleLibrary            mLibrary;   //the modules included by the submissions
+    QVector<R8TestSuite>       mSuites;
+    QVector<R8Submission>      mSubmissions;
+    QVector<QPair<int, int> >  mTestJobs;  //(submission, test), grouped by submission
+
+    void RunPhase(EPhase phase, int jobsCount, R8TestResult *results = 0);
+    void Compile(R8Submission& submission);
+    bool CompileSource(const QString& path, const QString& source, int variant, R8CompileResult *result);
+    static QString CheckOutputs(const QVector<unsigned char>& outputs, const QVector<unsigned char>& expected, int from);
+};
+
+#endif // R8GRADER_H
@@ -51,6 +51,17 @@ void R8InputDialog::InitLexer() {
 
 R8UiInputPort::R8UiInputPort() {
     mInputDialog = new R8InputDialog();
+    Rewind();
+}
+
+void R8UiInputPort::SetTape(const QVector<unsigned char> &values) {
+    mTape = values;
+    Rewind();
+}
+
+void R8UiInputPort::Rewind() {
+    SetBuffer(mTape.constData(), mTape.constData() + mTape.size());
+    SetFailure(false);
 }
 
 unsigned char R8UiInputPort::DoInput() {
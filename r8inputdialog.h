@@ -2,6 +2,7 @@
 #define R8INPUTDIALOG_H
 
 #include <QDialog>
+#include <QVector>
 
 #include "r8engine.h"
 #include "r8lexer.h"
@@ -34,14 +35,22 @@ private:
     void InitLexer();
 };
 
+// "in" takes the values of the input tape first, then asks with the dialog
 class R8UiInputPort : public R8InputPort {
 public:
     R8UiInputPort();
     virtual ~R8UiInputPort() {delete mInputDialog;}
+
+    void SetTape(const QVector<unsigned char>& values); //rewinds it
+    void Rewind();
+    int TapeReadCount() const {return (int)(BufferNext() - mTape.constData());}
+    int TapeCount() const {return mTape.size();}
 private:
-    R8InputDialog *mInputDialog;
+    R8InputDialog          *mInputDialog;
+    QVector<unsigned char>  mTape;
 protected:
     virtual unsigned char DoInput();
+    virtual bool HasMoreInput() const {return false;} //Run() stops, the window asks by Step()
 };
 
 #endif // R8INPUTDIALOG_H
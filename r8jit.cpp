@@ -0,0 +1,300 @@
+#include "r8jit.h"
+
+#include <cstddef>
+#include <cstring>
+
+#include <QByteArray>
+#include <QPair>
+
+#ifdef R8_JIT_X86_64
+#   include <sys/mman.h>
+#endif
+
+#ifdef R8_JIT_X86_64
+
+// Just enough of x86-64 for R8BasicEngine programs.
+//   rbx - R8JitContext*, r12 - R8 registers, r13 - R8 memory,
+//   r14d - execution time, r15d - budget;
+//   al/dl/cl - operands, rcx - memory index.
+class R8JitAssembler {
+public:
+    enum EByteRegister {
+        AL = 0,
+        CL = 1,
+        DL = 2
+    };
+
+    int Position() const {return mCode.size();}
+    const QByteArray& Code() const {return mCode;}
+
+    void Byte(unsigned int b) {mCode.append((char)b);}
+    void Bytes(unsigned int b1, unsigned int b2) {Byte(b1); Byte(b2);}
+    void Bytes(unsigned int b1, unsigned int b2, unsigned int b3) {Byte(b1); Byte(b2); Byte(b3);}
+    void Int32(unsigned int value);
+    void PatchRel32(int position, int target); //position of the rel32 field
+
+    void Prologue();
+    void Epilogue(); //eax - IP
+
+    void LoadOperand(EByteRegister reg, unsigned char mode, unsigned char value);
+    void StoreAl(unsigned char mode, unsigned char value);
+
+    void CmpBudget(unsigned int count)  {Bytes(0x41, 0x81, 0xFF); Int32(count);} //cmp r15d, count
+    void SubBudget(unsigned int count)  {Bytes(0x41, 0x81, 0xEF); Int32(count);} //sub r15d, count
+    void AddTime(unsigned int time)     {Bytes(0x41, 0x81, 0xC6); Int32(time);}  //add r14d, time
+    void MovEax(unsigned int value)     {Byte(0xB8); Int32(value);}
+    int  Jmp();                                           //jmp rel32, returns position of rel32
+    void JmpTo(int target) {PatchRel32(Jmp(), target);}
+
+private:
+    QByteArray mCode;
+
+    void ModRmBase(EByteRegister reg, unsigned int opcode, unsigned char mode, unsigned char value);
+};
+
+void R8JitAssembler::Int32(unsigned int value) {
+    for (int i=0; i<4; ++i)
+        Byte((value >> (8*i)) & 0xFF);
+}
+
+void R8JitAssembler::PatchRel32(int position, int target) {
+    unsigned int rel = (unsigned int)(target - (position + 4));
+    for (int i=0; i<4; ++i)
+        mCode[position + i] = (char)((rel >> (8*i)) & 0xFF);
+}
+
+int R8JitAssembler::Jmp() {
+    Byte(0xE9);
+    int position = Position();
+    Int32(0);
+    return position;
+}
+
+void R8JitAssembler::Prologue() {
+    Byte(0x53);                                             //push rbx
+    Byte(0x55);                                             //push rbp
+    Bytes(0x41, 0x54);                                      //push r12
+    Bytes(0x41, 0x55);                                      //push r13
+    Bytes(0x41, 0x56);                                      //push r14
+    Bytes(0x41, 0x57);                                      //push r15
+    Bytes(0x48, 0x89, 0xFB);                                //mov rbx, rdi
+    Bytes(0x4C, 0x8B, 0x63); Byte(offsetof(R8JitContext, Registers)); //mov r12, [rbx+Registers]
+    Bytes(0x4C, 0x8B, 0x6B); Byte(offsetof(R8JitContext, Memory));    //mov r13, [rbx+Memory]
+    Bytes(0x44, 0x8B, 0x73); Byte(offsetof(R8JitContext, Time));      //mov r14d, [rbx+Time]
+    Bytes(0x44, 0x8B, 0x7B); Byte(offsetof(R8JitContext, Budget));    //mov r15d, [rbx+Budget]
+    Bytes(0xFF, 0xE6);                                      //jmp rsi
+}
+
+void R8JitAssembler::Epilogue() {
+    Bytes(0x89, 0x43);       Byte(offsetof(R8JitContext, IP));        //mov [rbx+IP], eax
+    Bytes(0x44, 0x89, 0x73); Byte(offsetof(R8JitContext, Time));      //mov [rbx+Time], r14d
+    Bytes(0x44, 0x89, 0x7B); Byte(offsetof(R8JitContext, Budget));    //mov [rbx+Budget], r15d
+    Bytes(0x41, 0x5F);                                      //pop r15
+    Bytes(0x41, 0x5E);                                      //pop r14
+    Bytes(0x41, 0x5D);                                      //pop r13
+    Bytes(0x41, 0x5C);                                      //pop r12
+    Byte(0x5D);                                             //pop rbp
+    Byte(0x5B);                                             //pop rbx
+    Byte(0xC3);                                             //ret
+}
+
+// opcode reg8, [base] or [base], reg8 for the R8 operand "value" of "mode"
+void R8JitAssembler::ModRmBase(EByteRegister reg, unsigned int opcode, unsigned char mode, unsigned char value) {
+    switch (mode) {
+    case R8Reference::REGISTER:                             //[r12+value]
+        Bytes(0x41, opcode, 0x44 | (reg << 3)); Bytes(0x24, value);
+        break;
+    case R8Reference::MEMORY_BY_CONSTANT:                   //[r13+value]
+        Bytes(0x41, opcode, 0x85 | (reg << 3)); Int32(value);
+        break;
+    default:                                                //[r13+rcx], rcx := r12[value]
+        Bytes(0x41, 0x0F, 0xB6); Bytes(0x4C, 0x24, value);  //movzx ecx, byte [r12+value]
+        Bytes(0x41, opcode, 0x44 | (reg << 3)); Bytes(0x0D, 0x00);
+        break;
+    }
+}
+
+void R8JitAssembler::LoadOperand(EByteRegister reg, unsigned char mode, unsigned char value) {
+    if (mode == R8Reference::CONSTANT)
+        Bytes(0xB0 + reg, value);                           //mov reg, value
+    else
+        ModRmBase(reg, 0x8A, mode, value);                  //mov reg, [...]
+}
+
+void R8JitAssembler::StoreAl(unsigned char mode, unsigned char value) {
+    ModRmBase(AL, 0x88, mode, value);                       //mov [...], al
+}
+
+
+static bool IsTranslated(const R8DecodedInstruction& d) {
+    return (d.Handler == R8DecodedInstruction::ALU_HANDLER)
+        || (d.Handler == R8DecodedInstruction::GOTO_HANDLER)
+        || ((R8DecodedInstruction::JZ_CONSTANT_HANDLER <= d.Handler) && (d.Handler <= R8DecodedInstruction::JO_MEMORY_BY_REGISTER_HANDLER));
+}
+
+static bool IsJump(const R8DecodedInstruction& d) {
+    return (d.Opcode == R8Instruction::JZ_OPCODE) || (d.Opcode == R8Instruction::JO_OPCODE);
+}
+
+static void EmitAlu(R8JitAssembler& a, const R8DecodedInstruction& d) {
+    a.LoadOperand(R8JitAssembler::AL, d.Mode1, d.Value1);
+    if (d.Opcode != R8Instruction::NOT_OPCODE)
+        a.LoadOperand(R8JitAssembler::DL, d.Mode2, d.Value2);
+
+    switch (d.Opcode) {
+    case R8Instruction::ROR_OPCODE:  a.Bytes(0x88, 0xD1); a.Bytes(0xD2, 0xC8); break; //mov cl, dl; ror al, cl
+    case R8Instruction::ROL_OPCODE:  a.Bytes(0x88, 0xD1); a.Bytes(0xD2, 0xC0); break; //mov cl, dl; rol al, cl
+    case R8Instruction::NOT_OPCODE:  a.Bytes(0xF6, 0xD0);                      break; //not al
+    case R8Instruction::OR_OPCODE:   a.Bytes(0x08, 0xD0);                      break; //or al, dl
+    case R8Instruction::AND_OPCODE:  a.Bytes(0x20, 0xD0);                      break; //and al, dl
+    case R8Instruction::NOR_OPCODE:  a.Bytes(0x08, 0xD0); a.Bytes(0xF6, 0xD0); break; //or al, dl; not al
+    case R8Instruction::NAND_OPCODE: a.Bytes(0x20, 0xD0); a.Bytes(0xF6, 0xD0); break; //and al, dl; not al
+    case R8Instruction::XOR_OPCODE:  a.Bytes(0x30, 0xD0);                      break; //xor al, dl
+    case R8Instruction::ADD_OPCODE:  a.Bytes(0x00, 0xD0);                      break; //add al, dl
+    case R8Instruction::SUB_OPCODE:  a.Bytes(0x28, 0xD0);                      break; //sub al, dl
+    default:
+        Q_ASSERT(false);
+    }
+
+    a.StoreAl(d.ModeR, d.ValueR);
+}
+
+#endif // R8_JIT_X86_64
+
+
+R8JitCode::R8JitCode() : mCode(0), mCodeSize(0) {}
+
+R8JitCode::~R8JitCode() {
+    Clear();
+}
+
+bool R8JitCode::IsSupported() {
+#ifdef R8_JIT_X86_64
+    return true;
+#else
+    return false;
+#endif
+}
+
+void R8JitCode::Clear() {
+#ifdef R8_JIT_X86_64
+    if (mCode != 0)
+        munmap(mCode, mCodeSize);
+#endif
+    mCode = 0;
+    mCodeSize = 0;
+    mEntries.clear();
+}
+
+bool R8JitCode::Compile(const QVector<R8DecodedInstruction> &program, unsigned int jumpTime) {
+    Clear();
+
+#ifdef R8_JIT_X86_64
+    const int count = program.size();
+
+    QVector<bool> isLeader(count + 1, false);
+    isLeader[0] = true;
+    for (int i=0; i<count; ++i) {
+        const R8DecodedInstruction& d = program[i];
+        if (!IsTranslated(d)) {
+            isLeader[i] = true;
+            isLeader[i + 1] = true;
+        } else if (IsJump(d)) {
+            isLeader[d.Target] = true;
+            isLeader[i + 1] = true;
+        }
+    }
+
+    R8JitAssembler a;
+    a.Prologue();
+    int exitPosition = a.Position();
+    a.Epilogue();
+
+    QVector<int> entries(count, -1);
+    QList<QPair<int, unsigned int> > jumps; //rel32 position, target ip
+
+    for (int start=0; start<count; ) {
+        if (!IsTranslated(program[start])) {
+            ++start;
+            continue;
+        }
+
+        int end = start + 1;
+        unsigned int cost = program[start].Cost;
+        while ((end < count) && !isLeader[end]) {
+            cost += program[end].Cost;
+            ++end;
+        }
+
+        entries[start] = a.Position();
+        unsigned int length = end - start;
+        a.CmpBudget(length);
+        a.Bytes(0x73, 0x0A);                                //jae +10
+        a.MovEax(start);
+        a.JmpTo(exitPosition);
+        a.SubBudget(length);
+        a.AddTime(cost);
+
+        for (int i=start; i<end; ++i) {
+            const R8DecodedInstruction& d = program[i];
+            if (!IsJump(d)) {
+                EmitAlu(a, d);
+                continue;
+            }
+
+            a.LoadOperand(R8JitAssembler::AL, d.Mode1, d.Value1);
+            if (d.Opcode == R8Instruction::JZ_OPCODE)
+                a.Bytes(0x84, 0xC0);                        //test al, al
+            else
+                a.Bytes(0x3C, 0xFF);                        //cmp al, 0xFF
+            a.Bytes(0x75, 0x0C);                            //jne +12
+            a.AddTime(jumpTime);
+            jumps.append(qMakePair(a.Jmp(), d.Target));
+        }
+
+        if ((end >= count) || !IsTranslated(program[end])) {
+            a.MovEax(end);                                  //to the interpreter
+            a.JmpTo(exitPosition);
+        }
+        start = end;
+    }
+
+    for (int i=0; i<jumps.size(); ++i) {
+        unsigned int target = jumps[i].second;
+        if ((target < (unsigned int)count) && (entries[target] >= 0)) {
+            a.PatchRel32(jumps[i].first, entries[target]);
+        } else {
+            a.PatchRel32(jumps[i].first, a.Position());
+            a.MovEax(target);
+            a.JmpTo(exitPosition);
+        }
+    }
+
+    size_t size = a.Code().size();
+    void *code = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED)
+        return false;
+
+    memcpy(code, a.Code().constData(), size);
+    if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(code, size);
+        return false;
+    }
+
+    mCode = (unsigned char*)code;
+    mCodeSize = size;
+    mEntries = entries;
+    return true;
+#else
+    Q_UNUSED(program);
+    Q_UNUSED(jumpTime);
+    return false;
+#endif
+}
+
+void R8JitCode::Run(R8JitContext *context) const {
+    Q_ASSERT(IsEntry(context->IP));
+
+    TEntryPoint entryPoint = reinterpret_cast<TEntryPoint>(mCode);
+    entryPoint(context, mCode + mEntries[context->IP]);
+}
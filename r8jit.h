@@ -0,0 +1,57 @@
+#ifndef R8JIT_H
+#define R8JIT_H
+
+#include <QtGlobal>
+#include <QVector>
+
+#include "r8engine.h"
+
+#if defined(__x86_64__) && defined(Q_OS_UNIX)
+#   define R8_JIT_X86_64
+#endif
+
+// State shared by R8BasicEngine and its native code.
+struct R8JitContext {
+    unsigned char *Registers;
+    unsigned char *Memory;
+    unsigned int   IP;
+    unsigned int   Time;
+    unsigned int   Budget;  //instructions left to execute
+};
+
+// Native x86-64 (System V) code of a decoded program. Only ALU instructions and
+// jumps are translated: in, out, halt and invalid instructions leave the native
+// code with IP pointing at them, so the interpreter executes them and any
+// exception is thrown outside of generated frames.
+//
+// Code is emitted per basic block: a block checks Budget and adds its time on
+// entry, a taken jump adds JUMP_TIME. R8 registers and memory are accessed in
+// place through Registers and Memory.
+class R8JitCode {
+public:
+    R8JitCode();
+    ~R8JitCode();
+
+    static bool IsSupported();
+
+    // program ends with the HALT of Length()
+    bool Compile(const QVector<R8DecodedInstruction>& program, unsigned int jumpTime);
+    void Clear();
+
+    bool IsEntry(unsigned int ip) const {return (ip < (unsigned int)mEntries.size()) && (mEntries[ip] >= 0);}
+
+    // Runs from context->IP (must be an entry) until a not translated
+    // instruction or a block longer than Budget.
+    void Run(R8JitContext *context) const;
+
+private:
+    typedef void (*TEntryPoint)(R8JitContext *context, const unsigned char *entry);
+
+    unsigned char *mCode;
+    size_t         mCodeSize;
+    QVector<int>   mEntries; //code offset of the block starting at ip, or -1
+
+    Q_DISABLE_COPY(R8JitCode)
+};
+
+#endif // R8JIT_H
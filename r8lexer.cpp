@@ -1,9 +1,19 @@
 #include "r8lexer.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "r8charstream.h"
 
-R8Lexer::R8Lexer() {
-    mCharStream = 0;
+QString R8Token::TokenString() const {
+    if (mType == END_OF_SOURCE)
+        return QString("eos");
+    return QString(mText, mLength);
+}
+
+
+R8Lexer::R8Lexer() : mCharStream(0),mCurrent(0),mEnd(0),mLine(0) {
 }
 
 bool R8Lexer::IsConstantStart(QChar ch) {
@@ -20,170 +30,177 @@ bool R8Lexer::IsIdentifierStart(QChar ch) {
             ;
 }
 
-QChar R8Lexer::CurrentChar() {Q_ASSERT(mCharStream != 0); return mCharStream->CurrentChar(); }
-bool  R8Lexer::IsValidCurrentChar() const {Q_ASSERT(mCharStream != 0); return mCharStream->IsValidCurrentChar(); }
-void  R8Lexer::GoToNextChar() { Q_ASSERT(mCharStream != 0); mCharStream->GoToNextChar(); }
-int   R8Lexer::CurrentLine() const {Q_ASSERT(mCharStream != 0); return mCharStream->CurrentLine();}
+bool R8Lexer::IsDigit(QChar ch, int base) {
+    const ushort code = ch.unicode();
+    if (base <= 10)
+        return (code >= '0') && (code < '0' + base);
+    return     ((code >= '0') && (code <= '9'))
+            || ((code >= 'A') && (code < 'A' + base - 10))
+            || ((code >= 'a') && (code < 'a' + base - 10))
+            ;
+}
+
+int R8Lexer::CurrentLine() const {Q_ASSERT(mCharStream != 0); return mCharStream->CurrentLine();}
 
+// Skips ' ', '\t', '\r' and '\n', counting the lines; with SSE2 eight chars at a time
 void R8Lexer::SkipSpaces() {
-    while (IsValidCurrentChar()) {
-        QChar ch = CurrentChar();
-        if ((ch == QChar(' ')) || (ch == QChar('\t')) || (ch == QChar('\r')) || (ch == QChar('\n'))) {
-            GoToNextChar();
+#ifdef __SSE2__
+    const __m128i spaces   = _mm_set1_epi16(' ');
+    const __m128i tabs     = _mm_set1_epi16('\t');
+    const __m128i returns  = _mm_set1_epi16('\r');
+    const __m128i newlines = _mm_set1_epi16('\n');
+
+    while (mEnd - mCurrent >= 8) {
+        const __m128i chars = _mm_loadu_si128((const __m128i *)mCurrent);
+        const __m128i lines = _mm_cmpeq_epi16(chars, newlines);
+        const __m128i blank = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(chars, spaces), _mm_cmpeq_epi16(chars, tabs)),
+                                           _mm_or_si128(_mm_cmpeq_epi16(chars, returns), lines));
+
+        const unsigned int lineBytes  = (unsigned int)_mm_movemask_epi8(lines);    //2 bits per char
+        const unsigned int otherBytes = ~(unsigned int)_mm_movemask_epi8(blank) & 0xFFFF;
+        if (otherBytes == 0) {
+            mLine += __builtin_popcount(lineBytes) / 2;
+            mCurrent += 8;
             continue;
         }
-        break;
+
+        const int first = __builtin_ctz(otherBytes);
+        mLine += __builtin_popcount(lineBytes & ((1u << first) - 1)) / 2;
+        mCurrent += first / 2;
+        return;
+    }
+#endif
+    while (IsValidCurrentChar()) {
+        const ushort ch = mCurrent->unicode();
+        if (ch == '\n')
+            ++mLine;
+        else if ((ch != ' ') && (ch != '\t') && (ch != '\r'))
+            break;
+        ++mCurrent;
     }
 }
 
+// Up to the end of the line; the '\n' is left to SkipSpaces()
 void R8Lexer::SkipComment() {
-    while (IsValidCurrentChar()) {
-        QChar ch = CurrentChar();
-        GoToNextChar();
-        if (ch == QChar('\n'))
+#ifdef __SSE2__
+    const __m128i newlines = _mm_set1_epi16('\n');
+
+    while (mEnd - mCurrent >= 8) {
+        const __m128i chars = _mm_loadu_si128((const __m128i *)mCurrent);
+        const unsigned int lineBytes = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi16(chars, newlines));
+        if (lineBytes != 0) {
+            mCurrent += __builtin_ctz(lineBytes) / 2;
             return;
+        }
+        mCurrent += 8;
     }
+#endif
+    while (IsValidCurrentChar() && (*mCurrent != QChar('\n')))
+        ++mCurrent;
 }
 
 void R8Lexer::NextToken() {
-    QChar ch;
+    Q_ASSERT(mCharStream != 0);
+    mCurrent = mCharStream->Current();
+    mEnd     = mCharStream->End();
+    mLine    = mCharStream->CurrentLine();
+
+    const bool isKnown = ScanToken();
+    mCharStream->SetCurrent(mCurrent, mLine);
+    if (!isKnown)
+        throw R8LexerException(R8LexerException::UNKNOWN_TOKEN, mLine, QString(*mCurrent));
+}
+
+bool R8Lexer::ScanToken() {
     while (1) {
         SkipSpaces();
         if (!IsValidCurrentChar()) {
-            mCurrentToken = R8Token(R8Token::END_OF_SOURCE, "eos", 0);
-            return;
+            mCurrentToken = R8Token();
+            return true;
         }
 
-        ch = CurrentChar();
+        const QChar ch = *mCurrent;
         if (ch == QChar(',')) {
-            mCurrentToken = R8Token(R8Token::COMMA, QString(","), 0);
-            GoToNextChar();
-            return;
+            mCurrentToken = R8Token(R8Token::COMMA, mCurrent++, 1, 0);
+            return true;
         } else if (ch == QChar(':')) {
-            mCurrentToken = R8Token(R8Token::COLON, QString(":"), 0);
-            GoToNextChar();
-            return;
+            mCurrentToken = R8Token(R8Token::COLON, mCurrent++, 1, 0);
+            return true;
         } else if (ch == QChar('[')) {
-            mCurrentToken = R8Token(R8Token::LEFT_SBRACE, QString("["), 0);
-            GoToNextChar();
-            return;
+            mCurrentToken = R8Token(R8Token::LEFT_SBRACE, mCurrent++, 1, 0);
+            return true;
         } else if (ch == QChar(']')) {
-            mCurrentToken = R8Token(R8Token::RIGHT_SBRACE, QString("]"), 0);
-            GoToNextChar();
-            return;
+            mCurrentToken = R8Token(R8Token::RIGHT_SBRACE, mCurrent++, 1, 0);
+            return true;
         } else if (ch == QChar(';')) {
             SkipComment();
         } else if (IsConstantStart(ch)) {
             mCurrentToken = GetConstantToken();
-            return;
+            return true;
         } else if (IsIdentifierStart(ch)) {
             mCurrentToken = GetIdentifierToken();
-            return;
+            return true;
         } else
-            throw R8LexerException(R8LexerException::UNKNOWN_TOKEN, CurrentLine(), QString(ch));
+            return false;
     }
 }
 
-R8Token R8Lexer::ReadNumberToken(bool isNegative, const QString& prefix, int base) {
-    QString str(prefix);
-    int value = 0;
-
-    while (IsValidCurrentChar()) {
-        QChar ch = CurrentChar();
-
-        if (base <= 10) {
-            if ((QChar('0') <= ch) && (ch <= QChar('0' + base - 1))) {
-                int digit = (int)(ch.unicode() - QChar('0').unicode());
-                value = value * base + digit;
+R8Token R8Lexer::ReadNumberToken(const QChar *start, bool isNegative, int base) {
+    unsigned int value = 0; //modulo 2^32, so its low byte is right for any length
 
-                GoToNextChar();
-                str += ch;
-            } else
-                break;
-        } else {
-            if ((QChar('0') <= ch) && (ch <= QChar('0' + 10 - 1))) {
-                int digit = (int)(ch.unicode() - QChar('0').unicode());
-                value = value * base + digit;
-
-                GoToNextChar();
-                str += ch;
-            } else if ((QChar('A') <= ch.toUpper()) && (ch.toUpper() <= QChar('A' + (base - 10) - 1))) {
-                int digit = (int)(10 + ch.toUpper().unicode() - QChar('A').unicode());
-                value = value * base + digit;
-
-                GoToNextChar();
-                str += ch;
-            } else
-                break;
-        }
+    while (IsValidCurrentChar() && IsDigit(*mCurrent, base)) {
+        const ushort ch = mCurrent->unicode();
+        const unsigned int digit = (ch <= '9') ? (ch - '0') : (10 + (ch | 0x20) - 'a');
+        value = value * base + digit;
+        ++mCurrent;
     }
-    return R8Token(R8Token::NUMBER, str, (unsigned char)((isNegative)?(-value):value));
+    return R8Token(R8Token::NUMBER, start, (int)(mCurrent - start), (unsigned char)((isNegative)?(-value):value));
 }
 
 //число {+12, -12, 0xAC, 0123, 0o123, 0b01010}
 R8Token R8Lexer::GetConstantToken() {
-    QString str;
-    bool    isNegative = false;
+    const QChar *start = mCurrent;
+    bool isNegative = false;
 
-    QChar   ch = CurrentChar();
-    if (ch == QChar('-')) {
+    if (*mCurrent == QChar('-')) {
         isNegative = true;
-
-        GoToNextChar();
-        str += ch;
-    } else if (ch == QChar('+')) {
-        GoToNextChar();
-        str += ch;
+        ++mCurrent;
+    } else if (*mCurrent == QChar('+')) {
+        ++mCurrent;
     }
 
     if (!IsValidCurrentChar())
-        return R8Token(R8Token::END_OF_SOURCE, "eos", 0);
+        return R8Token();
 
-    ch = CurrentChar();
-    if (ch == QChar('0')) { //start of prefix
-        str += ch;
-        GoToNextChar();
+    if (*mCurrent == QChar('0')) { //start of prefix
+        ++mCurrent;
         if (!IsValidCurrentChar())
-            return R8Token(R8Token::NUMBER, str, 0);
+            return R8Token(R8Token::NUMBER, start, (int)(mCurrent - start), 0);
 
-        ch = CurrentChar(); //prefix char
+        const QChar ch = *mCurrent; //prefix char
         if (ch == QChar('b')) { //binary
-            str += ch;
-            GoToNextChar();
-            return ReadNumberToken(isNegative, str, 2);
+            ++mCurrent;
+            return ReadNumberToken(start, isNegative, 2);
         } else if (ch == QChar('o')) { //octal
-            str += ch;
-            GoToNextChar();
-            return ReadNumberToken(isNegative, str, 8);
+            ++mCurrent;
+            return ReadNumberToken(start, isNegative, 8);
         } else if (ch == QChar('x')) { //hex
-            str += ch;
-            GoToNextChar();
-            return ReadNumberToken(isNegative, str, 16);
+            ++mCurrent;
+            return ReadNumberToken(start, isNegative, 16);
         } else if ((QChar('0') <= ch) && (ch <= QChar('7'))) { //octal
-            return ReadNumberToken(isNegative, str, 8);
+            return ReadNumberToken(start, isNegative, 8);
         } else {
-            return ReadNumberToken(isNegative, str, 10);
+            return ReadNumberToken(start, isNegative, 10);
         }
     } else {
-        return ReadNumberToken(isNegative, str, 10);
+        return ReadNumberToken(start, isNegative, 10);
     }
 }
 
 R8Token R8Lexer::GetIdentifierToken() {
-    QString str;
-
-    while (IsValidCurrentChar()) {
-        QChar ch = CurrentChar();
-
-        if (
-                   IsIdentifierStart(ch)
-                || ((QChar('0') <= ch) && (ch <= QChar('9')))
-        ) {
-            GoToNextChar();
-            str += ch;
-        } else
-            break;
-    }
+    const QChar *start = mCurrent;
+    while (IsValidCurrentChar() && (IsIdentifierStart(*mCurrent) || IsDigit(*mCurrent, 10)))
+        ++mCurrent;
 
-    return R8Token(R8Token::IDENTIFIER, str, 0);
+    return R8Token(R8Token::IDENTIFIER, start, (int)(mCurrent - start), 0);
 }
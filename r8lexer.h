@@ -24,6 +24,7 @@ private:
 };
 
 
+// A span of the source buffer (see R8CharStream), so tokens cost no allocations
 class R8Token {
 public:
     enum EType {
@@ -37,17 +38,20 @@ public:
         MISPRINT
     };
 
-    R8Token() : mType(END_OF_SOURCE), mTokenString(), mValue(0) {}
-    R8Token(EType Type, QString TokenString, unsigned char Value) :
-        mType(Type),mTokenString(TokenString),mValue(Value) {}
+    R8Token() : mType(END_OF_SOURCE),mText(0),mLength(0),mValue(0) {}
+    R8Token(EType type, const QChar *text, int length, unsigned char value) :
+        mType(type),mText(text),mLength(length),mValue(value) {}
 
     EType   Type() const { return mType; }
-    const QString TokenString() const { return mTokenString; }
+    const QChar *Text() const { return mText; }
+    int     Length() const { return mLength; }
+    QString TokenString() const; //a copy of the span, "eos" at the end of source
     unsigned char Value() const { return mValue; }
 
 private:
     EType           mType;
-    QString         mTokenString;
+    const QChar    *mText;
+    int             mLength;
     unsigned char   mValue;   //register index, memory index, constant
 };
 
@@ -57,25 +61,28 @@ public:
     R8Lexer();
     void SetSource(R8CharStream *charStream) {mCharStream = charStream;}
     const R8Token& CurrentToken() {return mCurrentToken;}
-    void NextToken();
+    void NextToken(); //from the current char of the stream, the stream goes past the token
 
     int  CurrentLine() const;
 
 private:
     R8CharStream *mCharStream;
     R8Token       mCurrentToken;
+    const QChar  *mCurrent; //while a token is scanned
+    const QChar  *mEnd;
+    int           mLine;
 
     static bool IsConstantStart(QChar ch);
     static bool IsIdentifierStart(QChar ch);
+    static bool IsDigit(QChar ch, int base);
 
-    QChar CurrentChar();
-    bool  IsValidCurrentChar() const;
-    void  GoToNextChar();
+    bool IsValidCurrentChar() const {return (mCurrent < mEnd);}
+    bool ScanToken(); //false at an unknown char
 
     void SkipSpaces();
     void SkipComment();
 
-    R8Token ReadNumberToken(bool isNegative, const QString& prefix, int base);
+    R8Token ReadNumberToken(const QChar *start, bool isNegative, int base);
     R8Token GetConstantToken();
     R8Token GetIdentifierToken();
 };
@@ -0,0 +1,172 @@
+#include "r8linker.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QScopedPointer>
+
+#include "r8charstream.h"
+#include "r8commandset.h"
+
+const R8Module *R8ModuleLibrary::Module(const QString &path, int variant) {
+    const QString key = QString("%1:%2").arg(variant).arg(QFileInfo(path).absoluteFilePath());
+    {
+        QMutexLocker locker(&mMutex);
+        R8Module *module = mModules.value(key, 0);
+        if (module != 0)
+            return module;
+    }
+
+    QFile file(path);
+    if (!file.open(QFile::ReadOnly | QFile::Text))
+        return 0;
+
+    QScopedPointer<R8Module> compiled(new R8Module()); //outside the lock: threads may compile one module twice, one copy is kept
+    Compile(path, QString::fromUtf8(file.readAll()), variant, compiled.data());
+
+    QMutexLocker locker(&mMutex);
+    R8Module *&module = mModules[key];
+    if (module == 0)
+        module = compiled.take();
+    return module;
+}
+
+void R8ModuleLibrary::Compile(const QString &path, const QString &source, int variant, R8Module *module) {
+    R8StringCharStream charStream(source);
+    R8CommandSet       commandSet;
+    R8Compiler         compiler;
+
+    commandSet.SetVariant(variant);
+    commandSet.ApplyTo(compiler);
+    compiler.SetSource(&charStream);
+
+    module->Path = path;
+    try {
+        compiler.CompileFragment(&module->Labels, &module->Jumps, &module->Includes);
+    } catch (const R8CompilerException& ex) {
+        throw R8LinkerException(path, ex);
+    } catch (const R8LexerException& ex) {
+        throw R8LinkerException(path, ex.LineNumber(), QString("unknown token \"%1\"").arg(ex.Info()));
+    }
+    module->Program     = compiler.CompiledCode();
+    module->SourceLines = compiler.SourceLines();
+}
+
+QString R8ModuleLibrary::IncludedPath(const QString &path, const R8Include &include) {
+    return QDir::cleanPath(QFileInfo(path).path() + "/" + include.Name + ".r8");
+}
+
+
+void R8Linker::Link(const R8Module &main, R8ModuleLibrary *library, int variant) {
+    mProgram.Clear();
+    mSourceLines.clear();
+    mParts.clear();
+    mCopies.clear();
+    mJumps.clear();
+    mLabels.clear();
+
+    QStringList including;
+    Place(main, library, variant, &including);
+    ResolveJumps();
+}
+
+QString R8Linker::PathForIp(int ip) const {
+    int found = -1;
+    for (int low=0, high=mParts.size() - 1; low <= high; ) { //the last part that begins at ip or before
+        const int middle = (low + high) / 2;
+        if (mParts[middle].Ip <= (unsigned int)ip) {
+            found = middle;
+            low = middle + 1;
+        } else
+            high = middle - 1;
+    }
+    return (found >= 0) && (ip < mProgram.Length()) ? mParts[found].Path : QString();
+}
+
+// Copies the commands of the module and the modules it includes, in the order
+// of the source; includes are followed depth first, so a cycle is found as a
+// path that is being included already.
+void R8Linker::Place(const R8Module &module, R8ModuleLibrary *library, int variant, QStringList *including) {
+    including->append(QFileInfo(module.Path).absoluteFilePath()); //as R8ModuleLibrary keys it, whatever path reached it
+    const int copy = mCopies.size();
+    mCopies.append(TCopy());
+
+    QVector<unsigned int> ips(module.Program.Length() + 1); // f: opcode_index_in_module -> opcode_index
+    QHash<QString, unsigned int> includedLabels;           //labels right before an include point to its code
+    unsigned int from = 0;
+    for (int i=0; i<module.Includes.size(); ++i) {
+        const R8Include& include = module.Includes[i];
+        Copy(module, from, include.Ip, ips);
+        from = include.Ip;
+
+        const QString path = R8ModuleLibrary::IncludedPath(module.Path, include);
+        if (including->contains(QFileInfo(path).absoluteFilePath()))
+            throw R8LinkerException(module.Path, R8CompilerException(R8CompilerException::INCLUDE_CYCLE, include.Line, include.Name));
+        const R8Module *included = library->Module(path, variant);
+        if (included == 0)
+            throw R8LinkerException(module.Path, R8CompilerException(R8CompilerException::MODULE_NOT_FOUND, include.Line, include.Name));
+
+        for (int label=0; label<include.Labels.size(); ++label)
+            includedLabels.insert(include.Labels[label], mProgram.Length());
+        Place(*included, library, variant, including);
+    }
+    Copy(module, from, module.Program.Length(), ips);
+    ips[module.Program.Length()] = mProgram.Length();
+
+    QHash<QString, unsigned int>& labels = mCopies[copy].Labels;
+    for (int i=0; i<module.Labels.size(); ++i) {
+        const R8LabelUse& label = module.Labels[i];
+        const unsigned int ip = includedLabels.value(label.Name, ips[label.Ip]);
+        labels.insert(label.Name, ip);
+        const unsigned int global = mLabels.contains(label.Name) ? AMBIGUOUS_LABEL : ip; //a copy: insert() binds a reference
+        mLabels.insert(label.Name, global);
+    }
+
+    TJump jump;
+    jump.Copy = copy;
+    for (int i=0; i<module.Jumps.size(); ++i) {
+        jump.Name = module.Jumps[i].Name;
+        jump.Ip   = ips[module.Jumps[i].Ip];
+        mJumps.append(jump);
+    }
+    including->removeLast();
+}
+
+void R8Linker::Copy(const R8Module &module, unsigned int from, unsigned int to, QVector<unsigned int> &ips) {
+    if (from == to)
+        return;
+
+    TPart part;
+    part.Ip   = mProgram.Length();
+    part.Path = module.Path;
+    mParts.append(part);
+
+    for (unsigned int ip=from; ip<to; ++ip) {
+        ips[ip] = mProgram.AddInstruction(module.Program.Instruction(ip));
+        mSourceLines.append(module.SourceLines[ip]);
+    }
+}
+
+// The first jump (by ip) with no label is reported, as R8Compiler does
+void R8Linker::ResolveJumps() {
+    const TJump *unresolved = 0;
+    for (int i=0; i<mJumps.size(); ++i) {
+        const TJump& jump = mJumps[i];
+        const QHash<QString, unsigned int>& labels = mCopies[jump.Copy].Labels;
+        QHash<QString, unsigned int>::const_iterator found = labels.constFind(jump.Name);
+        if (found == labels.constEnd()) {
+            found = mLabels.constFind(jump.Name);
+            if (found == mLabels.constEnd()) {
+                if ((unresolved == 0) || (jump.Ip < unresolved->Ip))
+                    unresolved = &jump;
+                continue;
+            }
+            if (found.value() == AMBIGUOUS_LABEL)
+                throw R8LinkerException(PathForIp(jump.Ip), R8CompilerException(R8CompilerException::LABEL_REDEFINITION, mSourceLines[jump.Ip], jump.Name));
+        }
+        mProgram.SetInstructionResult(jump.Ip, R8Reference(R8Reference::INSTRUCTION_INDEX, found.value()));
+    }
+
+    if (unresolved != 0)
+        throw R8LinkerException(PathForIp(unresolved->Ip), R8CompilerException(R8CompilerException::UNRESOLVED_LABEL, mSourceLines[unresolved->Ip], unresolved->Name));
+}
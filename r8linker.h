@@ -0,0 +1,105 @@
+#ifndef R8LINKER_H
+#define R8LINKER_H
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QtAlgorithms>
+
+#include "r8compiler.h"
+#include "r8engine.h"
+
+// An error in one of the modules of a program
+class R8LinkerException {
+public:
+    R8LinkerException(const QString& path, unsigned int lineNumber, const QString& description) :
+        mPath(path),mLineNumber(lineNumber),mDescription(description) {}
+    R8LinkerException(const QString& path, const R8CompilerException& ex) :
+        mPath(path),mLineNumber(ex.LineNumber()),mDescription(ex.Description()) {}
+
+    QString Path() const {return mPath;}
+    unsigned int LineNumber() const {return mLineNumber;}
+    QString Description() const {return mDescription;} //not translated, for batch tools
+private:
+    QString      mPath;
+    unsigned int mLineNumber;
+    QString      mDescription;
+};
+
+// A compiled source file: its jumps are not resolved but listed, as are its
+// labels and includes, see R8Compiler::CompileFragment()
+struct R8Module {
+    QString             Path;
+    R8Program           Program;
+    QVector<int>        SourceLines; // f: opcode_index -> source_line
+    QVector<R8LabelUse> Labels;
+    QVector<R8LabelUse> Jumps;
+    QVector<R8Include>  Includes;    //by ip
+};
+
+// Modules by path and command set variant: each is compiled once and shared by
+// all the programs that include it. Threads may share a library.
+class R8ModuleLibrary {
+public:
+    R8ModuleLibrary() {}
+    ~R8ModuleLibrary() {qDeleteAll(mModules);}
+
+    // 0 if the file can not be read; the module lasts while the library does
+    const R8Module *Module(const QString& path, int variant); //throws R8LinkerException
+
+    static void Compile(const QString& path, const QString& source, int variant, R8Module *module); //throws R8LinkerException
+    static QString IncludedPath(const QString& path, const R8Include& include); //"name.r8" next to the including file
+
+private:
+    QMutex                    mMutex;
+    QHash<QString, R8Module*> mModules; //by variant and absolute path
+
+    Q_DISABLE_COPY(R8ModuleLibrary)
+};
+
+// Builds a program of modules. R8 has no calls, so the code of an included
+// module goes in place of its include, a copy for every include. The labels of
+// every copy are its own: a jump goes to the label of its copy, or to the
+// label of that name in the program if its copy has none (then only one copy
+// may define it).
+class R8Linker {
+public:
+    void Link(const R8Module& main, R8ModuleLibrary *library, int variant); //throws R8LinkerException
+
+    const R8Program& LinkedCode() const {return mProgram;}
+    const QVector<int>& SourceLines() const {return mSourceLines;} // f: opcode_index -> source_line in its module
+    QString PathForIp(int ip) const; //of the module the command comes from
+
+private:
+    static const unsigned int AMBIGUOUS_LABEL = ~0u; //defined by more than one copy
+
+    struct TPart {      //the commands from Ip on come from the module
+        unsigned int Ip;
+        QString      Path;
+    };
+
+    struct TCopy {
+        QHash<QString, unsigned int> Labels; //of the program
+    };
+
+    struct TJump {
+        QString      Name;
+        unsigned int Ip;   //of the program
+        int          Copy;
+    };
+
+    R8Program                    mProgram;
+    QVector<int>                 mSourceLines;
+    QVector<TPart>               mParts;
+    QVector<TCopy>               mCopies;
+    QVector<TJump>               mJumps;
+    QHash<QString, unsigned int> mLabels; //of all the copies
+
+    void Place(const R8Module& module, R8ModuleLibrary *library, int variant, QStringList *including);
+    void Copy(const R8Module& module, unsigned int from, unsigned int to, QVector<unsigned int>& ips);
+    void ResolveJumps();
+};
+
+#endif // R8LINKER_H
@@ -0,0 +1,70 @@
+#include "r8memorymodel.h"
+
+R8MemoryModel::R8MemoryModel(R8Engine *engine, QObject *parent) : QAbstractTableModel(parent),mEngine(engine) {
+    for (int value=0; value<256; ++value)
+        mCellTexts[value] = QString("%1").arg(value, 2, 16, QLatin1Char('0'));
+    for (unsigned int i=0; i<R8Engine::MEMORY_SIZE; ++i)
+        mShownCells[i] = mEngine->MemoryCell(i);
+}
+
+int R8MemoryModel::rowCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : ROWS_COUNT;
+}
+
+int R8MemoryModel::columnCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : COLUMNS_COUNT;
+}
+
+QVariant R8MemoryModel::data(const QModelIndex &index, int role) const {
+    const unsigned int cell = index.row()*COLUMNS_COUNT + index.column();
+    if ((role != Qt::DisplayRole) || !index.isValid() || (cell >= R8Engine::MEMORY_SIZE))
+        return QVariant();
+    return mCellTexts[mEngine->MemoryCell(cell)];
+}
+
+QVariant R8MemoryModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (role != Qt::DisplayRole)
+        return QVariant();
+    if (orientation == Qt::Horizontal)
+        return QString("%1").arg(section, 0, 16).toUpper();
+    return QString("0x%1").arg(QString("%1").arg(section, 0, 16).toUpper());
+}
+
+Qt::ItemFlags R8MemoryModel::flags(const QModelIndex &) const {
+    return Qt::ItemIsSelectable | Qt::ItemIsEnabled;
+}
+
+void R8MemoryModel::RefreshCell(unsigned int index) {
+    Q_ASSERT(index < R8Engine::MEMORY_SIZE);
+
+    const unsigned char value = mEngine->MemoryCell(index);
+    if (value == mShownCells[index])
+        return;
+    mShownCells[index] = value;
+
+    const QModelIndex cell = createIndex(index / COLUMNS_COUNT, index % COLUMNS_COUNT);
+    emit dataChanged(cell, cell);
+}
+
+void R8MemoryModel::Refresh() {
+    for (int row=0; row<ROWS_COUNT; ++row) {
+        int first = -1;
+        int last  = -1;
+        for (int column=0; column<COLUMNS_COUNT; ++column) {
+            const unsigned int index = row*COLUMNS_COUNT + column;
+            if (index >= R8Engine::MEMORY_SIZE)
+                break;
+
+            const unsigned char value = mEngine->MemoryCell(index);
+            if (value == mShownCells[index])
+                continue;
+            mShownCells[index] = value;
+
+            if (first < 0)
+                first = column;
+            last = column;
+        }
+        if (first >= 0)
+            emit dataChanged(createIndex(row, first), createIndex(row, last));
+    }
+}
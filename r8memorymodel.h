@@ -0,0 +1,34 @@
+#ifndef R8MEMORYMODEL_H
+#define R8MEMORYMODEL_H
+
+#include <QAbstractTableModel>
+
+#include "r8engine.h"
+
+// The memory of the engine as a table of hex cells: the view reads the engine
+// only for the cells it paints, and Refresh() repaints only the changed ones.
+class R8MemoryModel : public QAbstractTableModel {
+public:
+    static const int COLUMNS_COUNT = 16;
+    static const int ROWS_COUNT    = (R8Engine::MEMORY_SIZE + COLUMNS_COUNT - 1) / COLUMNS_COUNT;
+
+    R8MemoryModel(R8Engine *engine, QObject *parent = 0);
+
+    virtual int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    virtual int columnCount(const QModelIndex &parent = QModelIndex()) const;
+    virtual QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+    virtual QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+    virtual Qt::ItemFlags flags(const QModelIndex &index) const;
+
+    void RefreshCell(unsigned int index); //if the cell changed since its last view
+    void Refresh();                       //all cells, a span per changed row
+
+private:
+    R8Engine     *mEngine;
+    unsigned char mShownCells[R8Engine::MEMORY_SIZE]; //as the view shows them
+    QString       mCellTexts[256];                    //by value, so painting allocates nothing
+
+    Q_DISABLE_COPY(R8MemoryModel)
+};
+
+#endif // R8MEMORYMODEL_H
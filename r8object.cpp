@@ -0,0 +1,126 @@
+#include "r8object.h"
+
+#include <QtEndian>
+
+void R8ObjectFile::SetProgram(const R8Program &program, const QVector<int> &sourceLines) {
+    Close();
+    mProgram = program;
+    if (sourceLines.size() != program.Length()) //no lines are known
+        return;
+
+    mLines = QByteArray(sourceLines.size()*(int)sizeof(quint32), 0);
+    quint32 *word = reinterpret_cast<quint32*>(mLines.data());
+    for (int i=0; i<sourceLines.size(); ++i)
+        word[i] = (quint32)(qint32)sourceLines[i];
+}
+
+int R8ObjectFile::SourceLineForIp(int ip) const {
+    if ((unsigned int)ip >= (unsigned int)(mLines.size() / sizeof(quint32)))
+        return -1;
+    return (qint32)reinterpret_cast<const quint32*>(mLines.constData())[ip];
+}
+
+// count words of the map, viewed in place by a little-endian host
+QByteArray R8ObjectFile::Section(const uchar *data, qint64 count) {
+    const int size = (int)(count*sizeof(quint32));
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    return QByteArray::fromRawData(reinterpret_cast<const char*>(data), size);
+#else
+    QByteArray words(size, 0);
+    quint32 *word = reinterpret_cast<quint32*>(words.data());
+    for (qint64 i=0; i<count; ++i)
+        word[i] = qFromLittleEndian<quint32>(data + i*sizeof(quint32));
+    return words;
+#endif
+}
+
+bool R8ObjectFile::WriteSection(QFile &file, const QByteArray &words) {
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    return (file.write(words) == words.size());
+#else
+    QByteArray bytes(words.size(), 0);
+    const quint32 *word = reinterpret_cast<const quint32*>(words.constData());
+    for (int i=0; i<words.size() / (int)sizeof(quint32); ++i)
+        qToLittleEndian<quint32>(word[i], reinterpret_cast<uchar*>(bytes.data()) + i*sizeof(quint32));
+    return (file.write(bytes) == bytes.size());
+#endif
+}
+
+bool R8ObjectFile::Save(const QString &path) const {
+    QFile file(path);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate))
+        return false;
+
+    const quint32 header[HEADER_WORDS] = {
+        MAGIC, VERSION,
+        (quint32)mProgram.Length(),
+        (quint32)(mProgram.WideWords().size() / (R8Program::WIDE_WORDS*sizeof(quint32))),
+        (quint32)(mLines.size() / sizeof(quint32))
+    };
+    uchar bytes[sizeof(header)];
+    for (int i=0; i<HEADER_WORDS; ++i)
+        qToLittleEndian<quint32>(header[i], bytes + i*sizeof(quint32));
+
+    return (file.write(reinterpret_cast<const char*>(bytes), sizeof(bytes)) == (qint64)sizeof(bytes))
+        && WriteSection(file, mProgram.Words())
+        && WriteSection(file, mProgram.WideWords())
+        && WriteSection(file, mLines)
+        && file.flush();
+}
+
+bool R8ObjectFile::Open(const QString &path) {
+    Close();
+
+    mFile.setFileName(path);
+    if (!mFile.open(QFile::ReadOnly))
+        return false;
+
+    const qint64 size = mFile.size();
+    mMap = (size > 0) ? mFile.map(0, size) : 0;
+    if ((mMap != 0) && (reinterpret_cast<quintptr>(mMap) % sizeof(quint32) != 0)) { //a resource, not aligned for words
+        mFile.unmap(mMap);
+        mMap = 0;
+    }
+    if (mMap == 0)
+        mData = mFile.readAll(); //a compressed resource or a file that can not be mapped
+
+    const uchar *data = (mMap != 0) ? mMap : reinterpret_cast<const uchar*>(mData.constData());
+    if (!View(data, (mMap != 0) ? size : mData.size())) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+// The program views the words of the file at data
+bool R8ObjectFile::View(const uchar *data, qint64 size) {
+    if (size < HEADER_WORDS*(qint64)sizeof(quint32))
+        return false;
+
+    quint32 header[HEADER_WORDS];
+    for (int i=0; i<HEADER_WORDS; ++i)
+        header[i] = qFromLittleEndian<quint32>(data + i*sizeof(quint32));
+
+    const qint64 length     = header[2];
+    const qint64 wideWords  = R8Program::WIDE_WORDS*(qint64)header[3];
+    const qint64 linesCount = header[4];
+    const bool isObject = (header[0] == MAGIC) && (header[1] == VERSION)
+                       && ((linesCount == 0) || (linesCount == length))
+                       && ((HEADER_WORDS + length + wideWords + linesCount)*(qint64)sizeof(quint32) == size);
+
+    const uchar *code = data + HEADER_WORDS*sizeof(quint32);
+    if (!isObject || !R8Program::FromWords(Section(code, length), Section(code + length*sizeof(quint32), wideWords), &mProgram))
+        return false;
+    mLines = Section(code + (length + wideWords)*sizeof(quint32), linesCount);
+    return true;
+}
+
+void R8ObjectFile::Close() {
+    mProgram.Clear();
+    mLines.clear();
+    if (mMap != 0)
+        mFile.unmap(mMap);
+    mMap = 0;
+    mData.clear();
+    mFile.close();
+}
@@ -0,0 +1,55 @@
+#ifndef R8OBJECT_H
+#define R8OBJECT_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+#include "r8engine.h"
+
+// A compiled program with the source line of every instruction, as it is kept
+// in an .r8o file (32-bit little-endian words):
+//   header  "R8OB", version, instructions count, wide instructions count and
+//           lines count (0 or the instructions count)
+//   code    R8Program::Words(), then R8Program::WideWords()
+//   lines   the debug-line section: the source line of every instruction
+// An opened file is mapped and its program views the mapped words, so nothing
+// is read into memory; the program and its copies last until Close().
+//
+// A file that can not be mapped, or is mapped unaligned for words (a pipe, a
+// compressed ":/" resource of a .qrc), is read into memory instead. Programs
+// assembled at build time are R8_ASSEMBLE()'s, see r8staticassembler.h.
+class R8ObjectFile {
+public:
+    R8ObjectFile() : mMap(0) {}
+    ~R8ObjectFile() {Close();}
+
+    void SetProgram(const R8Program& program, const QVector<int>& sourceLines);
+    bool Save(const QString& path) const;
+
+    bool Open(const QString& path); //false if it can not be read or is not an object file
+    void Close();
+
+    const R8Program& Program() const {return mProgram;}
+    int SourceLineForIp(int ip) const; //-1 if it is not known
+
+private:
+    static const quint32 MAGIC        = 0x52384F42; //"R8OB"
+    static const quint32 VERSION      = 1;
+    static const int     HEADER_WORDS = 5;
+
+    QFile      mFile;
+    uchar     *mMap;     //0 if the program is not of a file or the file is read
+    QByteArray mData;    //the file when it can not be mapped
+    R8Program  mProgram;
+    QByteArray mLines;   //quint32 words of qint32 lines in host order, as Section() gives them
+
+    bool View(const uchar *data, qint64 size);
+    static QByteArray Section(const uchar *data, qint64 count);
+    static bool WriteSection(QFile& file, const QByteArray& words);
+
+    Q_DISABLE_COPY(R8ObjectFile)
+};
+
+#endif // R8OBJECT_H
@@ -0,0 +1,143 @@
+#include "r8ports.h"
+
+#include <climits>
+
+#include "r8charstream.h"
+#include "r8lexer.h"
+
+void R8BufferInputPort::SetValues(const QVector<unsigned char> &values) {
+    mValues = values;
+    SetSpan(mValues.constData(), mValues.size());
+}
+
+void R8BufferInputPort::SetSpan(const unsigned char *begin, int count) {
+    mBegin = begin;
+    mEnd   = begin + count;
+    Rewind();
+}
+
+void R8BufferInputPort::Rewind() {
+    SetBuffer(mBegin, mEnd);
+    SetFailure(false);
+}
+
+unsigned char R8BufferInputPort::DoInput() {
+    SetFailure(true);
+    return 0;
+}
+
+bool R8BufferInputPort::ParseValues(const QString &text, QVector<unsigned char> &values) {
+    R8StringCharStream charStream(text);
+    R8Lexer lexer;
+    lexer.SetSource(&charStream);
+
+    try {
+        for (lexer.NextToken(); lexer.CurrentToken().Type() != R8Token::END_OF_SOURCE; lexer.NextToken()) {
+            if (lexer.CurrentToken().Type() == R8Token::NUMBER)
+                values.append(lexer.CurrentToken().Value());
+            else if (lexer.CurrentToken().Type() != R8Token::COMMA)
+                return false;
+        }
+    } catch (const R8LexerException&) {
+        return false;
+    }
+    return true;
+}
+
+
+bool R8MappedInputPort::Open(const QString &path) {
+    Close();
+
+    mFile.setFileName(path);
+    if (!mFile.open(QFile::ReadOnly))
+        return false;
+
+    const qint64 size = mFile.size();
+    if (size > INT_MAX)
+        return false;
+
+    mMap = (size > 0) ? mFile.map(0, size) : 0;
+    if (mMap != 0) {
+        SetSpan(mMap, (int)size);
+        return true;
+    }
+
+    const QByteArray bytes = mFile.readAll(); //a pipe or a file that can not be mapped
+    QVector<unsigned char> values(bytes.size());
+    for (int i=0; i<bytes.size(); ++i)
+        values[i] = (unsigned char)bytes[i];
+    SetValues(values);
+    return true;
+}
+
+void R8MappedInputPort::Close() {
+    SetSpan(0, 0);
+    if (mMap != 0)
+        mFile.unmap(mMap);
+    mMap = 0;
+    mFile.close();
+}
+
+
+void R8BufferOutputPort::Clear() {
+    mValues.resize(INITIAL_SIZE);
+    SetBuffer(mValues.data(), mValues.data() + mValues.size());
+}
+
+void R8BufferOutputPort::DoOutput(unsigned char value) {
+    const int count = mValues.size();
+    mValues.resize(2*count);
+    mValues[count] = value;
+    SetBuffer(mValues.data() + count + 1, mValues.data() + mValues.size());
+}
+
+
+R8QueuedOutputPort::R8QueuedOutputPort() {
+    SetBuffer(mChunk, mChunk + CHUNK_SIZE);
+}
+
+QVector<unsigned char> R8QueuedOutputPort::Take() {
+    QMutexLocker locker(&mMutex);
+    QVector<unsigned char> values = mQueue;
+    mQueue.clear();
+    return values;
+}
+
+void R8QueuedOutputPort::Clear() {
+    QMutexLocker locker(&mMutex);
+    mQueue.clear();
+    SetBuffer(mChunk, mChunk + CHUNK_SIZE);
+}
+
+void R8QueuedOutputPort::DoOutput(unsigned char value) {
+    DoFlush();
+    Output(value);
+}
+
+void R8QueuedOutputPort::DoFlush() {
+    const int count = (int)(BufferNext() - mChunk);
+    if (count == 0)
+        return;
+
+    QMutexLocker locker(&mMutex);
+    for (int i=0; i<count; ++i)
+        mQueue.append(mChunk[i]);
+    SetBuffer(mChunk, mChunk + CHUNK_SIZE);
+}
+
+
+R8DeviceOutputPort::R8DeviceOutputPort(QIODevice *device) : mDevice(device),mIsFailure(false) {
+    SetBuffer(mChunk, mChunk + CHUNK_SIZE);
+}
+
+void R8DeviceOutputPort::DoOutput(unsigned char value) {
+    DoFlush();
+    Output(value);
+}
+
+void R8DeviceOutputPort::DoFlush() {
+    const qint64 count = BufferNext() - mChunk;
+    if ((count != 0) && (mDevice->write((const char *)mChunk, count) != count))
+        mIsFailure = true;
+    SetBuffer(mChunk, mChunk + CHUNK_SIZE);
+}
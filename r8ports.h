@@ -0,0 +1,120 @@
+#ifndef R8PORTS_H
+#define R8PORTS_H
+
+#include <QFile>
+#include <QIODevice>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+#include "r8engine.h"
+
+// Buffer-backed ports: "in" and "out" of the engine read and write the span of
+// the port directly and call the port only when the span is over.
+
+// Gives the values of a span to "in", then fails (the engine halts)
+class R8BufferInputPort : public R8InputPort {
+public:
+    R8BufferInputPort() : mBegin(0),mEnd(0) {}
+
+    void SetValues(const QVector<unsigned char>& values); //keeps a copy
+    void SetSpan(const unsigned char *begin, int count);  //the span must outlive the run
+    void Rewind();
+
+    int Count() const {return (int)(mEnd - mBegin);}
+    int ReadCount() const {return (int)(BufferNext() - mBegin);}
+
+    // "1, 2, 0x10": numbers as in programs, separated by commas or spaces
+    static bool ParseValues(const QString& text, QVector<unsigned char>& values);
+
+protected:
+    virtual unsigned char DoInput();
+    virtual bool HasMoreInput() const {return false;}
+
+private:
+    QVector<unsigned char> mValues;
+    const unsigned char   *mBegin;
+    const unsigned char   *mEnd;
+};
+
+// The bytes of a file are the values, mapped to memory for large data sets
+class R8MappedInputPort : public R8BufferInputPort {
+public:
+    R8MappedInputPort() : mMap(0) {}
+    virtual ~R8MappedInputPort() {Close();}
+
+    bool Open(const QString& path); //false if it can not be read
+    void Close();
+
+private:
+    QFile  mFile;
+    uchar *mMap; //0 if the values are read into memory
+
+    Q_DISABLE_COPY(R8MappedInputPort)
+};
+
+// Collects the outputs in a growing buffer
+class R8BufferOutputPort : public R8OutputPort {
+public:
+    R8BufferOutputPort() {Clear();}
+
+    int Count() const {return (int)(BufferNext() - mValues.constData());}
+    unsigned char Value(int index) const {return mValues[index];}
+    QVector<unsigned char> Values() const {return mValues.mid(0, Count());}
+    void Clear();
+
+protected:
+    virtual void DoOutput(unsigned char value);
+
+private:
+    static const int INITIAL_SIZE = 256;
+
+    QVector<unsigned char> mValues; //[0, Count()) are the outputs
+};
+
+// Hands the outputs over to another thread: the engine's thread flushes them,
+// a chunk at a time when the chunk is full, and the other one takes them
+class R8QueuedOutputPort : public R8OutputPort {
+public:
+    R8QueuedOutputPort();
+
+    QVector<unsigned char> Take(); //the flushed outputs
+    void Clear();                  //while the engine is not running
+
+protected:
+    virtual void DoOutput(unsigned char value);
+    virtual void DoFlush();
+
+private:
+    static const int CHUNK_SIZE = 256;
+
+    QMutex                 mMutex;
+    QVector<unsigned char> mQueue; //flushed, under mMutex
+    unsigned char          mChunk[CHUNK_SIZE];
+
+    Q_DISABLE_COPY(R8QueuedOutputPort)
+};
+
+// Writes the outputs to a device as bytes, a chunk at a time
+class R8DeviceOutputPort : public R8OutputPort {
+public:
+    explicit R8DeviceOutputPort(QIODevice *device);
+    virtual ~R8DeviceOutputPort() {}
+
+    bool IsFailure() const {return mIsFailure;} //a write failed
+
+protected:
+    virtual void DoOutput(unsigned char value);
+    virtual void DoFlush();
+
+private:
+    static const int CHUNK_SIZE = 64*1024;
+
+    QIODevice    *mDevice;
+    bool          mIsFailure;
+    unsigned char mChunk[CHUNK_SIZE];
+
+    Q_DISABLE_COPY(R8DeviceOutputPort)
+};
+
+#endif // R8PORTS_H
@@ -0,0 +1,1202 @@
+#include <climits>
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <QScopedPointer>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
+
+#include "r8charstream.h"
+#include "r8commandset.h"
+#include "r8compilecache.h"
+#include "r8engine.h"
+#include "r8grader.h"
+#include "r8linker.h"
+#include "r8object.h"
+#include "r8ports.h"
+#include "r8staticassembler.h"
+#include "r8testsuite.h"
+#include "r8vectorengine.h"
+
+// Headless R8 runner:
+//   r8run [-v variant] [-i input-file | -d data-file] [-o output-file]
+//         [-s max-steps] [-m max-time] [-l] [-j] [-b runs] [-r state-file] [-w state-file]
+//         [-x count [-e vector|bitsliced] [-c reference.r8]] program.r8 [value ...]
+//   r8run [-v variant] [-s max-steps] [-m max-time] [-l] -t tests program.r8
+//   r8run [-v variant] -a object-file program.r8
+//   r8run [-v variant] [-s max-steps] -f vectors [program.r8 ...]
+//   r8run [-s max-steps] [-m max-time] [-l] [-k cache-file] -g manifest
+//
+// A program (and the reference of -c) may be an .r8o file written by -a: it is
+// mapped and run as it is, not compiled.
+//
+// A program may include modules: "include name" puts the code of the file
+// name.r8 (next to the including file) in its place, see R8Linker. A module
+// is compiled once per run, however many programs include it; the line of
+// a runtime error is the one in the module the command comes from.
+//
+// Values for "in" are taken from the command line, then from the input file
+// (or stdin when no file is given). When the run is over every "out" is printed
+// as "out <value>", followed by "time <clocks>".
+//
+// With -d the values for "in" are the bytes of the data file (mapped to memory,
+// the command line values are ignored); with -o every "out" is written to the
+// output file as a byte instead of being printed.
+//
+// With -l a program that loops forever (its state repeats with no "in" between)
+// stops with the runtime error "Infinite loop detected".
+//
+// With -r the run resumes from the state (registers, memory, IP, time) saved
+// by -w when a previous run stopped, e.g. after -s max-steps.
+//
+// With -j the program runs as native code where the host supports it.
+// With -b the program is run the given number of times by the reference
+// interpreter, the threaded one and the native code (values from the command
+// line only); final states are compared and the speeds are printed.
+// With -f the interpreters and the native code are checked against each other
+// (the differential test of R8BatchEngine::Execute()): generated programs that
+// use every ALU command with every combination of operand access types and
+// jz/jo, the ones built in by R8_ASSEMBLE() (their instructions must be the
+// ones R8Compiler makes), then the given ones, are run on vectors pseudo-random
+// input vectors (the same ones every time) by ReferenceStep(), the threaded
+// interpreter (also with loop detection), the native code and the lanes of
+// R8VectorEngine and R8BitslicedEngine (but the FAULTED ones). IP, time,
+// steps, registers, memory, outputs, inputs read and errors must be equal
+// after every run (or max-steps, 100000 by default; only loop detection may
+// stop earlier); the first difference of a program is printed with its
+// inputs, the exit code is 6. "static loop" must be stopped by loop detection.
+// With -x the program is run on every combination of count input values by
+// R8VectorEngine (or R8BitslicedEngine with -e bitsliced); a line
+// "in <values> out <values> time <clocks> [status]" is printed for each of
+// them. With -c the outputs are compared with the ones of the reference
+// program: " expected <values>" is added to the lines that differ.
+//
+// With -t the program is compiled once and run on every test of the file (the
+// test blocks of todo.txt or the lines printed by -x), one after another; a
+// line "<test>: passed|failed, time <clocks>" is printed for each of them.
+//
+// With -g the submissions listed in the manifest are graded on all cores. A
+// manifest line is "<program.r8> <variant> <tests>" (paths are relative to the
+// manifest), the tests file has the lines printed by -x. With -k the compiled
+// submissions are kept in the cache file (.r8cache), and a submission whose
+// tokens are in it already is not compiled again by the next runs.
+
+static const int EXIT_BAD_USAGE      = 1;
+static const int EXIT_COMPILE_ERROR  = 2;
+static const int EXIT_RUNTIME_ERROR  = 3;
+static const int EXIT_STEPS_EXCEEDED = 4;
+static const int EXIT_INPUT_EXHAUSTED= 5;
+static const int EXIT_OUTPUTS_DIFFER = 6;
+static const int EXIT_TESTS_FAILED   = 7;
+
+static const unsigned long DIFFERENTIAL_MAX_STEPS = 100000; //per run of -f with no -s, for programs that loop
+
+// Values from the command line, then from the lines of the stream; a line is
+// read only when the values before it are over
+class R8ValuesInputPort : public R8InputPort {
+public:
+    R8ValuesInputPort() : mStream(0) {Rewind();}
+
+    void AddValues(const QVector<unsigned char>& values);
+    void Rewind();
+    void SetStream(QTextStream *stream) {mStream = stream;}
+
+protected:
+    virtual unsigned char DoInput();
+
+private:
+    QVector<unsigned char> mValues;
+    QTextStream           *mStream;
+
+    bool ReadNextLine();
+};
+
+void R8ValuesInputPort::AddValues(const QVector<unsigned char> &values) {
+    const int next = (int)(BufferNext() - mValues.constData());
+    mValues += values;
+    SetBuffer(mValues.constData() + next, mValues.constData() + mValues.size());
+}
+
+void R8ValuesInputPort::Rewind() {
+    SetBuffer(mValues.constData(), mValues.constData() + mValues.size());
+    SetFailure(false);
+}
+
+unsigned char R8ValuesInputPort::DoInput() {
+    const int next = mValues.size(); //the buffer is over
+    while (next >= mValues.size()) {
+        if (!ReadNextLine()) {
+            SetFailure(true);
+            return 0;
+        }
+    }
+
+    SetFailure(false);
+    SetBuffer(mValues.constData() + next + 1, mValues.constData() + mValues.size());
+    return mValues[next];
+}
+
+bool R8ValuesInputPort::ReadNextLine() {
+    if ((mStream == 0) || mStream->atEnd())
+        return false;
+
+    QString line = mStream->readLine();
+    QVector<unsigned char> values;
+    if (!R8BufferInputPort::ParseValues(line, values))
+        throw R8Exception(QString("Bad input value \"%1\"").arg(line));
+    AddValues(values);
+    return true;
+}
+
+
+static void PrintUsage(QTextStream& err) {
+    err << "usage: r8run [-v variant] [-i input-file | -d data-file] [-o output-file]\n"
+        << "             [-s max-steps] [-m max-time] [-l] [-j] [-b runs] [-r state-file] [-w state-file]\n"
+        << "             [-x count [-e vector|bitsliced] [-c reference.r8]] program.r8 [value ...]\n"
+        << "       r8run [-v variant] [-s max-steps] [-m max-time] [-l] -t tests program.r8\n"
+        << "       r8run [-v variant] -a object-file program.r8\n"
+        << "       r8run [-v variant] [-s max-steps] -f vectors [program.r8 ...]\n"
+        << "       r8run [-s max-steps] [-m max-time] [-l] [-k cache-file] -g manifest\n"
+        << "  -v variant     command set variant (0.." << (R8CommandSet::VARIANTS_COUNT - 1) << "), 0 by default\n"
+        << "  -i input-file  file with values for \"in\" (\"-\" or nothing means stdin)\n"
+        << "  -d data-file   file with bytes for \"in\"\n"
+        << "  -o output-file file to write the bytes of \"out\" to\n"
+        << "  -s max-steps   stop after max-steps executed commands\n"
+        << "  -m max-time    stop after max-time clocks (not for -x)\n"
+        << "  -l             stop programs that loop forever\n"
+        << "  -r state-file  resume from the state saved by -w\n"
+        << "  -w state-file  save the state (.r8state) when the run stops\n"
+        << "  -j             run native code (x86-64 only)\n"
+        << "  -b runs        benchmark the interpreters on runs program runs\n"
+        << "  -f vectors     check the interpreters and native code against each other\n"
+        << "  -x count       run on all combinations of count (1..3) input values\n"
+        << "  -e engine      engine of -x: vector (default) or bitsliced\n"
+        << "  -c reference   compare the outputs of -x with the reference program\n"
+        << "  -t tests       run the program on the tests of the file\n"
+        << "  -a object-file write the compiled program to the file (.r8o) and exit\n"
+        << "  -g manifest    grade the submissions of the manifest on their tests\n"
+        << "  -k cache-file  keep the compiled submissions of -g in the file\n";
+}
+
+static QString FormatSpeed(quint64 steps, qint64 ms) {
+    return QString::number((double)steps / ((ms > 0) ? ms : 1) / 1000.0, 'f', 1);
+}
+
+// Final state of a run, to compare the interpreters with each other
+static QVector<unsigned int> EngineState(R8BatchEngine& engine) {
+    QVector<unsigned int> state;
+    state << engine.IP() << engine.ExecutionTime();
+    for (unsigned int i=0; i<R8BatchEngine::REGISTERS_COUNT; ++i)
+        state << engine.Register(i);
+    for (unsigned int i=0; i<R8BatchEngine::MEMORY_SIZE; ++i)
+        state << engine.MemoryCell(i);
+    for (int i=0; i<engine.Outputs().size(); ++i)
+        state << engine.Outputs()[i];
+    return state;
+}
+
+static qint64 RunTimes(R8BatchEngine& engine, R8ValuesInputPort& inputPort, unsigned int runs, bool isReference, quint64 *steps) {
+    QElapsedTimer timer;
+    timer.start();
+    for (unsigned int i=0; i<runs; ++i) {
+        inputPort.Rewind();
+        engine.Reset();
+        if (isReference) {
+            for (; !engine.IsHalted(); ++*steps)
+                engine.ReferenceStep();
+        } else {
+            while (!engine.IsHalted())
+                *steps += engine.Execute(UINT_MAX);
+        }
+    }
+    return timer.elapsed();
+}
+
+static int RunBenchmark(R8BatchEngine& engine, R8ValuesInputPort& inputPort, unsigned int runs, QTextStream& out, QTextStream& err) {
+    static const char *const sNames[] = {"reference", "threaded ", "jit      "};
+
+    qint64 referenceMs = 0;
+    QVector<unsigned int> referenceState;
+
+    for (int mode=0; mode<3; ++mode) {
+        engine.SetJitEnabled(mode == 2);
+        if ((mode == 2) && !engine.IsJitActive()) {
+            out << sNames[mode] << " not supported\n";
+            break;
+        }
+
+        quint64 steps = 0;
+        qint64 ms = RunTimes(engine, inputPort, runs, (mode == 0), &steps);
+        if (mode == 0) {
+            referenceMs = ms;
+            referenceState = EngineState(engine);
+        } else if (EngineState(engine) != referenceState) {
+            err << sNames[mode] << " differs from the reference interpreter\n";
+            return EXIT_RUNTIME_ERROR;
+        }
+
+        out << sNames[mode] << " " << steps << " steps, " << ms << " ms, " << FormatSpeed(steps, ms) << " Msteps/s";
+        if (mode != 0)
+            out << ", x" << QString::number((double)((referenceMs > 0) ? referenceMs : 1) / ((ms > 0) ? ms : 1), 'f', 2);
+        out << "\n";
+    }
+    return 0;
+}
+
+// One run of an exhaustive check, as it is printed
+struct R8RunResult {
+    QVector<unsigned char> Outputs;
+    unsigned int           Time;
+    QString                Status; //empty when halted normally
+    int                    ExitCode;
+};
+
+// Inputs R8VectorEngine stopped on an invalid instruction are run once again
+static R8RunResult RunScalar(const R8Program& program, const QVector<unsigned char>& values, unsigned long maxSteps) {
+    R8BufferInputPort inputPort;
+    inputPort.SetValues(values);
+
+    R8BatchEngine engine;
+    engine.SetInputPort(&inputPort);
+    engine.SetProgram(program);
+
+    R8RunResult result;
+    result.ExitCode = 0;
+    try {
+        for (unsigned long steps=0; !engine.IsHalted(); ) {
+            if ((maxSteps != 0) && (steps == maxSteps)) {
+                result.Status = "steps-exceeded";
+                result.ExitCode = EXIT_STEPS_EXCEEDED;
+                break;
+            }
+            steps += engine.Execute((maxSteps == 0) ? UINT_MAX : (unsigned int)qMin<unsigned long>(maxSteps - steps, UINT_MAX));
+        }
+    } catch (const R8Exception& ex) {
+        result.Status = QString("error \"%1\"").arg(ex.Message());
+        result.ExitCode = EXIT_RUNTIME_ERROR;
+    }
+    if ((result.ExitCode == 0) && inputPort.IsFailure()) {
+        result.Status = "input-exhausted";
+        result.ExitCode = EXIT_INPUT_EXHAUSTED;
+    }
+
+    result.Outputs = engine.Outputs();
+    result.Time = engine.ExecutionTime();
+    return result;
+}
+
+template<class TEngine>
+static R8RunResult LaneResult(const TEngine& engine, int lane, const R8Program& program, const QVector<unsigned char>& values, unsigned long maxSteps) {
+    if (engine.LaneState(lane) == TEngine::FAULTED)
+        return RunScalar(program, values, maxSteps);
+
+    R8RunResult result;
+    result.Outputs = engine.Outputs(lane);
+    result.Time = engine.ExecutionTime(lane);
+    result.ExitCode = 0;
+    if (engine.LaneState(lane) == TEngine::INPUT_EXHAUSTED) {
+        result.Status = "input-exhausted";
+        result.ExitCode = EXIT_INPUT_EXHAUSTED;
+    } else if (engine.LaneState(lane) == TEngine::STEPS_EXCEEDED) {
+        result.Status = "steps-exceeded";
+        result.ExitCode = EXIT_STEPS_EXCEEDED;
+    }
+    return result;
+}
+
+static QVector<unsigned char> ExhaustiveValues(unsigned long index, int count) {
+    QVector<unsigned char> values(count);
+    for (int i=0; i<count; ++i)
+        values[i] = (index >> (8 * (count - 1 - i))) & 0xFF;
+    return values;
+}
+
+static QString FormatValues(const QVector<unsigned char>& values) {
+    QString text;
+    for (int i=0; i<values.size(); ++i)
+        text += QString(" %1").arg((unsigned int)values[i]);
+    return text;
+}
+
+// Runs program (and reference when given) on every combination of count values
+template<class TEngine>
+static int RunExhaustive(const R8Program& program, const R8Program *reference, int count, unsigned long maxSteps, QTextStream& out) {
+    const unsigned long runs = 1UL << (8 * count);
+
+    QScopedPointer<TEngine> engine(new TEngine());
+    QScopedPointer<TEngine> referenceEngine(new TEngine());
+    engine->SetProgram(program);
+    if (reference != 0)
+        referenceEngine->SetProgram(*reference);
+
+    int exitCode = 0;
+    unsigned long differences = 0;
+    for (unsigned long first=0; first<runs; first+=TEngine::LANES_COUNT) {
+        const int lanes = (int)qMin<unsigned long>(runs - first, TEngine::LANES_COUNT);
+
+        engine->Reset(lanes);
+        referenceEngine->Reset((reference != 0) ? lanes : 0);
+        for (int lane=0; lane<lanes; ++lane) {
+            engine->SetInputs(lane, ExhaustiveValues(first + lane, count));
+            referenceEngine->SetInputs(lane, ExhaustiveValues(first + lane, count));
+        }
+        engine->Run(maxSteps);
+        referenceEngine->Run(maxSteps);
+
+        for (int lane=0; lane<lanes; ++lane) {
+            const QVector<unsigned char> values = ExhaustiveValues(first + lane, count);
+            R8RunResult result = LaneResult(*engine, lane, program, values, maxSteps);
+
+            out << "in" << FormatValues(values) << " out" << FormatValues(result.Outputs) << " time " << result.Time;
+            if (!result.Status.isEmpty())
+                out << " " << result.Status;
+            if (reference != 0) {
+                R8RunResult expected = LaneResult(*referenceEngine, lane, *reference, values, maxSteps);
+                if (expected.Outputs != result.Outputs) {
+                    out << " expected" << FormatValues(expected.Outputs);
+                    ++differences;
+                }
+            }
+            out << "\n";
+
+            if (exitCode == 0)
+                exitCode = result.ExitCode;
+        }
+    }
+
+    if (reference != 0) {
+        out << differences << " of " << runs << " outputs differ\n";
+        if ((exitCode == 0) && (differences != 0))
+            exitCode = EXIT_OUTPUTS_DIFFER;
+    }
+    return exitCode;
+}
+
+static int LinkFile(const QString& path, int variant, R8Linker& linker, QTextStream& err) {
+    QFile file(path);
+    if (!file.open(QFile::ReadOnly | QFile::Text)) {
+        err << path << ": can not open file\n";
+        return EXIT_BAD_USAGE;
+    }
+
+    R8ModuleLibrary library;
+    R8Module        main;
+    try {
+        R8ModuleLibrary::Compile(path, QString::fromUtf8(file.readAll()), variant, &main);
+        linker.Link(main, &library, variant);
+    } catch (const R8LinkerException& ex) {
+        err << ex.Path() << ":" << (ex.LineNumber() + 1) << ": error: " << ex.Description() << "\n";
+        return EXIT_COMPILE_ERROR;
+    }
+    return 0;
+}
+
+// program.r8 is compiled and linked with the modules it includes, program.r8o is mapped
+static int LoadProgram(const QString& path, int variant, R8ObjectFile& object, QTextStream& err) {
+    if (path.endsWith(".r8o")) {
+        if (!object.Open(path)) {
+            err << path << ": not an r8 object file\n";
+            return EXIT_BAD_USAGE;
+        }
+        return 0;
+    }
+
+    R8Linker linker;
+    const int exitCode = LinkFile(path, variant, linker, err);
+    if (exitCode == 0)
+        object.SetProgram(linker.LinkedCode(), linker.SourceLines());
+    return exitCode;
+}
+
+// Operands of the generated programs of the differential check, by access type
+static QString DifferentialOperand(int accessType, int k) {
+    static const int sConstants[] = {0x00, 0x01, 0x42, 0x7F, 0x80, 0xFE, 0xFF};
+    const int constant = sConstants[k % (int)(sizeof(sConstants)/sizeof(sConstants[0]))];
+    switch (accessType) {
+    case R8Reference::REGISTER:           return QString("r%1").arg(k % R8BatchEngine::REGISTERS_COUNT);
+    case R8Reference::MEMORY_BY_CONSTANT: return QString("[0x%1]").arg(constant, 2, 16, QChar('0'));
+    case R8Reference::MEMORY_BY_REGISTER: return QString("[r%1]").arg(k % R8BatchEngine::REGISTERS_COUNT);
+    default:                              return QString("0x%1").arg(constant, 2, 16, QChar('0')); //CONSTANT
+    }
+}
+
+// A program for every ALU command: the command with every combination of
+// operand access types, its result tested by jz or jo right after it (native
+// code may take the flags of the command) and put out, then a backward loop.
+// Registers and the constant cells are set by "in" first.
+static QStringList DifferentialPrograms(QStringList *names) {
+    static const char *const sCommands[] = {"ror", "rol", "not", "or", "and", "nor", "nand", "xor", "add", "sub"};
+    static const int sSources[]      = {R8Reference::REGISTER, R8Reference::CONSTANT, R8Reference::MEMORY_BY_CONSTANT, R8Reference::MEMORY_BY_REGISTER};
+    static const int sDestinations[] = {R8Reference::REGISTER, R8Reference::MEMORY_BY_CONSTANT, R8Reference::MEMORY_BY_REGISTER};
+
+    QStringList programs;
+    for (int command=0; command<(int)(sizeof(sCommands)/sizeof(sCommands[0])); ++command) {
+        const bool isUnary = (QString(sCommands[command]) == "not");
+        QString source;
+        for (unsigned int i=0; i<R8BatchEngine::REGISTERS_COUNT; ++i)
+            source += QString("    in r%1\n").arg(i);
+        for (int k=0; k<7; ++k)
+            source += QString("    in %1\n").arg(DifferentialOperand(R8Reference::MEMORY_BY_CONSTANT, k));
+
+        int k = 0;
+        for (int s1=0; s1<4; ++s1) {
+            for (int s2=0; s2<(isUnary ? 1 : 4); ++s2) {
+                for (int d=0; d<3; ++d, ++k) {
+                    const QString result = DifferentialOperand(sDestinations[d], 3*k + 1);
+                    source += QString("    %1 %2, ").arg(sCommands[command]).arg(DifferentialOperand(sSources[s1], k));
+                    if (!isUnary)
+                        source += DifferentialOperand(sSources[s2], 5*k + 3) + ", ";
+                    source += result + "\n";
+                    source += QString("    %1 %2, l%3\n    out %2\nl%3:\n").arg((k % 2 == 0) ? "jz" : "jo").arg(result).arg(k);
+                    source += QString("    jo %1, m%2\n    out 0x5A\nm%2:\n").arg(DifferentialOperand(sSources[s1], k)).arg(k);
+                }
+            }
+        }
+        source += "    add 0, 5, r7\nloop:\n    sub r7, 1, r7\n    out r7\n    jz r7, end\n    jz 0, loop\nend:\n";
+
+        programs.append(source);
+        names->append(QString("generated %1").arg(sCommands[command]));
+    }
+    return programs;
+}
+
+// The state an engine leaves after a run of the differential check; the
+// outputs go last as their count varies
+static QVector<unsigned int> DifferentialState(R8BatchEngine& engine, const R8BufferInputPort& port, unsigned long steps) {
+    QVector<unsigned int> state;
+    state << engine.IP() << engine.ExecutionTime() << (unsigned int)steps << engine.IsHalted() << port.ReadCount() << engine.Outputs().size();
+    for (unsigned int i=0; i<R8BatchEngine::REGISTERS_COUNT; ++i)
+        state << engine.Register(i);
+    for (unsigned int i=0; i<R8BatchEngine::MEMORY_SIZE; ++i)
+        state << engine.MemoryCell(i);
+    for (int i=0; i<engine.Outputs().size(); ++i)
+        state << engine.Outputs()[i];
+    return state;
+}
+
+static QString DifferentialField(int index) {
+    static const char *const sNames[] = {"ip", "time", "steps", "halted", "inputs read", "outputs count"};
+    const int count = (int)(sizeof(sNames)/sizeof(sNames[0]));
+    if (index < count)
+        return sNames[index];
+    index -= count;
+    if (index < (int)R8BatchEngine::REGISTERS_COUNT)
+        return QString("r%1").arg(index);
+    index -= R8BatchEngine::REGISTERS_COUNT;
+    if (index < (int)R8BatchEngine::MEMORY_SIZE)
+        return QString("[%1]").arg(index);
+    return QString("out %1").arg(index - R8BatchEngine::MEMORY_SIZE + 1);
+}
+
+// The state a lane of a vector engine leaves, as DifferentialState() has it
+template<class TEngine>
+static QVector<unsigned int> DifferentialLaneState(const TEngine& engine, int lane, int length) {
+    QVector<unsigned int> state;
+    state << engine.IP(lane) << engine.ExecutionTime(lane) << (unsigned int)engine.Steps(lane) << (engine.IP(lane) >= (unsigned int)length)
+          << engine.InputsRead(lane) << engine.Outputs(lane).size();
+    for (unsigned int i=0; i<R8BatchEngine::REGISTERS_COUNT; ++i)
+        state << engine.Register(lane, i);
+    for (unsigned int i=0; i<R8BatchEngine::MEMORY_SIZE; ++i)
+        state << engine.MemoryCell(lane, i);
+    for (int i=0; i<engine.Outputs(lane).size(); ++i)
+        state << engine.Outputs(lane)[i];
+    return state;
+}
+
+static void PrintDifference(const QString& name, const char *mode, const QVector<unsigned char>& values, const QVector<unsigned int>& state,
+                            const QString& error, const QVector<unsigned int>& referenceState, const QString& referenceError, QTextStream& out) {
+    out << name << ": " << mode << " differs from the reference on in " << FormatValues(values) << ": ";
+    if (error != referenceError) {
+        out << "error \"" << error << "\" instead of \"" << referenceError << "\"\n";
+        return;
+    }
+    int field = 0;
+    while ((field < state.size()) && (field < referenceState.size()) && (state[field] == referenceState[field]))
+        ++field;
+    out << DifferentialField(field) << " " << ((field < state.size()) ? QString::number(state[field]) : QString("none"))
+        << " instead of " << ((field < referenceState.size()) ? QString::number(referenceState[field]) : QString("none")) << "\n";
+}
+
+// Runs the vectors by the lanes of TEngine; lanes stopped as FAULTED are left
+// out as their state is not kept (-x runs them again by the scalar engine)
+template<class TEngine>
+static int CheckLanes(const QString& name, const char *mode, const R8Program& program, const QVector<QVector<unsigned char> >& vectors,
+                      const QVector<QVector<unsigned int> >& referenceStates, const QStringList& referenceErrors, unsigned long maxSteps, QTextStream& out) {
+    QScopedPointer<TEngine> engine(new TEngine());
+    engine->SetProgram(program);
+    for (int first=0; first<vectors.size(); first+=TEngine::LANES_COUNT) {
+        const int lanes = qMin(vectors.size() - first, (int)TEngine::LANES_COUNT);
+        engine->Reset(lanes);
+        for (int lane=0; lane<lanes; ++lane)
+            engine->SetInputs(lane, vectors[first + lane]);
+        engine->Run(maxSteps);
+
+        for (int lane=0; lane<lanes; ++lane) {
+            if (engine->LaneState(lane) == TEngine::FAULTED)
+                continue;
+            const int vector = first + lane;
+            const QVector<unsigned int> state = DifferentialLaneState(*engine, lane, program.Length());
+            if ((state == referenceStates[vector]) && referenceErrors[vector].isEmpty())
+                continue;
+            PrintDifference(name, mode, vectors[vector], state, QString(), referenceStates[vector], referenceErrors[vector], out);
+            return EXIT_OUTPUTS_DIFFER;
+        }
+    }
+    return 0;
+}
+
+static QString LoopDetectedMessage() {
+    return QCoreApplication::translate("R8Engine", "Infinite loop detected");
+}
+
+// Runs the program on vectors pseudo-random input vectors (the same ones every
+// time) by the reference interpreter, then by the threaded one, the native
+// code and the threaded one detecting loops, each in one Execute() call and a
+// few steps at a time, then by the lanes of the vector engines; the states
+// they leave and their errors must be equal, but loop detection may stop runs
+// the reference stops at max-steps. Prints the first difference.
+static int CheckProgram(const QString& name, const R8Program& program, unsigned int vectors, unsigned long maxSteps, QTextStream& out) {
+    static const int          MODES_COUNT = 7;
+    static const char *const  sNames[MODES_COUNT]   = {"reference", "threaded", "threaded by 7", "jit", "jit by 7", "loop detection", "loop detection by 7"};
+    static const unsigned int sChunks[MODES_COUNT]  = {0, UINT_MAX, 7, UINT_MAX, 7, UINT_MAX, 7}; //steps per Execute(), 0 - ReferenceStep()
+    static const bool         sIsJit[MODES_COUNT]   = {false, false, false, true, true, false, false};
+    static const bool         sIsDetectingLoops[MODES_COUNT] = {false, false, false, false, false, true, true};
+    static const unsigned char sValues[] = {0x00, 0xFF, 0x01, 0x80, 0x7F}; //zero, all ones and the signs are drawn often
+
+    QVector<QVector<unsigned char> > inputs;
+    quint32 seed = 1;
+    for (unsigned int vector=0; vector<vectors; ++vector) {
+        QVector<unsigned char> values;
+        seed = seed*1103515245u + 12345u;
+        for (int count=(int)((seed >> 16) % 33); count>0; --count) {
+            seed = seed*1103515245u + 12345u;
+            const unsigned int random = seed >> 16;
+            values.append(((random & 7) < 5) ? sValues[random & 7] : (unsigned char)(random >> 3));
+        }
+        inputs.append(values);
+    }
+
+    R8BufferInputPort port;
+    R8BatchEngine     engine;
+    engine.SetInputPort(&port);
+    engine.SetProgram(program);
+
+    QVector<QVector<unsigned int> > referenceStates;
+    QStringList                     referenceErrors;
+    bool isJitChecked = true;
+    for (int vector=0; vector<inputs.size(); ++vector) {
+        port.SetValues(inputs[vector]);
+        for (int mode=0; mode<MODES_COUNT; ++mode) {
+            engine.SetJitEnabled(sIsJit[mode]);
+            engine.SetLoopDetectionEnabled(sIsDetectingLoops[mode]);
+            if (sIsJit[mode] && !engine.IsJitActive()) {
+                isJitChecked = false;
+                continue;
+            }
+
+            port.Rewind();
+            engine.Reset();
+            unsigned long steps = 0;
+            QString error;
+            try {
+                while (!engine.IsHalted() && (steps < maxSteps)) {
+                    if (sChunks[mode] == 0) {
+                        engine.ReferenceStep();
+                        ++steps;
+                    } else
+                        steps += engine.Execute((unsigned int)qMin<unsigned long>(maxSteps - steps, sChunks[mode]));
+                }
+            } catch (const R8Exception& ex) {
+                error = ex.Message();
+                steps = 0; //of an Execute() call that threw is not known
+            }
+
+            const QVector<unsigned int> state = DifferentialState(engine, port, steps);
+            if (mode == 0) {
+                referenceStates.append(state);
+                referenceErrors.append(error);
+                continue;
+            }
+            if ((state == referenceStates[vector]) && (error == referenceErrors[vector]))
+                continue;
+            if (sIsDetectingLoops[mode] && (error == LoopDetectedMessage()) && referenceErrors[vector].isEmpty()
+                    && (referenceStates[vector][2] == maxSteps)) //steps: the reference did not halt
+                continue;
+
+            PrintDifference(name, sNames[mode], inputs[vector], state, error, referenceStates[vector], referenceErrors[vector], out);
+            return EXIT_OUTPUTS_DIFFER;
+        }
+    }
+
+    if ((CheckLanes<R8VectorEngine>(name, "vector", program, inputs, referenceStates, referenceErrors, maxSteps, out) != 0)
+            || (CheckLanes<R8BitslicedEngine>(name, "bitsliced", program, inputs, referenceStates, referenceErrors, maxSteps, out) != 0))
+        return EXIT_OUTPUTS_DIFFER;
+
+    out << name << ": " << vectors << " runs, engines agree" << (isJitChecked ? "" : " (no native code on this host)") << "\n";
+    return 0;
+}
+
+// A program built into r8run (see r8staticassembler.h); -f checks that
+// R8Compiler compiles its source to the same instructions
+static constexpr char sSyntaxSource[] =
+    "; the syntax of R8Compiler\n"
+    "    IN r0\n"
+    "    in [0x10]\n"
+    "    In [R3]\n"
+    "    and r0, 0o7, r1        ;up to 7 times\n"
+    "loop:\n"
+    "    jz r1, done\n"
+    "    out [r3]\n"
+    "    sub r1, +1, r1\n"
+    "    jz 0, LOOP             ;labels ignore case\n"
+    "done:\n"
+    "    add [0x10], 0x20, [0x30] ;three 8-bit values: a wide instruction\n"
+    "    nor [r1], [r2], [r3]\n"
+    "    nand 017, -1, r2\n"
+    "    xor r2, 0b1010, [r2]\n"
+    "    ror 0xFF, 3, [5]\n"
+    "    rol r2, 09, r2\n"
+    "    not [0x40], [0x41]\n"
+    "    jo [0x30], over\n"
+    "    out [0x30]\n"
+    "over: OUT 0\n";
+static constexpr auto sSyntaxProgram = R8_ASSEMBLE(sSyntaxSource);
+
+// Halts by running off the end or by a jump to it; neither is a step
+static constexpr char sEndSource[] =
+    "    in r0\n"
+    "    add r0, 1, r1\n"
+    "    jz r1, end\n"
+    "    out r1\n"
+    "end:\n";
+static constexpr auto sEndProgram = R8_ASSEMBLE(sEndSource);
+
+// Loops forever writing registers and memory; -l must stop it
+static constexpr char sLoopSource[] =
+    "    in r0\n"
+    "loop:\n"
+    "    add r1, 1, r1\n"
+    "    xor [r1], r0, [r1]\n"
+    "    jz 0, loop\n";
+static constexpr auto sLoopProgram = R8_ASSEMBLE(sLoopSource);
+
+#ifdef R8_CHECK_STATIC_SYNTAX_ERROR //"make check": r8run.cpp must not compile with it
+static constexpr auto sSyntaxErrorProgram = R8_ASSEMBLE("    add r1, r9, r2\n");
+#endif
+
+// Variant 0 has every command but nand and nor, which no variant has together
+// with both jumps; the sources are correct, so they throw no errors
+static R8Program CompileWithAllCommands(const QString& source) {
+    R8StringCharStream charStream(source);
+    R8CommandSet       commandSet;
+    R8Compiler         compiler;
+    commandSet.ApplyTo(compiler);
+    compiler.SetAvailableCommand("NAND", R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::NAND_OPCODE));
+    compiler.SetAvailableCommand("NOR", R8CommandDescriptor(R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::NOR_OPCODE));
+    compiler.SetSource(&charStream);
+    compiler.Compile();
+    return compiler.CompiledCode();
+}
+
+static bool IsSameReference(const R8Reference& a, const R8Reference& b) {
+    return (a.AccessType() == b.AccessType()) && (a.Value() == b.Value());
+}
+
+// The first ip where the programs differ, -1 if they are equal; the words may
+// differ as wide instructions may be in another order
+static int FirstDifference(const R8Program& program, const R8Program& expected) {
+    for (int ip=0; ip<qMax(program.Length(), expected.Length()); ++ip) {
+        R8Instruction instruction = program.Instruction(ip);
+        R8Instruction expectedInstruction = expected.Instruction(ip);
+        if ((ip >= program.Length()) || (ip >= expected.Length()) || (instruction.Opcode() != expectedInstruction.Opcode())
+                || !IsSameReference(instruction.Operand1(), expectedInstruction.Operand1())
+                || !IsSameReference(instruction.Operand2(), expectedInstruction.Operand2())
+                || !IsSameReference(instruction.Result(), expectedInstruction.Result()))
+            return ip;
+    }
+    return -1;
+}
+
+// Loop detection must stop the program within maxSteps on any input
+static int CheckLoopDetected(const QString& name, const R8Program& program, unsigned long maxSteps, QTextStream& out) {
+    R8BufferInputPort port;
+    R8BatchEngine     engine;
+    engine.SetInputPort(&port);
+    engine.SetProgram(program);
+    engine.SetLoopDetectionEnabled(true);
+
+    for (int value=0; value<256; value+=0x33) {
+        port.SetValues(QVector<unsigned char>(1, (unsigned char)value));
+        engine.Reset();
+        unsigned long steps = 0;
+        QString error;
+        try {
+            while (!engine.IsHalted() && (steps < maxSteps))
+                steps += engine.Execute((unsigned int)qMin<unsigned long>(maxSteps - steps, UINT_MAX));
+        } catch (const R8Exception& ex) {
+            error = ex.Message();
+        }
+        if (error != LoopDetectedMessage()) {
+            out << name << ": no infinite loop detected on in " << value << "\n";
+            return EXIT_OUTPUTS_DIFFER;
+        }
+    }
+    return 0;
+}
+
+// The generated programs, the built in ones, then the given ones
+static int RunDifferential(const QStringList& paths, int variant, unsigned int vectors, unsigned long maxSteps, QTextStream& out, QTextStream& err) {
+    QStringList names;
+    const QStringList sources = DifferentialPrograms(&names);
+    QVector<R8Program> programs;
+    for (int i=0; i<sources.size(); ++i)
+        programs.append(CompileWithAllCommands(sources[i]));
+
+    static const int STATIC_COUNT = 3;
+    const char *const staticNames[STATIC_COUNT]   = {"static syntax", "static end", "static loop"};
+    const char *const staticSources[STATIC_COUNT] = {sSyntaxSource, sEndSource, sLoopSource};
+    const R8Program   staticPrograms[STATIC_COUNT] = {sSyntaxProgram.Program(), sEndProgram.Program(), sLoopProgram.Program()};
+
+    int exitCode = 0;
+    for (int i=0; i<STATIC_COUNT; ++i) {
+        const int ip = FirstDifference(staticPrograms[i], CompileWithAllCommands(staticSources[i]));
+        if (ip >= 0) {
+            out << staticNames[i] << ": R8_ASSEMBLE() differs from R8Compiler at ip " << ip << "\n";
+            exitCode = EXIT_OUTPUTS_DIFFER;
+        }
+        names.append(staticNames[i]);
+        programs.append(staticPrograms[i]);
+    }
+    if (CheckLoopDetected("static loop", sLoopProgram.Program(), maxSteps, out) != 0)
+        exitCode = EXIT_OUTPUTS_DIFFER;
+
+    for (int i=0; i<programs.size() + paths.size(); ++i) {
+        const bool isGiven = (i >= programs.size());
+        const QString name = isGiven ? paths[i - programs.size()] : names[i];
+        R8ObjectFile object;
+        if (isGiven) {
+            const int loadCode = LoadProgram(name, variant, object, err);
+            if (loadCode != 0)
+                return loadCode;
+        }
+
+        if (CheckProgram(name, isGiven ? object.Program() : programs[i], vectors, maxSteps, out) != 0)
+            exitCode = EXIT_OUTPUTS_DIFFER;
+    }
+    return exitCode;
+}
+
+static int LoadState(const QString& path, const R8Program& program, R8State& state, QTextStream& err) {
+    QFile file(path);
+    if (!file.open(QFile::ReadOnly)) {
+        err << path << ": can not open file\n";
+        return EXIT_BAD_USAGE;
+    }
+
+    QDataStream stream(&file);
+    stream >> state;
+    if (stream.status() != QDataStream::Ok) {
+        err << path << ": not an r8 state file\n";
+        return EXIT_BAD_USAGE;
+    }
+    if (state.IP > (unsigned int)program.Length()) {
+        err << path << ": the state does not fit the program\n";
+        return EXIT_BAD_USAGE;
+    }
+    return 0;
+}
+
+static int SaveState(const QString& path, const R8State& state, QTextStream& err) {
+    QFile file(path);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate)) {
+        err << path << ": can not write file\n";
+        return EXIT_BAD_USAGE;
+    }
+
+    QDataStream stream(&file);
+    stream << state;
+    return 0;
+}
+
+static int LoadSuite(const QString& path, R8TestSuite& suite, QTextStream& err) {
+    QFile file(path);
+    if (!file.open(QFile::ReadOnly | QFile::Text)) {
+        err << path << ": can not open file\n";
+        return EXIT_BAD_USAGE;
+    }
+
+    try {
+        suite.Parse(QString::fromUtf8(file.readAll()));
+    } catch (const R8TestSuiteException& ex) {
+        err << path << ":" << (ex.LineNumber() + 1) << ": error: " << ex.Message() << "\n";
+        return EXIT_BAD_USAGE;
+    }
+    return 0;
+}
+
+static int RunTests(const R8Program& program, const R8TestSuite& suite, unsigned long maxSteps, unsigned long maxTime, bool isLoopDetectionEnabled, QTextStream& out) {
+    R8BatchEngine   engine;
+    R8BufferInputPort port;
+    engine.SetInputPort(&port);
+    engine.SetLoopDetectionEnabled(isLoopDetectionEnabled);
+    engine.SetProgram(program);
+
+    int passed = 0;
+    for (int i=0; i<suite.Count(); ++i) {
+        const R8TestResult result = R8Grader::RunTest(engine, port, suite.Test(i), maxSteps, maxTime);
+        out << suite.Test(i).Name << ": ";
+        if (result.IsPassed) {
+            out << "passed";
+            ++passed;
+        } else
+            out << "failed (" << result.Message << ")";
+        out << ", time " << result.Time << "\n";
+    }
+    out << "passed " << passed << " of " << suite.Count() << "\n";
+    return (passed == suite.Count()) ? 0 : EXIT_TESTS_FAILED;
+}
+
+static int Grade(const QString& manifestPath, const QString& cachePath, unsigned long maxSteps, unsigned long maxTime, bool isLoopDetectionEnabled, QTextStream& out, QTextStream& err) {
+    QFile manifestFile(manifestPath);
+    if (!manifestFile.open(QFile::ReadOnly | QFile::Text)) {
+        err << manifestPath << ": can not open file\n";
+        return EXIT_BAD_USAGE;
+    }
+    const QDir baseDir(QFileInfo(manifestPath).absolutePath());
+
+    R8Grader grader;
+    grader.SetMaxSteps(maxSteps);
+    grader.SetMaxTime(maxTime);
+    grader.SetLoopDetectionEnabled(isLoopDetectionEnabled);
+
+    QMap<QString, int> suites; //by path
+    QStringList lines = QString::fromUtf8(manifestFile.readAll()).split('\n');
+    for (int i=0; i<lines.size(); ++i) {
+        QString line = lines[i];
+        if (line.contains(';')) //comment
+            line.truncate(line.indexOf(';'));
+        line = line.simplified();
+        if (line.isEmpty())
+            continue;
+
+        QStringList fields = line.split(' ');
+        bool isOk = (fields.size() == 3);
+        int variant = isOk ? fields[1].toInt(&isOk) : 0;
+        if (!isOk || (variant < 0) || (variant >= R8CommandSet::VARIANTS_COUNT)) {
+            err << manifestPath << ":" << (i + 1) << ": error: \"<program.r8> <variant> <tests>\" expected\n";
+            return EXIT_BAD_USAGE;
+        }
+
+        const QString suitePath = baseDir.filePath(fields[2]);
+        if (!suites.contains(suitePath)) {
+            R8TestSuite suite;
+            if (LoadSuite(suitePath, suite, err) != 0)
+                return EXIT_BAD_USAGE;
+            suites[suitePath] = grader.AddSuite(suite);
+        }
+
+        grader.AddSubmission(baseDir.filePath(fields[0]), variant, suites[suitePath]);
+    }
+
+    R8CompileCache cache;
+    if (!cachePath.isEmpty()) {
+        if (!cache.Load(cachePath)) {
+            err << cachePath << ": not an r8 cache file\n";
+            return EXIT_BAD_USAGE;
+        }
+        grader.SetCompileCache(&cache);
+    }
+
+    grader.Run();
+
+    if (cache.IsChanged() && !cache.Save(cachePath))
+        err << cachePath << ": can not write file\n";
+
+    int exitCode = 0;
+    for (int i=0; i<grader.SubmissionsCount(); ++i) {
+        const R8Submission& submission = grader.Submission(i);
+        if (!submission.CompileError.isEmpty()) {
+            out << submission.Path << ": compile error: " << submission.CompileError << "\n";
+            exitCode = EXIT_TESTS_FAILED;
+            continue;
+        }
+
+        int passed = 0;
+        quint64 time = 0;
+        for (int test=0; test<submission.Results.size(); ++test) {
+            passed += submission.Results[test].IsPassed ? 1 : 0;
+            time += submission.Results[test].Time;
+        }
+        out << submission.Path << ": passed " << passed << " of " << submission.Results.size() << ", time " << time << "\n";
+
+        for (int test=0; test<submission.Results.size(); ++test) {
+            const R8TestResult& result = submission.Results[test];
+            if (!result.IsPassed)
+                out << "  " << grader.Suite(submission.Suite).Test(test).Name << ": " << result.Message << "\n";
+        }
+        if (passed != submission.Results.size())
+            exitCode = EXIT_TESTS_FAILED;
+    }
+    return exitCode;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    int           variant = 0;
+    unsigned long maxSteps = 0;
+    unsigned long maxTime = 0;
+    unsigned int  benchRuns = 0;
+    unsigned int  differentialVectors = 0;
+    int           exhaustiveCount = 0;
+    QString       exhaustiveEngine = "vector";
+    QString       referencePath;
+    QString       manifestPath;
+    QString       cachePath;
+    QString       testsPath;
+    QString       restorePath;
+    QString       savePath;
+    QString       objectPath;
+    bool          isJitEnabled = false;
+    bool          isLoopDetectionEnabled = false;
+    QString       inputPath;
+    QString       dataPath;
+    QString       outputPath;
+    QString       programPath;
+    QStringList   valueArgs;
+
+    QStringList args = QCoreApplication::arguments();
+    for (int i=1; i<args.size(); ++i) {
+        const QString& arg = args[i];
+        bool isOk = true;
+
+        if (!programPath.isEmpty()) {
+            valueArgs.append(arg);
+        } else if ((arg == "-v") && (i + 1 < args.size())) {
+            variant = args[++i].toInt(&isOk);
+            isOk = isOk && (0 <= variant) && (variant < R8CommandSet::VARIANTS_COUNT);
+        } else if ((arg == "-i") && (i + 1 < args.size())) {
+            inputPath = args[++i];
+        } else if ((arg == "-d") && (i + 1 < args.size())) {
+            dataPath = args[++i];
+        } else if ((arg == "-o") && (i + 1 < args.size())) {
+            outputPath = args[++i];
+        } else if ((arg == "-s") && (i + 1 < args.size())) {
+            maxSteps = args[++i].toULong(&isOk);
+        } else if ((arg == "-m") && (i + 1 < args.size())) {
+            maxTime = args[++i].toULong(&isOk);
+        } else if (arg == "-l") {
+            isLoopDetectionEnabled = true;
+        } else if (arg == "-j") {
+            isJitEnabled = true;
+        } else if ((arg == "-b") && (i + 1 < args.size())) {
+            benchRuns = args[++i].toUInt(&isOk);
+            isOk = isOk && (benchRuns != 0);
+        } else if ((arg == "-f") && (i + 1 < args.size())) {
+            differentialVectors = args[++i].toUInt(&isOk);
+            isOk = isOk && (differentialVectors != 0);
+        } else if ((arg == "-x") && (i + 1 < args.size())) {
+            exhaustiveCount = args[++i].toInt(&isOk);
+            isOk = isOk && (1 <= exhaustiveCount) && (exhaustiveCount <= 3);
+        } else if ((arg == "-e") && (i + 1 < args.size())) {
+            exhaustiveEngine = args[++i];
+            isOk = (exhaustiveEngine == "vector") || (exhaustiveEngine == "bitsliced");
+        } else if ((arg == "-c") && (i + 1 < args.size())) {
+            referencePath = args[++i];
+        } else if ((arg == "-r") && (i + 1 < args.size())) {
+            restorePath = args[++i];
+        } else if ((arg == "-w") && (i + 1 < args.size())) {
+            savePath = args[++i];
+        } else if ((arg == "-a") && (i + 1 < args.size())) {
+            objectPath = args[++i];
+        } else if ((arg == "-t") && (i + 1 < args.size())) {
+            testsPath = args[++i];
+        } else if ((arg == "-g") && (i + 1 < args.size())) {
+            manifestPath = args[++i];
+        } else if ((arg == "-k") && (i + 1 < args.size())) {
+            cachePath = args[++i];
+        } else if (!arg.startsWith("-")) {
+            programPath = arg;
+        } else
+            isOk = false;
+
+        if (!isOk) {
+            PrintUsage(err);
+            return EXIT_BAD_USAGE;
+        }
+    }
+
+    if (!manifestPath.isEmpty())
+        return Grade(manifestPath, cachePath, maxSteps, maxTime, isLoopDetectionEnabled, out, err);
+
+    if (differentialVectors != 0) {
+        QStringList paths = valueArgs;
+        if (!programPath.isEmpty())
+            paths.prepend(programPath);
+        return RunDifferential(paths, variant, differentialVectors, (maxSteps != 0) ? maxSteps : DIFFERENTIAL_MAX_STEPS, out, err);
+    }
+
+    if (programPath.isEmpty()) {
+        PrintUsage(err);
+        return EXIT_BAD_USAGE;
+    }
+
+    R8ObjectFile object;
+    int exitCode = LoadProgram(programPath, variant, object, err);
+    if (exitCode != 0)
+        return exitCode;
+
+    if (!objectPath.isEmpty()) {
+        if (!object.Save(objectPath)) {
+            err << objectPath << ": can not write file\n";
+            return EXIT_BAD_USAGE;
+        }
+        return 0;
+    }
+
+    if (!testsPath.isEmpty()) {
+        R8TestSuite suite;
+        exitCode = LoadSuite(testsPath, suite, err);
+        if (exitCode != 0)
+            return exitCode;
+        return RunTests(object.Program(), suite, maxSteps, maxTime, isLoopDetectionEnabled, out);
+    }
+
+    if (exhaustiveCount != 0) {
+        R8ObjectFile referenceObject;
+        if (!referencePath.isEmpty()) {
+            exitCode = LoadProgram(referencePath, variant, referenceObject, err);
+            if (exitCode != 0)
+                return exitCode;
+        }
+        const R8Program *reference = referencePath.isEmpty() ? 0 : &referenceObject.Program();
+
+        if (exhaustiveEngine == "bitsliced")
+            return RunExhaustive<R8BitslicedEngine>(object.Program(), reference, exhaustiveCount, maxSteps, out);
+        return RunExhaustive<R8VectorEngine>(object.Program(), reference, exhaustiveCount, maxSteps, out);
+    }
+
+    R8ValuesInputPort inputPort;
+
+    QVector<unsigned char> values;
+    if (!R8BufferInputPort::ParseValues(valueArgs.join(" "), values)) {
+        err << "bad input values \"" << valueArgs.join(" ") << "\"\n";
+        return EXIT_BAD_USAGE;
+    }
+    inputPort.AddValues(values);
+
+    R8BatchEngine engine;
+    engine.SetInputPort(&inputPort);
+    engine.SetProgram(object.Program());
+    engine.SetJitEnabled(isJitEnabled);
+    engine.SetLoopDetectionEnabled(isLoopDetectionEnabled);
+
+    if (benchRuns != 0) {
+        try {
+            return RunBenchmark(engine, inputPort, benchRuns, out, err);
+        } catch (const R8Exception& ex) {
+            err << "execution error: \"" << ex.Message() << "\" at line " << (object.SourceLineForIp(engine.IP()) + 1) << "\n";
+            return EXIT_RUNTIME_ERROR;
+        }
+    }
+
+    R8MappedInputPort dataPort;
+    R8InputPort *port = &inputPort;
+    QFile inputFile;
+    if (!dataPath.isEmpty()) {
+        if (!dataPort.Open(dataPath)) {
+            err << dataPath << ": can not open file\n";
+            return EXIT_BAD_USAGE;
+        }
+        port = &dataPort;
+        engine.SetInputPort(port);
+    } else if (inputPath.isEmpty() || (inputPath == "-")) {
+        inputFile.open(stdin, QFile::ReadOnly | QFile::Text);
+    } else {
+        inputFile.setFileName(inputPath);
+        if (!inputFile.open(QFile::ReadOnly | QFile::Text)) {
+            err << inputPath << ": can not open file\n";
+            return EXIT_BAD_USAGE;
+        }
+    }
+    QTextStream inputStream(&inputFile);
+    inputPort.SetStream(&inputStream);
+
+    QFile outputFile;
+    QScopedPointer<R8DeviceOutputPort> outputPort;
+    if (!outputPath.isEmpty()) {
+        outputFile.setFileName(outputPath);
+        if (!outputFile.open(QFile::WriteOnly | QFile::Truncate)) {
+            err << outputPath << ": can not write file\n";
+            return EXIT_BAD_USAGE;
+        }
+        outputPort.reset(new R8DeviceOutputPort(&outputFile));
+        engine.SetOutputPort(outputPort.data());
+    }
+
+    if (!restorePath.isEmpty()) {
+        R8State state;
+        exitCode = LoadState(restorePath, object.Program(), state, err);
+        if (exitCode != 0)
+            return exitCode;
+        engine.Restore(state);
+    }
+
+    try {
+        switch (engine.Run(maxSteps, maxTime)) {
+        case R8BatchEngine::STEPS_EXCEEDED_STATUS:
+            err << "execution stopped after " << maxSteps << " steps at line " << (object.SourceLineForIp(engine.IP()) + 1) << "\n";
+            exitCode = EXIT_STEPS_EXCEEDED;
+            break;
+        case R8BatchEngine::TIME_EXCEEDED_STATUS:
+            err << "execution stopped after " << maxTime << " clocks at line " << (object.SourceLineForIp(engine.IP()) + 1) << "\n";
+            exitCode = EXIT_STEPS_EXCEEDED;
+            break;
+        case R8BatchEngine::INPUT_NEEDED_STATUS: //-d values are over
+            err << "execution stopped: no more input values at line " << (object.SourceLineForIp(engine.IP()) + 1) << "\n";
+            exitCode = EXIT_INPUT_EXHAUSTED;
+            break;
+        default:
+            break;
+        }
+    } catch (const R8Exception& ex) {
+        err << "execution error: \"" << ex.Message() << "\" at line " << (object.SourceLineForIp(engine.IP()) + 1) << "\n";
+        exitCode = EXIT_RUNTIME_ERROR;
+    }
+
+    if ((exitCode == 0) && port->IsFailure()) {
+        err << "execution halted: no more input values\n";
+        exitCode = EXIT_INPUT_EXHAUSTED;
+    }
+
+    if (!outputPort.isNull()) {
+        outputPort->Flush();
+        if (outputPort->IsFailure()) {
+            err << outputPath << ": can not write file\n";
+            return EXIT_BAD_USAGE;
+        }
+    }
+
+    const QVector<unsigned char>& outputs = engine.Outputs(); //empty with -o
+    for (int i=0; i<outputs.size(); ++i)
+        out << "out " << (unsigned int)outputs[i] << "\n";
+
+    out << "time " << engine.ExecutionTime() << "\n";
+
+    if (!savePath.isEmpty()) {
+        R8State state;
+        engine.Snapshot(&state);
+        if (SaveState(savePath, state, err) != 0)
+            return EXIT_BAD_USAGE;
+    }
+    return exitCode;
+}
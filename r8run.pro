@@ -0,0 +1,28 @@
+#-------------------------------------------------
+#
+# Headless R8 runner (no QtWidgets, no QApplication)
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = r8run
+TEMPLATE = app
+
+CONFIG   += console
+CONFIG   -= app_bundle
+
+OBJECTS_DIR = .obj/r8run
+MOC_DIR     = .moc/r8run
+
+include(r8core.pri)
+
+SOURCES += r8run.cpp
+
+# "make check": the differential check of the engines, then a syntax error of
+# R8_ASSEMBLE() that must fail the build of r8run.cpp
+check.depends  = $(TARGET)
+check.commands = ./$(TARGET) -f 100 $$PWD/scripts/*.r8 && \
+                 ! $(CXX) -c $(CXXFLAGS) $(DEFINES) -DR8_CHECK_STATIC_SYNTAX_ERROR $(INCPATH) -o /dev/null $$PWD/r8run.cpp 2> /dev/null
+QMAKE_EXTRA_TARGETS += check
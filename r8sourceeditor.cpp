@@ -111,16 +111,6 @@ void R8SourceEditor::ClearAllBreakpoints() {
     }
 }
 
-bool R8SourceEditor::IsBreakointBetweenLines(int startLine, int endLine) const {
-    QListIterator<int> it(mBreakpoints);
-    while (it.hasNext()) {
-        int line = it.next();
-        if ((startLine <= line) && (line <= endLine))
-            return true;
-    }
-    return false;
-}
-
 void R8SourceEditor::ShiftStateTo(R8SourceEditor::EState state) {
      mState = state;
      mLineNumberArea->repaint();
@@ -234,56 +224,3 @@ void R8SourceEditor::lineNumberAreaPaintEvent(QPaintEvent *event) {
         ++blockNumber;
     }
 }
-
-void R8SourceEditorCharStream::SetSourceTextBlock(const QTextBlock& block){
-    mTextBlock = block;
-
-    while (mTextBlock.isValid()) {
-        if (mTextBlock.blockNumber() == 0)
-            break;
-        mTextBlock = mTextBlock.previous();
-    }
-
-    if (mTextBlock.isValid()) {
-        mCurrentCharIndex = 0;
-        mCurrentLine = mTextBlock.text();
-    } else {
-        mCurrentCharIndex = 1;
-        mCurrentLine.clear();
-    }
-}
-
-QChar R8SourceEditorCharStream::CurrentChar() const {
-    if (IsValidCurrentChar()) {
-        if (mCurrentCharIndex >= mCurrentLine.length())
-            return QChar('\n');
-        return mCurrentLine[mCurrentCharIndex];
-    }
-    return QChar(' ');
-}
-
-void R8SourceEditorCharStream::GoToNextChar() {
-    if (IsValidCurrentChar())
-        ++mCurrentCharIndex;
-
-    if (!IsValidCurrentChar()) {
-        if (mTextBlock.isValid()) {
-            mTextBlock = mTextBlock.next();
-            if (mTextBlock.isValid()) {
-                mCurrentLine = mTextBlock.text();
-                mCurrentCharIndex = 0;
-            }
-        }
-    }
-}
-
-bool R8SourceEditorCharStream::IsValidCurrentChar() const {
-    return (mCurrentCharIndex <= mCurrentLine.length());
-}
-
-int R8SourceEditorCharStream::CurrentLine() const {
-    if (IsValidCurrentChar())
-        return mTextBlock.blockNumber();
-    return -1;
-}
-
@@ -8,8 +8,6 @@
 
 #include "r8syntaxhighlighter.h"
 
-#include "r8charstream.h"
-
 class QPaintEvent;
 class QResizeEvent;
 class QSize;
@@ -40,7 +38,7 @@ public:
     void ClearAllBreakpoints();
 
     bool IsBreakedLine(int line) const {return mBreakpoints.contains(line); }
-    bool IsBreakointBetweenLines(int start, int end) const;
+    const QList<int>& Breakpoints() const {return mBreakpoints;}
 
     void ShiftStateTo(EState state);
     bool IsStateIs(EState state) const {return (State() == state);}
@@ -85,21 +83,4 @@ private:
     R8SourceEditor *mSourceEditor;
 };
 
-class R8SourceEditorCharStream : public R8CharStream {
-public:
-    R8SourceEditorCharStream() {mCurrentCharIndex = 1;}
-
-    void SetSourceTextBlock(const QTextBlock& block);
-
-    virtual QChar CurrentChar() const;
-    virtual void  GoToNextChar();
-    virtual bool  IsValidCurrentChar() const;
-    virtual int   CurrentLine() const;
-
-private:
-    QTextBlock mTextBlock;
-    QString    mCurrentLine;
-    int        mCurrentCharIndex;
-};
-
 #endif // R8SOURCEEDITOR_H
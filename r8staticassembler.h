@@ -0,0 +1,416 @@
+#ifndef R8STATICASSEMBLER_H
+#define R8STATICASSEMBLER_H
+
+#include <array>
+
+#include <QByteArray>
+#include <QtGlobal>
+
+#include "r8compiler.h"
+
+// A program assembled by R8_ASSEMBLE() while the C++ source is compiled: the
+// words of R8Program in host byte order (see r8engine.cpp). Program() views
+// them, so nothing is lexed, compiled or copied at startup; the words must
+// outlive the program and its copies, so keep the R8StaticProgram static.
+template<int LENGTH, int WIDE_LENGTH>
+struct R8StaticProgram {
+    std::array<quint32, LENGTH>                            Words;
+    std::array<quint32, WIDE_LENGTH*R8Program::WIDE_WORDS> WideWords;
+
+    R8Program Program() const {
+        R8Program program;
+        const bool isProgram = R8Program::FromWords(QByteArray::fromRawData(reinterpret_cast<const char*>(Words.data()), LENGTH*sizeof(quint32)),
+                                                    QByteArray::fromRawData(reinterpret_cast<const char*>(WideWords.data()), WideWords.size()*sizeof(quint32)),
+                                                    &program);
+        Q_ASSERT(isProgram);
+        Q_UNUSED(isProgram);
+        return program;
+    }
+};
+
+// The assembler of R8_ASSEMBLE(): the syntax of R8Compiler (numbers with the
+// 0x, 0o, 0b and 0 prefixes, labels, [rX] and [constant] references, ";"
+// comments) and the commands of every command set variant, nand and nor
+// included; "include" is not allowed. It runs in constant expressions only, so
+// an error stops the build at a call of the function named after it, e.g.
+// "call to non-'constexpr' function 'static void
+// R8StaticAssembler::CommaExpected(int)'", below the constexpr expansion of the
+// source. Labels are looked up by scanning the source, which is fine for the
+// programs of a few hundred lines this is meant for.
+class R8StaticAssembler {
+public:
+    template<int N> static constexpr int Length(const char (&source)[N])     {return Run(source, N - 1, 0, 0).Length;}
+    template<int N> static constexpr int WideLength(const char (&source)[N]) {return Run(source, N - 1, 0, 0).WideLength;}
+
+    template<int LENGTH, int WIDE_LENGTH, int N>
+    static constexpr R8StaticProgram<LENGTH, WIDE_LENGTH> Assemble(const char (&source)[N]) {
+        R8StaticProgram<LENGTH, WIDE_LENGTH> program = {};
+        Run(source, N - 1, program.Words.data(), program.WideWords.data());
+        return program;
+    }
+
+private:
+    struct TToken {
+        R8Token::EType Type;
+        int            Begin;
+        int            End;    //of the token, where the next one is scanned from
+        int            Line;   //from 0, as R8Compiler counts
+        unsigned char  Value;
+    };
+
+    struct TReference {
+        R8Reference::EAccessType AccessType;
+        quint32                  Value;
+    };
+
+    struct TCommand {
+        const char                *Name;   //folded
+        R8CommandDescriptor::EType Type;
+        R8Instruction::EOpcode     Opcode;
+    };
+
+    struct TResult {
+        int Length;
+        int WideLength;
+    };
+
+    static constexpr TCommand COMMANDS[] = {
+        {"IN",   R8CommandDescriptor::ARGS_DST,         R8Instruction::IN_OPCODE},
+        {"OUT",  R8CommandDescriptor::ARGS_SRC,         R8Instruction::OUT_OPCODE},
+        {"ROR",  R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::ROR_OPCODE},
+        {"ROL",  R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::ROL_OPCODE},
+        {"NOT",  R8CommandDescriptor::ARGS_SRC_DST,     R8Instruction::NOT_OPCODE},
+        {"OR",   R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::OR_OPCODE},
+        {"AND",  R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::AND_OPCODE},
+        {"NOR",  R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::NOR_OPCODE},
+        {"NAND", R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::NAND_OPCODE},
+        {"XOR",  R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::XOR_OPCODE},
+        {"ADD",  R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::ADD_OPCODE},
+        {"SUB",  R8CommandDescriptor::ARGS_SRC_SRC_DST, R8Instruction::SUB_OPCODE},
+        {"JZ",   R8CommandDescriptor::ARGS_SRC_LABEL,   R8Instruction::JZ_OPCODE},
+        {"JO",   R8CommandDescriptor::ARGS_SRC_LABEL,   R8Instruction::JO_OPCODE}
+    };
+    static constexpr int COMMANDS_COUNT = sizeof(COMMANDS)/sizeof(COMMANDS[0]);
+
+    // The errors of R8LexerException and R8CompilerException; the line is from 1
+    static void UnknownToken(int line)      {Q_UNUSED(line);}
+    static void BadExpression(int line)     {Q_UNUSED(line);}
+    static void UnresolvedLabel(int line)   {Q_UNUSED(line);}
+    static void CommaExpected(int line)     {Q_UNUSED(line);}
+    static void LabelRedefinition(int line) {Q_UNUSED(line);}
+    static void UndefinedCommand(int line)  {Q_UNUSED(line);}
+    static void BadReference(int line)      {Q_UNUSED(line);}
+    static void ReferenceExpected(int line) {Q_UNUSED(line);}
+    static void RbraceExpected(int line)    {Q_UNUSED(line);}
+    static void LabelExpected(int line)     {Q_UNUSED(line);}
+    static void RegisterExpected(int line)  {Q_UNUSED(line);}
+    static void IncludeNotAllowed(int line) {Q_UNUSED(line);}
+
+    static constexpr char Fold(char ch) {return ((ch >= 'a') && (ch <= 'z')) ? (char)(ch - 'a' + 'A') : ch;}
+    static constexpr bool IsIdentifierChar(char ch, bool isFirst) {
+        return ((ch >= 'a') && (ch <= 'z')) || ((ch >= 'A') && (ch <= 'Z')) || (ch == '_') || (!isFirst && (ch >= '0') && (ch <= '9'));
+    }
+    static constexpr int Digit(char ch, int base) { //-1 if it is not a digit of the base
+        const int digit = ((ch >= '0') && (ch <= '9')) ? (ch - '0')
+                        : ((ch >= 'a') && (ch <= 'z')) ? (ch - 'a' + 10)
+                        : ((ch >= 'A') && (ch <= 'Z')) ? (ch - 'A' + 10) : 99;
+        return (digit < base) ? digit : -1;
+    }
+
+    static constexpr bool IsName(const char *text, const TToken& token, const char *folded) {
+        int i = 0;
+        for (; folded[i] != 0; ++i) {
+            if ((token.Begin + i == token.End) || (Fold(text[token.Begin + i]) != folded[i]))
+                return false;
+        }
+        return (token.Begin + i == token.End);
+    }
+
+    static constexpr bool IsSameName(const char *text, const TToken& a, const TToken& b) {
+        if (a.End - a.Begin != b.End - b.Begin)
+            return false;
+        for (int i=0; i<a.End - a.Begin; ++i) {
+            if (Fold(text[a.Begin + i]) != Fold(text[b.Begin + i]))
+                return false;
+        }
+        return true;
+    }
+
+    // As R8Lexer::GetConstantToken()
+    static constexpr TToken Number(const char *text, int size, int at, int line) {
+        TToken token = {R8Token::NUMBER, at, at, line, 0};
+        bool isNegative = (text[at] == '-');
+        if ((text[at] == '-') || (text[at] == '+'))
+            ++at;
+        if (at == size) {
+            token.Type = R8Token::END_OF_SOURCE;
+            token.End  = at;
+            return token;
+        }
+
+        int base = 10;
+        if (text[at] == '0') {
+            ++at;
+            if (at == size) {
+                token.End = at;
+                return token;
+            }
+            if ((text[at] == 'b') || (text[at] == 'o') || (text[at] == 'x')) {
+                base = (text[at] == 'b') ? 2 : (text[at] == 'o') ? 8 : 16;
+                ++at;
+            } else if ((text[at] >= '0') && (text[at] <= '7'))
+                base = 8;
+        }
+
+        unsigned int value = 0; //modulo 2^32, so its low byte is right for any length
+        for (; (at < size) && (Digit(text[at], base) >= 0); ++at)
+            value = value*base + Digit(text[at], base);
+        token.Value = (unsigned char)(isNegative ? (0u - value) : value);
+        token.End   = at;
+        return token;
+    }
+
+    // The token at or after at, as R8Lexer::NextToken() scans it
+    static constexpr TToken Next(const char *text, int size, int at, int line) {
+        for (;;) {
+            for (; at<size; ++at) {
+                if (text[at] == '\n')
+                    ++line;
+                else if ((text[at] != ' ') && (text[at] != '\t') && (text[at] != '\r'))
+                    break;
+            }
+            TToken token = {R8Token::END_OF_SOURCE, at, at, line, 0};
+            if (at == size)
+                return token;
+
+            const char ch = text[at];
+            if (ch == ';') {
+                while ((at < size) && (text[at] != '\n'))
+                    ++at;
+                continue;
+            }
+
+            token.End = at + 1;
+            if (ch == ',') {
+                token.Type = R8Token::COMMA;
+            } else if (ch == ':') {
+                token.Type = R8Token::COLON;
+            } else if (ch == '[') {
+                token.Type = R8Token::LEFT_SBRACE;
+            } else if (ch == ']') {
+                token.Type = R8Token::RIGHT_SBRACE;
+            } else if (((ch >= '0') && (ch <= '9')) || (ch == '-') || (ch == '+')) {
+                return Number(text, size, at, line);
+            } else if (IsIdentifierChar(ch, true)) {
+                token.Type = R8Token::IDENTIFIER;
+                while ((token.End < size) && IsIdentifierChar(text[token.End], false))
+                    ++token.End;
+            } else {
+                UnknownToken(line + 1);
+                token.Type = R8Token::MISPRINT;
+            }
+            return token;
+        }
+    }
+
+    static constexpr int CommandIndex(const char *text, const TToken& token) { //COMMANDS_COUNT if it is none
+        int command = 0;
+        while ((command < COMMANDS_COUNT) && !IsName(text, token, COMMANDS[command].Name))
+            ++command;
+        return command;
+    }
+
+    static constexpr int OperandsCount(R8CommandDescriptor::EType type) {
+        return (type == R8CommandDescriptor::ARGS_SRC_SRC_DST) ? 3
+             : ((type == R8CommandDescriptor::ARGS_SRC_DST) || (type == R8CommandDescriptor::ARGS_SRC_LABEL)) ? 2 : 1;
+    }
+
+    // The ip of the label: the commands before its definition, -1 if there is
+    // none. Operands are skipped by their tokens; a source they do not fit
+    // fails in Run() anyway.
+    static constexpr int LabelIp(const char *text, int size, const TToken& label) {
+        int ip = -1;
+        int commands = 0;
+        TToken token = Next(text, size, 0, 0);
+        while (token.Type != R8Token::END_OF_SOURCE) {
+            const TToken next = Next(text, size, token.End, token.Line);
+            if ((token.Type == R8Token::IDENTIFIER) && (next.Type == R8Token::COLON)) {
+                if (IsSameName(text, token, label)) {
+                    if (ip >= 0)
+                        LabelRedefinition(token.Line + 1);
+                    ip = commands;
+                }
+                token = Next(text, size, next.End, next.Line);
+                continue;
+            }
+
+            const int command = (token.Type == R8Token::IDENTIFIER) ? CommandIndex(text, token) : COMMANDS_COUNT;
+            token = next;
+            if (command == COMMANDS_COUNT)
+                continue;
+            ++commands;
+            for (int operand=0; operand<OperandsCount(COMMANDS[command].Type); ++operand) {
+                if ((operand > 0) && (token.Type == R8Token::COMMA))
+                    token = Next(text, size, token.End, token.Line);
+                for (int tokens=(token.Type == R8Token::LEFT_SBRACE) ? 3 : 1; (tokens > 0) && (token.Type != R8Token::END_OF_SOURCE); --tokens)
+                    token = Next(text, size, token.End, token.Line);
+            }
+        }
+        return ip;
+    }
+
+    static constexpr int RegisterIndex(const char *text, const TToken& token) {
+        if ((token.End - token.Begin == 2) && (Fold(text[token.Begin]) == 'R') && (text[token.Begin + 1] >= '0') && (text[token.Begin + 1] <= '7'))
+            return text[token.Begin + 1] - '0';
+        RegisterExpected(token.Line + 1);
+        return 0;
+    }
+
+    // As R8Compiler::CompileSrcReference() and CompileDstReference(); token goes past the reference
+    static constexpr TReference Reference(const char *text, int size, TToken& token, bool isSource) {
+        TReference reference = {R8Reference::CONSTANT, 0};
+        if (token.Type == R8Token::IDENTIFIER) {
+            reference.AccessType = R8Reference::REGISTER;
+            reference.Value      = RegisterIndex(text, token);
+        } else if (isSource && (token.Type == R8Token::NUMBER)) {
+            reference.Value = token.Value;
+        } else if (token.Type == R8Token::LEFT_SBRACE) {
+            token = Next(text, size, token.End, token.Line);
+            if (token.Type == R8Token::IDENTIFIER) {
+                reference.AccessType = R8Reference::MEMORY_BY_REGISTER;
+                reference.Value      = RegisterIndex(text, token);
+            } else if (token.Type == R8Token::NUMBER) {
+                reference.AccessType = R8Reference::MEMORY_BY_CONSTANT;
+                reference.Value      = token.Value;
+            } else
+                BadReference(token.Line + 1);
+
+            token = Next(text, size, token.End, token.Line);
+            if (token.Type != R8Token::RIGHT_SBRACE)
+                RbraceExpected(token.Line + 1);
+        } else
+            ReferenceExpected(token.Line + 1);
+
+        token = Next(text, size, token.End, token.Line);
+        return reference;
+    }
+
+    static constexpr void SkipComma(const char *text, int size, TToken& token) {
+        if (token.Type != R8Token::COMMA)
+            CommaExpected(token.Line + 1);
+        token = Next(text, size, token.End, token.Line);
+    }
+
+    static constexpr bool IsJump(quint32 opcode) {return (opcode == R8Instruction::JZ_OPCODE) || (opcode == R8Instruction::JO_OPCODE);}
+
+    // As R8Program::Pack()
+    static constexpr bool Pack(quint32 opcode, const TReference *operands, quint32 *word) {
+        const bool isSame = (operands[1].AccessType == operands[0].AccessType) && (operands[1].Value == operands[0].Value);
+        const bool hasOperand[3] = {(opcode != R8Instruction::IN_OPCODE), (opcode != R8Instruction::IN_OPCODE) && (opcode != R8Instruction::OUT_OPCODE) && (opcode != R8Instruction::NOT_OPCODE) && !IsJump(opcode), (opcode != R8Instruction::OUT_OPCODE)};
+
+        quint32 modes[3] = {0, isSame ? R8Program::SAME_OPERAND : 0, 0};
+        quint32 packed = opcode;
+        int bit = R8Program::FIRST_VALUE_BIT;
+        for (int i=0; i<3; ++i) {
+            if (((i == 1) && isSame) || !hasOperand[i])
+                continue;
+
+            int bits = 32 - bit;
+            if (!IsJump(opcode) || (i != 2)) {
+                modes[i] = (i == 2) ? (operands[i].AccessType - R8Reference::REGISTER) : operands[i].AccessType;
+                bits = ((operands[i].AccessType == R8Reference::REGISTER) || (operands[i].AccessType == R8Reference::MEMORY_BY_REGISTER)) ? 3 : 8;
+            }
+            if ((bit + bits > 32) || (((quint64)operands[i].Value >> bits) != 0))
+                return false;
+            packed |= operands[i].Value << bit;
+            bit += bits;
+        }
+        *word = packed | ((modes[0] + 4*(modes[1] + 5*modes[2])) << 4);
+        return true;
+    }
+
+    // As R8Compiler::Compile() then R8Program::AddInstruction(); without words
+    // it only counts them
+    static constexpr TResult Run(const char *text, int size, quint32 *words, quint32 *wideWords) {
+        TResult result = {0, 0};
+        TToken token = Next(text, size, 0, 0);
+        while (token.Type != R8Token::END_OF_SOURCE) {
+            if (token.Type != R8Token::IDENTIFIER) {
+                BadExpression(token.Line + 1);
+                break;
+            }
+            const TToken name = token;
+            token = Next(text, size, token.End, token.Line);
+            if (token.Type == R8Token::COLON) {
+                LabelIp(text, size, name); //a redefinition fails
+                token = Next(text, size, token.End, token.Line);
+                continue;
+            }
+            if (IsName(text, name, "INCLUDE"))
+                IncludeNotAllowed(name.Line + 1);
+
+            const int command = CommandIndex(text, name);
+            if (command == COMMANDS_COUNT) {
+                UndefinedCommand(name.Line + 1);
+                break;
+            }
+
+            TReference operands[3] = {{R8Reference::CONSTANT, 0}, {R8Reference::CONSTANT, 0}, {R8Reference::CONSTANT, 0}};
+            const R8CommandDescriptor::EType type = COMMANDS[command].Type;
+            if (type == R8CommandDescriptor::ARGS_DST) {
+                operands[2] = Reference(text, size, token, false);
+            } else {
+                operands[0] = Reference(text, size, token, true);
+                operands[1] = operands[0];
+                if (type == R8CommandDescriptor::ARGS_SRC_SRC_DST) {
+                    SkipComma(text, size, token);
+                    operands[1] = Reference(text, size, token, true);
+                }
+                if (type == R8CommandDescriptor::ARGS_SRC_LABEL) {
+                    SkipComma(text, size, token);
+                    if (token.Type != R8Token::IDENTIFIER)
+                        LabelExpected(token.Line + 1);
+                    const int ip = LabelIp(text, size, token);
+                    if (ip < 0)
+                        UnresolvedLabel(token.Line + 1);
+                    operands[2].AccessType = R8Reference::INSTRUCTION_INDEX;
+                    operands[2].Value      = ip;
+                    token = Next(text, size, token.End, token.Line);
+                } else if (type != R8CommandDescriptor::ARGS_SRC) {
+                    SkipComma(text, size, token);
+                    operands[2] = Reference(text, size, token, false);
+                }
+            }
+
+            const quint32 opcode = COMMANDS[command].Opcode;
+            quint32 word = 0;
+            if (!Pack(opcode, operands, &word)) {
+                if (wideWords != 0) {
+                    quint32 *wide = wideWords + result.WideLength*R8Program::WIDE_WORDS;
+                    wide[0] = opcode | ((quint32)operands[0].AccessType << 8) | ((quint32)operands[1].AccessType << 16) | ((quint32)operands[2].AccessType << 24);
+                    wide[1] = operands[0].Value;
+                    wide[2] = operands[1].Value;
+                    wide[3] = operands[2].Value;
+                }
+                word = R8Program::WIDE_OPCODE | ((quint32)result.WideLength << 4);
+                ++result.WideLength;
+            }
+            if (words != 0)
+                words[result.Length] = word;
+            ++result.Length;
+        }
+        return result;
+    }
+};
+
+// The R8StaticProgram of a string literal, assembled while the C++ source is
+// compiled (a constexpr variable forces it even where the result is not one):
+//   static constexpr auto sEcho = R8_ASSEMBLE("loop: in r0\n out r0\n jz 0, loop\n");
+//   engine.SetProgram(sEcho.Program());
+#define R8_ASSEMBLE(source) \
+    ([]() { \
+        constexpr auto program = R8StaticAssembler::Assemble<R8StaticAssembler::Length(source), R8StaticAssembler::WideLength(source)>(source); \
+        return program; \
+    }())
+
+#endif // R8STATICASSEMBLER_H
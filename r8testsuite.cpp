@@ -0,0 +1,219 @@
+#include "r8testsuite.h"
+
+#include "r8charstream.h"
+#include "r8lexer.h"
+
+// Tokens of test scripts; numbers are read by R8Lexer from the same stream, so
+// they are written as in programs (0xF4, 0b0101, -1...)
+class R8TestScriptReader {
+public:
+    enum EToken {
+        WORD,
+        NUMBER,
+        STRING,      //"...", without the quotes
+        LEFT_BRACE,
+        RIGHT_BRACE,
+        SEMICOLON,
+        END_OF_SCRIPT
+    };
+
+    explicit R8TestScriptReader(R8CharStream *charStream);
+
+    void NextToken();
+
+    EToken         Token() const {return mToken;}
+    const QString& TokenString() const {return mTokenString;}
+    unsigned char  Value() const {return mValue;}
+    int            Line() const {return mLine;}
+
+    void Expect(EToken token, const QString& what) const;
+
+private:
+    R8CharStream  *mCharStream;
+    R8Lexer        mLexer;
+    EToken         mToken;
+    QString        mTokenString;
+    unsigned char  mValue;
+    int            mLine;
+
+    void SkipSpacesAndComments();
+    void ReadString();
+    void ReadWord();
+};
+
+R8TestScriptReader::R8TestScriptReader(R8CharStream *charStream) :
+    mCharStream(charStream),mToken(END_OF_SCRIPT),mValue(0),mLine(0) {
+    mLexer.SetSource(charStream);
+}
+
+void R8TestScriptReader::Expect(EToken token, const QString &what) const {
+    if (mToken != token)
+        throw R8TestSuiteException(mLine, QString("%1 expected instead \"%2\"").arg(what).arg(mTokenString));
+}
+
+void R8TestScriptReader::SkipSpacesAndComments() {
+    while (mCharStream->IsValidCurrentChar()) {
+        QChar ch = mCharStream->CurrentChar();
+        if (ch.isSpace()) {
+            mCharStream->GoToNextChar();
+        } else if (ch == QChar('/')) { //"//" up to the end of line
+            mCharStream->GoToNextChar();
+            if (!mCharStream->IsValidCurrentChar() || (mCharStream->CurrentChar() != QChar('/')))
+                throw R8TestSuiteException(mCharStream->CurrentLine(), QString("unknown token \"/\""));
+            while (mCharStream->IsValidCurrentChar() && (mCharStream->CurrentChar() != QChar('\n')))
+                mCharStream->GoToNextChar();
+        } else
+            break;
+    }
+}
+
+void R8TestScriptReader::ReadString() {
+    mCharStream->GoToNextChar();
+    mTokenString.clear();
+    while (mCharStream->IsValidCurrentChar() && (mCharStream->CurrentChar() != QChar('"'))) {
+        if (mCharStream->CurrentChar() == QChar('\n'))
+            break;
+        mTokenString += mCharStream->CurrentChar();
+        mCharStream->GoToNextChar();
+    }
+    if (!mCharStream->IsValidCurrentChar() || (mCharStream->CurrentChar() != QChar('"')))
+        throw R8TestSuiteException(mLine, QString("unterminated string"));
+    mCharStream->GoToNextChar();
+    mToken = STRING;
+}
+
+void R8TestScriptReader::ReadWord() {
+    mTokenString.clear();
+    while (mCharStream->IsValidCurrentChar()) {
+        QChar ch = mCharStream->CurrentChar();
+        if (!ch.isLetterOrNumber() && (ch != QChar('_')))
+            break;
+        mTokenString += ch;
+        mCharStream->GoToNextChar();
+    }
+    mToken = WORD;
+}
+
+void R8TestScriptReader::NextToken() {
+    SkipSpacesAndComments();
+    mLine = mCharStream->CurrentLine();
+    if (!mCharStream->IsValidCurrentChar()) {
+        mToken = END_OF_SCRIPT;
+        mTokenString = QString("end of file");
+        return;
+    }
+
+    QChar ch = mCharStream->CurrentChar();
+    if ((ch == QChar('{')) || (ch == QChar('}')) || (ch == QChar(';'))) {
+        mToken = (ch == QChar('{')) ? LEFT_BRACE : ((ch == QChar('}')) ? RIGHT_BRACE : SEMICOLON);
+        mTokenString = QString(ch);
+        mCharStream->GoToNextChar();
+    } else if (ch == QChar('"')) {
+        ReadString();
+    } else if (ch.isDigit() || (ch == QChar('-')) || (ch == QChar('+'))) {
+        try {
+            mLexer.NextToken(); //starts right at the number
+        } catch (const R8LexerException& ex) {
+            throw R8TestSuiteException(ex.LineNumber(), QString("unknown token \"%1\"").arg(ex.Info()));
+        }
+        if (mLexer.CurrentToken().Type() != R8Token::NUMBER)
+            throw R8TestSuiteException(mLine, QString("bad number \"%1\"").arg(mLexer.CurrentToken().TokenString()));
+        mToken = NUMBER;
+        mTokenString = mLexer.CurrentToken().TokenString();
+        mValue = mLexer.CurrentToken().Value();
+    } else if (ch.isLetter() || (ch == QChar('_'))) {
+        ReadWord();
+    } else
+        throw R8TestSuiteException(mLine, QString("unknown token \"%1\"").arg(ch));
+}
+
+
+void R8TestSuite::Parse(const QString &text) {
+    R8StringCharStream charStream(text);
+    R8TestScriptReader reader(&charStream);
+
+    bool isScript = false;
+    try {
+        reader.NextToken();
+        isScript = (reader.Token() == R8TestScriptReader::WORD) && (reader.TokenString() == "test");
+    } catch (const R8TestSuiteException&) {
+        //not a script, ParseTable() tells what is wrong
+    }
+
+    if (isScript)
+        ParseScript(text);
+    else
+        ParseTable(text);
+}
+
+void R8TestSuite::ParseScript(const QString &text) {
+    R8StringCharStream charStream(text);
+    R8TestScriptReader reader(&charStream);
+
+    for (reader.NextToken(); reader.Token() != R8TestScriptReader::END_OF_SCRIPT; ) {
+        if ((reader.Token() != R8TestScriptReader::WORD) || (reader.TokenString() != "test"))
+            throw R8TestSuiteException(reader.Line(), QString("\"test\" expected instead \"%1\"").arg(reader.TokenString()));
+        reader.NextToken();
+        reader.Expect(R8TestScriptReader::STRING, "test name");
+
+        R8TestCase test;
+        test.Name = reader.TokenString();
+        reader.NextToken();
+        reader.Expect(R8TestScriptReader::LEFT_BRACE, "\"{\"");
+
+        for (reader.NextToken(); reader.Token() != R8TestScriptReader::RIGHT_BRACE; reader.NextToken()) {
+            const bool isOut = (reader.Token() == R8TestScriptReader::WORD) && (reader.TokenString() == "out");
+            const bool isIn  = (reader.Token() == R8TestScriptReader::WORD) && (reader.TokenString() == "in");
+            if (!isOut && !isIn)
+                throw R8TestSuiteException(reader.Line(), QString("\"out\", \"in\" or \"}\" expected instead \"%1\"").arg(reader.TokenString()));
+
+            reader.NextToken();
+            reader.Expect(R8TestScriptReader::NUMBER, "value");
+            if (isOut)
+                test.Inputs.append(reader.Value());  //the program reads it
+            else
+                test.Outputs.append(reader.Value()); //the program must give it
+
+            reader.NextToken();
+            reader.Expect(R8TestScriptReader::SEMICOLON, "\";\"");
+        }
+        reader.NextToken();
+
+        mTests.append(test);
+    }
+}
+
+void R8TestSuite::ParseTable(const QString &text) {
+    R8StringCharStream charStream(text);
+    R8Lexer lexer;
+    lexer.SetSource(&charStream);
+
+    try {
+        lexer.NextToken();
+        while (lexer.CurrentToken().Type() != R8Token::END_OF_SOURCE) {
+            R8TestCase test;
+            test.Name = QString("line %1").arg(lexer.CurrentLine() + 1);
+
+            if ((lexer.CurrentToken().Type() != R8Token::IDENTIFIER) || (lexer.CurrentToken().TokenString() != "in"))
+                throw R8TestSuiteException(lexer.CurrentLine(), QString("\"in\" expected instead \"%1\"").arg(lexer.CurrentToken().TokenString()));
+            for (lexer.NextToken(); lexer.CurrentToken().Type() == R8Token::NUMBER; lexer.NextToken())
+                test.Inputs.append(lexer.CurrentToken().Value());
+
+            if ((lexer.CurrentToken().Type() != R8Token::IDENTIFIER) || (lexer.CurrentToken().TokenString() != "out"))
+                throw R8TestSuiteException(lexer.CurrentLine(), QString("\"out\" expected instead \"%1\"").arg(lexer.CurrentToken().TokenString()));
+            for (lexer.NextToken(); lexer.CurrentToken().Type() == R8Token::NUMBER; lexer.NextToken())
+                test.Outputs.append(lexer.CurrentToken().Value());
+
+            if ((lexer.CurrentToken().Type() == R8Token::IDENTIFIER) && (lexer.CurrentToken().TokenString() == "time")) {
+                lexer.NextToken(); //the clocks of the run the line was taken from
+                if (lexer.CurrentToken().Type() != R8Token::NUMBER)
+                    throw R8TestSuiteException(lexer.CurrentLine(), QString("clocks expected after \"time\""));
+                lexer.NextToken();
+            }
+
+            mTests.append(test);
+        }
+    } catch (const R8LexerException& ex) {
+        throw R8TestSuiteException(ex.LineNumber(), QString("unknown token \"%1\"").arg(ex.Info()));
+    }
+}
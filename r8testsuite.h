@@ -0,0 +1,59 @@
+#ifndef R8TESTSUITE_H
+#define R8TESTSUITE_H
+
+#include <QString>
+#include <QVector>
+
+#include "r8engine.h"
+
+class R8TestSuiteException {
+public:
+    R8TestSuiteException(unsigned int lineNumber, const QString& message) :
+        mLineNumber(lineNumber),mMessage(message) {}
+
+    unsigned int LineNumber() const {return mLineNumber;}
+    const QString& Message() const {return mMessage;}
+private:
+    unsigned int mLineNumber;
+    QString      mMessage;
+};
+
+// Values the program reads with "in" and the values its "out" must give
+struct R8TestCase {
+    QString                Name;
+    QVector<unsigned char> Inputs;
+    QVector<unsigned char> Outputs;
+};
+
+// Tests come in two formats, told apart by the first word of the text.
+//
+// Table: lines "in <values> out <values> [time <clocks>]", as "r8run -x"
+// prints them; the test name is its line.
+//
+// Script (see todo.txt): blocks that play the other side of the program's
+// ports, so the test "out"s what the program reads with "in" and its "in" is
+// what the program must "out":
+//     test "4*5=20" {
+//      out 4;
+//      out 5;
+//      in 0;  //high byte first
+//      in 20;
+//     }
+class R8TestSuite {
+public:
+    // Throws R8TestSuiteException
+    void Parse(const QString& text);
+    void ParseTable(const QString& text);
+    void ParseScript(const QString& text);
+
+    void Clear() {mTests.clear();}
+    void AddTest(const R8TestCase& test) {mTests.append(test);}
+
+    int Count() const {return mTests.size();}
+    const R8TestCase& Test(int index) const {return mTests[index];}
+
+private:
+    QVector<R8TestCase> mTests;
+};
+
+#endif // R8TESTSUITE_H
@@ -0,0 +1,280 @@
+#include "r8vectorengine.h"
+
+#include <climits>
+#include <cstring>
+
+template<class TLanes>
+R8BasicVectorEngine<TLanes>::R8BasicVectorEngine() {
+    SetProgram(R8Program());
+}
+
+template<class TLanes>
+void R8BasicVectorEngine<TLanes>::SetProgram(const R8Program &program) {
+    mDecoder.SetProgram(program);
+
+    const QVector<R8DecodedInstruction>& code = mDecoder.DecodedProgram();
+    mAluHandlers.resize(code.size());
+    for (int i=0; i<code.size(); ++i)
+        mAluHandlers[i] = (code[i].Handler == R8DecodedInstruction::ALU_HANDLER) ? TLanes::SelectAlu(code[i].Opcode) : 0;
+
+    Reset(0);
+}
+
+template<class TLanes>
+void R8BasicVectorEngine<TLanes>::Reset(int lanesCount) {
+    Q_ASSERT((0 <= lanesCount) && (lanesCount <= LANES_COUNT));
+
+    const R8DecodedInstruction& first = mDecoder.DecodedProgram()[0];
+
+    mLanes.Clear();
+    for (int lane=0; lane<LANES_COUNT; ++lane) {
+        mIPs[lane]   = 0;
+        mTimes[lane] = first.BlockCost;
+        mSteps[lane] = 0;
+        mStates[lane] = RUNNING;
+        mNextInputs[lane] = 0;
+        mInputs[lane].clear();
+        mOutputs[lane].clear();
+        if (lane >= lanesCount)
+            Stop(lane, HALTED, true);
+    }
+}
+
+template<class TLanes>
+void R8BasicVectorEngine<TLanes>::SetInputs(int lane, const QVector<unsigned char> &values) {
+    mInputs[lane] = values;
+    mNextInputs[lane] = 0;
+}
+
+template<class TLanes>
+unsigned int R8BasicVectorEngine<TLanes>::ExecutionTime(int lane) const {
+    if (mStates[lane] != RUNNING) //made exact by Stop()
+        return mTimes[lane];
+    return mTimes[lane] - mDecoder.DecodedProgram()[mIPs[lane]].BlockCost;
+}
+
+template<class TLanes>
+void R8BasicVectorEngine<TLanes>::Stop(int lane, ELaneState state, bool isHalted) {
+    mTimes[lane] -= mDecoder.DecodedProgram()[mIPs[lane]].BlockCost; //exact time, as R8BasicEngine stops
+    if (isHalted)
+        mIPs[lane] = (unsigned int)(mDecoder.DecodedProgram().size() - 1);
+    mStates[lane] = (unsigned char)state;
+}
+
+template<class TLanes>
+bool R8BasicVectorEngine<TLanes>::SelectLanes(unsigned int *ip) {
+    unsigned int minIP = UINT_MAX;
+    for (int lane=0; lane<LANES_COUNT; ++lane) {
+        if ((mStates[lane] == RUNNING) && (mIPs[lane] < minIP))
+            minIP = mIPs[lane];
+    }
+    if (minIP == UINT_MAX)
+        return false;
+
+    for (int lane=0; lane<LANES_COUNT; ++lane)
+        mMask[lane] = ((mStates[lane] == RUNNING) && (mIPs[lane] == minIP)) ? 0xFF : 0x00;
+    *ip = minIP;
+    return true;
+}
+
+template<class TLanes>
+void R8BasicVectorEngine<TLanes>::Run(unsigned long maxSteps) {
+    const R8DecodedInstruction *code = mDecoder.DecodedProgram().constData();
+    const unsigned int length = (unsigned int)(mDecoder.DecodedProgram().size() - 1);
+
+    unsigned int ip;
+    while (SelectLanes(&ip)) {
+        const R8DecodedInstruction& d = code[ip];
+
+        if ((maxSteps != 0) && (ip < length)) {
+            for (int lane=0; lane<LANES_COUNT; ++lane) {
+                if (mMask[lane] && (mSteps[lane] == maxSteps)) {
+                    Stop(lane, STEPS_EXCEEDED, false);
+                    mMask[lane] = 0x00;
+                }
+            }
+        }
+
+        switch (d.Handler) {
+        case R8DecodedInstruction::HALT_HANDLER:
+            for (int lane=0; lane<LANES_COUNT; ++lane) {
+                if (mMask[lane]) {
+                    if (ip < length) //the halt at the end is no step, as in R8BasicEngine::Execute()
+                        ++mSteps[lane];
+                    Stop(lane, HALTED, true);
+                }
+            }
+            continue;
+        case R8DecodedInstruction::INVALID_HANDLER:
+            for (int lane=0; lane<LANES_COUNT; ++lane) {
+                if (mMask[lane])
+                    Stop(lane, FAULTED, false);
+            }
+            continue;
+        case R8DecodedInstruction::IN_HANDLER:
+            In(d);
+            break;
+        case R8DecodedInstruction::OUT_HANDLER:
+            Out(d);
+            break;
+        case R8DecodedInstruction::ALU_HANDLER:
+            (mLanes.*mAluHandlers[ip])(d, mMask);
+            for (int lane=0; lane<LANES_COUNT; ++lane) {
+                if (mMask[lane]) {
+                    ++mIPs[lane];
+                    mTimes[lane] += d.FallCost;
+                }
+            }
+            break;
+        default: //jumps
+            Jump(d);
+            break;
+        }
+
+        for (int lane=0; lane<LANES_COUNT; ++lane)
+            mSteps[lane] += (mMask[lane] & 1);
+    }
+}
+
+template<class TLanes>
+void R8BasicVectorEngine<TLanes>::In(const R8DecodedInstruction &d) {
+    unsigned char x[LANES_COUNT];
+    for (int lane=0; lane<LANES_COUNT; ++lane) {
+        x[lane] = 0;
+        if (!mMask[lane])
+            continue;
+
+        if (mNextInputs[lane] < mInputs[lane].size()) {
+            x[lane] = mInputs[lane][mNextInputs[lane]++];
+        } else {
+            ++mSteps[lane];
+            Stop(lane, INPUT_EXHAUSTED, true);
+            mMask[lane] = 0x00;
+        }
+    }
+    mLanes.Write(d.ModeR, d.ValueR, x, mMask);
+
+    for (int lane=0; lane<LANES_COUNT; ++lane) {
+        if (mMask[lane]) {
+            ++mIPs[lane];
+            mTimes[lane] += d.FallCost;
+        }
+    }
+}
+
+template<class TLanes>
+void R8BasicVectorEngine<TLanes>::Out(const R8DecodedInstruction &d) {
+    unsigned char x[LANES_COUNT];
+    mLanes.Read(d.Mode1, d.Value1, x);
+
+    for (int lane=0; lane<LANES_COUNT; ++lane) {
+        if (mMask[lane]) {
+            mOutputs[lane].append(x[lane]);
+            ++mIPs[lane];
+            mTimes[lane] += d.FallCost;
+        }
+    }
+}
+
+template<class TLanes>
+void R8BasicVectorEngine<TLanes>::Jump(const R8DecodedInstruction &d) {
+    unsigned char isTaken[LANES_COUNT];
+    mLanes.Equals(d.Mode1, d.Value1, (d.Opcode == R8Instruction::JZ_OPCODE) ? 0x00 : 0xFF, isTaken);
+
+    for (int lane=0; lane<LANES_COUNT; ++lane) {
+        if (!mMask[lane])
+            continue;
+
+        if (isTaken[lane]) {
+            mIPs[lane]    = d.Target;
+            mTimes[lane] += d.JumpCost;
+        } else {
+            ++mIPs[lane];
+            mTimes[lane] += d.FallCost;
+        }
+    }
+}
+
+void R8ByteLanes::Clear() {
+    std::memset(mRegisters, 0, sizeof(mRegisters));
+    std::memset(mMemoryCells, 0, sizeof(mMemoryCells));
+}
+
+// Rows of registers and memory are read whole; only [rX] gathers by lane.
+void R8ByteLanes::Read(unsigned char mode, unsigned char value, unsigned char *x) const {
+    switch (mode) {
+    case R8Reference::REGISTER:
+        std::memcpy(x, mRegisters[value], LANES_COUNT);
+        break;
+    case R8Reference::MEMORY_BY_CONSTANT:
+        std::memcpy(x, mMemoryCells[value], LANES_COUNT);
+        break;
+    case R8Reference::MEMORY_BY_REGISTER:
+        for (int lane=0; lane<LANES_COUNT; ++lane)
+            x[lane] = mMemoryCells[mRegisters[value][lane]][lane];
+        break;
+    default: //CONSTANT
+        std::memset(x, value, LANES_COUNT);
+        break;
+    }
+}
+
+// Rows are blended by the mask; [rX] scatters the selected lanes only.
+void R8ByteLanes::Write(unsigned char mode, unsigned char value, const unsigned char *r, const unsigned char *mask) {
+    unsigned char *row = 0;
+    switch (mode) {
+    case R8Reference::REGISTER:
+        row = mRegisters[value];
+        break;
+    case R8Reference::MEMORY_BY_CONSTANT:
+        row = mMemoryCells[value];
+        break;
+    default: //MEMORY_BY_REGISTER
+        for (int lane=0; lane<LANES_COUNT; ++lane) {
+            if (mask[lane])
+                mMemoryCells[mRegisters[value][lane]][lane] = r[lane];
+        }
+        return;
+    }
+
+    for (int lane=0; lane<LANES_COUNT; ++lane)
+        row[lane] = (r[lane] & mask[lane]) | (row[lane] & ~mask[lane]);
+}
+
+void R8ByteLanes::Equals(unsigned char mode, unsigned char value, unsigned char expected, unsigned char *isEqual) const {
+    Read(mode, value, isEqual);
+    for (int lane=0; lane<LANES_COUNT; ++lane)
+        isEqual[lane] = (isEqual[lane] == expected) ? 0xFF : 0x00;
+}
+
+template<class TOperation>
+void R8ByteLanes::Alu(const R8DecodedInstruction &d, const unsigned char *mask) {
+    unsigned char x[LANES_COUNT];
+    unsigned char y[LANES_COUNT];
+    Read(d.Mode1, d.Value1, x);
+    Read(d.Mode2, d.Value2, y);
+
+    unsigned char r[LANES_COUNT];
+    for (int lane=0; lane<LANES_COUNT; ++lane)
+        r[lane] = TOperation::Apply(x[lane], y[lane]);
+
+    Write(d.ModeR, d.ValueR, r, mask);
+}
+
+R8ByteLanes::TAluHandler R8ByteLanes::SelectAlu(unsigned char opcode) {
+    switch (opcode) {
+    case R8Instruction::ROR_OPCODE:  return &R8ByteLanes::Alu<R8RorOperation>;
+    case R8Instruction::ROL_OPCODE:  return &R8ByteLanes::Alu<R8RolOperation>;
+    case R8Instruction::NOT_OPCODE:  return &R8ByteLanes::Alu<R8NotOperation>;
+    case R8Instruction::OR_OPCODE:   return &R8ByteLanes::Alu<R8OrOperation>;
+    case R8Instruction::AND_OPCODE:  return &R8ByteLanes::Alu<R8AndOperation>;
+    case R8Instruction::NOR_OPCODE:  return &R8ByteLanes::Alu<R8NorOperation>;
+    case R8Instruction::NAND_OPCODE: return &R8ByteLanes::Alu<R8NandOperation>;
+    case R8Instruction::XOR_OPCODE:  return &R8ByteLanes::Alu<R8XorOperation>;
+    case R8Instruction::ADD_OPCODE:  return &R8ByteLanes::Alu<R8AddOperation>;
+    default:                         return &R8ByteLanes::Alu<R8SubOperation>;
+    }
+}
+
+template class R8BasicVectorEngine<R8ByteLanes>;
+template class R8BasicVectorEngine<R8BitLanes>;
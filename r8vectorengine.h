@@ -0,0 +1,167 @@
+#ifndef R8VECTORENGINE_H
+#define R8VECTORENGINE_H
+
+#include <QtGlobal>
+#include <QVector>
+
+#include "r8engine.h"
+
+// Lane policies of R8BasicVectorEngine: the registers and memory of all lanes
+// and the operations on them. Operations that write take the lanes of the
+// step as a mask, 0xFF for the lanes to change and 0x00 for the others.
+
+// Structure of arrays: byte i of every lane lies in one row, so an instruction
+// is applied to all lanes by plain byte loops that the compiler turns into
+// SIMD code.
+class R8ByteLanes {
+public:
+    static const int LANES_COUNT = 64;
+
+    typedef void (R8ByteLanes::*TAluHandler)(const R8DecodedInstruction& d, const unsigned char *mask);
+    static TAluHandler SelectAlu(unsigned char opcode);
+
+    void Clear();
+
+    unsigned char Register(int lane, unsigned int index) const {return mRegisters[index][lane];}
+    unsigned char MemoryCell(int lane, unsigned int index) const {return mMemoryCells[index][lane];}
+
+    void Read(unsigned char mode, unsigned char value, unsigned char *x) const;
+    void Write(unsigned char mode, unsigned char value, const unsigned char *r, const unsigned char *mask);
+    void Equals(unsigned char mode, unsigned char value, unsigned char expected, unsigned char *isEqual) const;
+
+private:
+    unsigned char mRegisters[R8BatchEngine::REGISTERS_COUNT][LANES_COUNT];
+    unsigned char mMemoryCells[R8BatchEngine::MEMORY_SIZE][LANES_COUNT];
+
+    template<class TOperation> void Alu(const R8DecodedInstruction& d, const unsigned char *mask);
+};
+
+// One bit of LANES_COUNT lanes
+struct R8BitPlane {
+    static const int WORDS_COUNT = 4;
+    quint64 Words[WORDS_COUNT];
+
+    static R8BitPlane Fill(bool bit);
+    bool IsEmpty() const;
+
+    R8BitPlane operator~() const;
+    R8BitPlane operator&(const R8BitPlane& plane) const;
+    R8BitPlane operator|(const R8BitPlane& plane) const;
+    R8BitPlane operator^(const R8BitPlane& plane) const;
+};
+
+// Bitsliced: every byte of the state is 8 bit planes, so an ALU instruction is
+// a few word operations per bit for all lanes at once (a carry chain for
+// add/sub, a barrel of plane permutations for rol/ror). [rX] compares the
+// address planes with every memory index.
+class R8BitLanes {
+public:
+    static const int LANES_COUNT = 64*R8BitPlane::WORDS_COUNT;
+
+    typedef void (R8BitLanes::*TAluHandler)(const R8DecodedInstruction& d, const unsigned char *mask);
+    static TAluHandler SelectAlu(unsigned char opcode);
+
+    void Clear();
+
+    unsigned char Register(int lane, unsigned int index) const {return Unslice(mRegisters[index], lane);}
+    unsigned char MemoryCell(int lane, unsigned int index) const {return Unslice(mMemoryCells[index], lane);}
+
+    void Read(unsigned char mode, unsigned char value, unsigned char *x) const;
+    void Write(unsigned char mode, unsigned char value, const unsigned char *r, const unsigned char *mask);
+    void Equals(unsigned char mode, unsigned char value, unsigned char expected, unsigned char *isEqual) const;
+
+private:
+    struct TByte {
+        R8BitPlane Bits[8];
+    };
+
+    TByte mRegisters[R8BatchEngine::REGISTERS_COUNT];
+    TByte mMemoryCells[R8BatchEngine::MEMORY_SIZE];
+
+    static unsigned char Unslice(const TByte& x, int lane);
+    static R8BitPlane MaskPlane(const unsigned char *mask);
+    static R8BitPlane EqualsPlane(const TByte& x, unsigned char expected);
+
+    void ReadByte(unsigned char mode, unsigned char value, TByte& x) const;
+    void WriteByte(unsigned char mode, unsigned char value, const TByte& r, const R8BitPlane& mask);
+
+    template<class TOperation> void Alu(const R8DecodedInstruction& d, const unsigned char *mask);
+};
+
+
+// Runs one program over TLanes::LANES_COUNT independent inputs at once, e.g. to
+// grade it on every (A,B) pair.
+//
+// Lanes have their own IPs. Every step executes the instruction with the least
+// IP of the running lanes for the lanes at that IP (the others are masked), so
+// lanes that went different ways of a jz/jo join again after it.
+//
+// Instructions decoded as invalid (they throw or may jump beyond the program)
+// are not executed: the lane stops as FAULTED before it, and its input is left
+// to R8BasicEngine.
+//
+// Instantiated in r8vectorengine.cpp for the lanes above only.
+template<class TLanes>
+class R8BasicVectorEngine {
+public:
+    enum ELaneState {
+        RUNNING,
+        HALTED,
+        INPUT_EXHAUSTED, //halted on "in" without a value
+        FAULTED,         //stopped before an invalid instruction, state is not final
+        STEPS_EXCEEDED
+    };
+
+    static const int LANES_COUNT = TLanes::LANES_COUNT;
+
+    R8BasicVectorEngine();
+
+    void SetProgram(const R8Program& program);
+
+    // Lanes [0, lanesCount) start from the initial state with no input values,
+    // the others are idle (HALTED).
+    void Reset(int lanesCount);
+    void SetInputs(int lane, const QVector<unsigned char>& values);
+
+    // Runs until no lane is RUNNING; maxSteps (0 - no limit) is per lane.
+    void Run(unsigned long maxSteps);
+
+    ELaneState LaneState(int lane) const {return (ELaneState)mStates[lane];}
+    unsigned int IP(int lane) const {return mIPs[lane];}
+    unsigned int ExecutionTime(int lane) const;
+    unsigned long Steps(int lane) const {return mSteps[lane];}
+    int InputsRead(int lane) const {return mNextInputs[lane];}
+
+    unsigned char Register(int lane, unsigned int index) const {return mLanes.Register(lane, index);}
+    unsigned char MemoryCell(int lane, unsigned int index) const {return mLanes.MemoryCell(lane, index);}
+    const QVector<unsigned char>& Outputs(int lane) const {return mOutputs[lane];}
+
+private:
+    R8BatchEngine                 mDecoder; //decodes and accounts the program like the scalar engine does
+    QVector<typename TLanes::TAluHandler> mAluHandlers; //by ip
+
+    TLanes         mLanes;
+    unsigned int   mIPs[LANES_COUNT];
+    unsigned int   mTimes[LANES_COUNT];   //with the prepaid rest of the block, see R8DecodedInstruction
+    unsigned long  mSteps[LANES_COUNT];
+    unsigned char  mStates[LANES_COUNT];  //ELaneState
+    unsigned char  mMask[LANES_COUNT];    //0xFF for lanes of the current step
+
+    QVector<unsigned char> mInputs[LANES_COUNT];
+    int                    mNextInputs[LANES_COUNT];
+    QVector<unsigned char> mOutputs[LANES_COUNT];
+
+    bool SelectLanes(unsigned int *ip); //lanes with the least IP
+    void Stop(int lane, ELaneState state, bool isHalted);
+
+    void In(const R8DecodedInstruction& d);
+    void Out(const R8DecodedInstruction& d);
+    void Jump(const R8DecodedInstruction& d);
+
+    Q_DISABLE_COPY(R8BasicVectorEngine)
+};
+
+typedef R8BasicVectorEngine<R8ByteLanes> R8VectorEngine;     //64 lanes of bytes
+typedef R8BasicVectorEngine<R8BitLanes>  R8BitslicedEngine;  //256 lanes of bit planes
+
+#endif // R8VECTORENGINE_H